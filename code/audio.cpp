@@ -0,0 +1,798 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "audio.h"
+#include "intern.h"
+#include "timer.h"
+
+// A music command that hangs (e.g: mpc with MPD gone) is not run
+// anymore this session: each cue would wait for it otherwise.
+internal void run_music_command(Audio *audio, Command *command)
+{
+	if (audio->music_broken)
+	{
+		return;
+	}
+
+	if (child_exec(command, CHILD_EXEC_NO_STDOUT, MUSIC_COMMAND_TIMEOUT) == CHILD_TIMED_OUT)
+	{
+		fprintf(stderr, "%s: the music commands are not run anymore this session.\n", PROGRAM);
+
+		audio->music_broken = true;
+	}
+}
+
+// NOTE: The mixer turns the music down on its own.
+internal void set_music(Audio *audio, b32 on)
+{
+	Config *config = audio->config;
+
+	if (audio->mixing)
+	{
+		return;
+	}
+
+	run_music_command(audio, on ? &config->music_on : &config->music_off);
+}
+
+b32 render_speech(Command *command, const char *text, i16 **samples, u64 *sample_count)
+{
+	*samples	  = NULL;
+	*sample_count = 0;
+
+	int in_pipe[2],
+		out_pipe[2];
+
+	if (pipe2(in_pipe, O_CLOEXEC) == -1)
+	{
+		return false;
+	}
+
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+
+		return false;
+	}
+
+	pid_t pid = spawn_child(command->argv, CHILD_EXEC_VERBOSE, in_pipe[0], out_pipe[1]);
+
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+
+	if (pid == -1)
+	{
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+
+		return false;
+	}
+
+	// Short enough to never fill the pipe.
+	write(in_pipe[1], text, strlen(text));
+	write(in_pipe[1], "\n", 1);
+	close(in_pipe[1]);
+
+	u64 deadline = get_monotonic_ns() + RENDER_TTS_TIMEOUT * 1000000ULL;
+
+	u8 *audio = NULL;
+	size_t size = 0,
+		   capacity = 0;
+
+	for (;;)
+	{
+		u64 now = get_monotonic_ns();
+
+		struct pollfd poll_fd = { out_pipe[0], POLLIN, 0 };
+
+		// Past the deadline, wait_child kills it.
+		if ((now >= deadline) || (poll(&poll_fd, 1, (int) ((deadline - now) / 1000000ULL)) <= 0))
+		{
+			break;
+		}
+
+		if (size == capacity)
+		{
+			capacity = MAX(65536, capacity * 2);
+			audio = (u8 *) realloc(audio, capacity);
+		}
+
+		ssize_t num_read = read(out_pipe[0], audio + size, capacity - size);
+
+		if (num_read <= 0)
+		{
+			if ((num_read == -1) && (errno == EINTR))
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		size += num_read;
+	}
+
+	close(out_pipe[0]);
+
+	u64 now = get_monotonic_ns();
+	u32 remaining = (now < deadline) ? (u32) ((deadline - now) / 1000000ULL) : 0;
+
+	b32 said = (wait_child(pid, remaining) == CHILD_OK);
+
+	*samples	  = (i16 *) audio;
+	*sample_count = said ? size / sizeof(i16) : 0;
+
+	return said;
+}
+
+internal void load_speech_lengths(Speech *speech)
+{
+	char path[512];
+	FILE *file;
+
+	speech->length_count = 0;
+	speech->next_replaced_length = 0;
+
+	if (!cache_file_path(path, sizeof(path), "spoken_lengths", false) ||
+		!(file = fopen(path, "r")))
+	{
+		return;
+	}
+
+	// DURATION TEXT, one per line (ids are only good for this run).
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_len;
+
+	while ((speech->length_count < MAX_SPEECH_LENGTH_COUNT) &&
+		   ((line_len = getline(&line, &line_size, file)) != -1))
+	{
+		char *text;
+		u32 duration = strtoul(line, &text, 10);
+
+		if ((text == line) || (*text != ' ') || (line_len < 2) || (line[line_len - 1] != '\n'))
+		{
+			continue;
+		}
+
+		++text;
+
+		SpeechLength *length = speech->all_lengths + speech->length_count++;
+
+		length->text	 = intern_string(text, line + line_len - 1 - text);
+		length->duration = duration;
+	}
+
+	free(line);
+	fclose(file);
+}
+
+internal void save_speech_lengths(Speech *speech)
+{
+	char path[512];
+	FILE *file;
+
+	if (!speech->length_count ||
+		!cache_file_path(path, sizeof(path), "spoken_lengths", true) ||
+		!(file = fopen(path, "w")))
+	{
+		return;
+	}
+
+	for (int i = 0; i < speech->length_count; ++i)
+	{
+		fprintf(file, "%u %s\n", speech->all_lengths[i].duration, get_string(speech->all_lengths[i].text));
+	}
+
+	fclose(file);
+}
+
+// NOTE: Festival is kept in pipe mode (reads scheme expressions from
+//       stdin). Once a text has been said, it prints a line back, so
+//       we know when it is done, and how long it took.
+int tts_warm_up(Config *config, Speech *speech)
+{
+	speech->pid = 0;
+	speech->pending_count = 0;
+
+	if (!config->voice_on)
+	{
+		return 0;
+	}
+
+	load_speech_lengths(speech);
+
+	// Said through the mixer instead (see speak_through_mixer).
+	if (config->mixer.argc || (config->mixer_file[0] != '\0'))
+	{
+		return 0;
+	}
+
+	int in_pipe[2],
+		out_pipe[2];
+
+	// Close-on-exec: only festival keeps its ends (as stdin and
+	// stdout), and no other child keeps any.
+	if (pipe2(in_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return -1;
+	}
+
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		return -1;
+	}
+
+	char *argv[] = { "festival", "--pipe", NULL };
+	pid_t child_pid = spawn_child(argv, CHILD_EXEC_VERBOSE, in_pipe[0], out_pipe[1]);
+
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+
+	if (child_pid == -1)
+	{
+		close(in_pipe[1]);
+		close(out_pipe[0]);
+		return -2;
+	}
+
+	speech->pid	   = child_pid;
+	speech->in_fd  = in_pipe[1];
+	speech->out_fd = out_pipe[0];
+
+	return 0;
+}
+
+internal void stop_festival(Speech *speech)
+{
+	if (!speech->pid)
+	{
+		return;
+	}
+
+	close(speech->in_fd);
+	close(speech->out_fd);
+
+	stop_child(speech->pid);
+
+	speech->pid = 0;
+	speech->pending_count = 0;
+}
+
+internal void free_clips(Speech *speech)
+{
+	for (int i = 0; i < speech->clip_count; ++i)
+	{
+		free(speech->all_clips[i].samples);
+	}
+
+	speech->clip_count = 0;
+}
+
+void tts_shutdown(Speech *speech)
+{
+	save_speech_lengths(speech);
+	stop_festival(speech);
+	free_clips(speech);
+}
+
+// Returns 0 once festival has been given the text (it is said in the
+// background, see collect_speech), anything else if it is not
+// listening anymore.
+internal int warm_tts_send(Speech *speech, const char *text)
+{
+	char buffer[512];
+	int num_written = snprintf(buffer, sizeof(buffer) - 1, "(SayText \"");
+
+	for (const char *c = text; *c && (num_written < (int) sizeof(buffer) - 64); ++c)
+	{
+		if ((*c == '"') || (*c == '\\'))
+		{
+			buffer[num_written++] = '\\';
+		}
+
+		buffer[num_written++] = *c;
+	}
+
+	num_written += snprintf(buffer + num_written, sizeof(buffer) - num_written - 1,
+							"\")\n(format t \"done\\n\")\n(fflush nil)\n");
+
+	if (write(speech->in_fd, buffer, num_written) != num_written)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+internal void finish_text(Audio *audio)
+{
+	ATOMIC_STORE(&audio->done_count, audio->done_count + 1);
+}
+
+internal void push_event(Audio *audio, u32 text, u64 duration_ns)
+{
+	AudioEvent event = { text, (u32) (duration_ns / 1000000) };
+
+	// The session is that far behind: it guesses this one's length.
+	ring_push(&audio->events, &event);
+
+	finish_text(audio);
+}
+
+internal void give_up_on_festival(Audio *audio)
+{
+	fprintf(stderr, "%s: festival is not responding, falling back to one process per text.\n",
+			PROGRAM);
+
+	for (int i = 0; i < audio->speech->pending_count; ++i)
+	{
+		finish_text(audio);
+	}
+
+	stop_festival(audio->speech);
+	set_music(audio, 1);
+}
+
+// Takes note of every text festival is done with (and turns the music
+// back on once it is done with all of them). If WAIT, it does not
+// return before that.
+internal void collect_speech(Audio *audio, b32 wait)
+{
+	Speech *speech = audio->speech;
+
+	while (speech && speech->pid && speech->pending_count)
+	{
+		struct pollfd poll_fd = { speech->out_fd, POLLIN, 0 };
+
+		int ready = poll(&poll_fd, 1, wait ? SPEECH_TIMEOUT : 0);
+
+		if (!ready && !wait)
+		{
+			return;
+		}
+
+		char buffer[64];
+		ssize_t num_read;
+
+		if ((ready <= 0) || ((num_read = read(speech->out_fd, buffer, sizeof(buffer))) <= 0))
+		{
+			give_up_on_festival(audio);
+			return;
+		}
+
+		u64 now = get_monotonic_ns();
+
+		// One line per text.
+		for (ssize_t i = 0; (i < num_read) && speech->pending_count; ++i)
+		{
+			if (buffer[i] != '\n')
+			{
+				continue;
+			}
+
+			// Festival says them one after the other.
+			u64 start = MAX(speech->all_pending_starts[0], speech->last_done);
+			push_event(audio, speech->all_pending_texts[0], now - start);
+
+			--speech->pending_count;
+
+			memmove(speech->all_pending_texts, speech->all_pending_texts + 1,
+					speech->pending_count * sizeof(u32));
+			memmove(speech->all_pending_starts, speech->all_pending_starts + 1,
+					speech->pending_count * sizeof(u64));
+
+			speech->last_done = now;
+		}
+
+		if (!speech->pending_count)
+		{
+			set_music(audio, 1);
+		}
+
+		// Only what was there to read.
+		if (!wait)
+		{
+			return;
+		}
+	}
+}
+
+// Takes note of every clip the mixer is done with. If WAIT, it does not
+// return before it is done with all of them.
+internal void collect_mixer(Audio *audio, b32 wait)
+{
+	Mixer *mixer = &audio->mixer;
+
+	while (audio->mixer_pending_count)
+	{
+		eventfd_t value;
+		eventfd_read(mixer->done_fd, &value);
+
+		MixerDone done;
+
+		while (mixer_next_done(mixer, &done))
+		{
+			push_event(audio, done.text, done.duration);
+			--audio->mixer_pending_count;
+		}
+
+		if (!wait || !audio->mixer_pending_count)
+		{
+			return;
+		}
+
+		struct pollfd poll_fd = { mixer->done_fd, POLLIN, 0 };
+
+		// NOTE: The mixer never waits for anything, so this is only
+		//       in case.
+		if (poll(&poll_fd, 1, SPEECH_TIMEOUT) <= 0)
+		{
+			for (int i = 0; i < audio->mixer_pending_count; ++i)
+			{
+				finish_text(audio);
+			}
+
+			audio->mixer_pending_count = 0;
+		}
+	}
+}
+
+internal SpeechClip *find_clip(Speech *speech, u32 text)
+{
+	for (int i = 0; i < speech->clip_count; ++i)
+	{
+		if (speech->all_clips[i].text == text)
+		{
+			return speech->all_clips + i;
+		}
+	}
+
+	return NULL;
+}
+
+// Each text is said through render_tts once, and kept: the mixer says
+// it again from then on. Returns once the mixer has been given it.
+internal void speak_through_mixer(Audio *audio, u32 text)
+{
+	Speech *speech = audio->clip_cache;
+
+	SpeechClip *clip = speech ? find_clip(speech, text) : NULL;
+
+	if (speech && !clip)
+	{
+		if (speech->clip_count == MAX_SPEECH_CLIP_COUNT)
+		{
+			// Only once the mixer is done with every one of them.
+			collect_mixer(audio, true);
+			free_clips(speech);
+		}
+
+		i16 *samples;
+		u64 sample_count;
+
+		render_speech(&audio->config->render_tts, get_string(text), &samples, &sample_count);
+
+		if (sample_count)
+		{
+			clip = speech->all_clips + speech->clip_count++;
+
+			clip->text		   = text;
+			clip->samples	   = samples;
+			clip->sample_count = (u32) MIN(sample_count, (u64) UINT32_MAX);
+		}
+		else
+		{
+			free(samples);
+		}
+	}
+
+	if (!clip)
+	{
+		finish_text(audio);
+		return;
+	}
+
+	if (audio->mixer_pending_count == MAX_MIXER_CLIP_COUNT)
+	{
+		// That far behind: waits for the mixer to catch up.
+		collect_mixer(audio, true);
+	}
+
+	if (!mixer_say(&audio->mixer, clip->samples, clip->sample_count, text))
+	{
+		finish_text(audio);
+		return;
+	}
+
+	++audio->mixer_pending_count;
+}
+
+// TODO: Use tts' config Command instead of festival.
+//       Check if tts is stdin or not (if not, add text to command's
+//       arguments).
+//       (Config file parsing is already done)
+// NOTE: With the resident festival, the text is said in the background
+//       (see collect_speech). Without it, this returns once it is said.
+internal void speak(Audio *audio, u32 text)
+{
+	Speech *speech = audio->speech;
+
+	if (audio->mixing)
+	{
+		speak_through_mixer(audio, text);
+		return;
+	}
+
+	if (speech && speech->pid && (speech->pending_count == MAX_PENDING_UTTERANCE_COUNT))
+	{
+		// That far behind: waits for festival to catch up.
+		collect_speech(audio, true);
+	}
+
+	if (speech && speech->pid)
+	{
+		if (!speech->pending_count)
+		{
+			set_music(audio, 0);
+		}
+
+		if (warm_tts_send(speech, get_string(text)) == 0)
+		{
+			int index = speech->pending_count++;
+
+			speech->all_pending_texts[index] = text;
+			speech->all_pending_starts[index] = get_monotonic_ns();
+
+			return;
+		}
+
+		give_up_on_festival(audio);
+	}
+
+	int pipe_fd[2];
+
+	if (pipe2(pipe_fd, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+
+		finish_text(audio);
+		return;
+	}
+
+	set_music(audio, 0);
+
+	u64 start = get_monotonic_ns();
+
+	// FIXME: Use config->tts
+	char *argv[] = { "festival", "--tts", NULL };
+	pid_t child_pid = spawn_child(argv, CHILD_EXEC_VERBOSE, pipe_fd[0], -1);
+
+	close(pipe_fd[0]);
+
+	if (child_pid != -1)
+	{
+		char buffer[255];
+		int num_written = snprintf(buffer, sizeof(buffer) - 1, "%s\n", get_string(text));
+		buffer[num_written] = '\0';
+
+		write(pipe_fd[1], buffer, num_written + 1);
+	}
+
+	close(pipe_fd[1]);
+
+	if ((child_pid != -1) && (wait_child(child_pid, SPEECH_TIMEOUT) == CHILD_OK))
+	{
+		push_event(audio, text, get_monotonic_ns() - start);
+	}
+	else
+	{
+		finish_text(audio);
+	}
+
+	set_music(audio, 1);
+}
+
+internal void *audio_thread(void *data)
+{
+	Audio *audio = (Audio *) data;
+	Speech *speech = audio->speech;
+
+	b32 quitting = false;
+
+	for (;;)
+	{
+		AudioCommand command;
+
+		while (!quitting && ring_pop(&audio->commands, &command))
+		{
+			switch (command.type)
+			{
+				case AUDIO_SAY:
+				{
+					speak(audio, command.text);
+					break;
+				}
+
+				case AUDIO_MUSIC_INIT:
+				{
+					run_music_command(audio, &audio->config->music_init);
+					break;
+				}
+
+				case AUDIO_MUSIC_ON:
+				{
+					set_music(audio, 1);
+					break;
+				}
+
+				case AUDIO_QUIT:
+				{
+					quitting = true;
+					break;
+				}
+			}
+		}
+
+		b32 is_speaking = (speech && speech->pid && speech->pending_count);
+
+		if (quitting)
+		{
+			collect_speech(audio, true);
+			collect_mixer(audio, true);
+			break;
+		}
+
+		struct pollfd all_poll_fds[3] =
+		{
+			{ audio->wake_fd, POLLIN, 0 },
+			{ is_speaking ? speech->out_fd : -1, POLLIN, 0 },
+			{ audio->mixer_pending_count ? audio->mixer.done_fd : -1, POLLIN, 0 },
+		};
+
+		int ready = poll(all_poll_fds, ARRAY_SIZE(all_poll_fds), is_speaking ? SPEECH_TIMEOUT : -1);
+
+		if ((ready == 0) && is_speaking)
+		{
+			give_up_on_festival(audio);
+			continue;
+		}
+
+		if (all_poll_fds[0].revents & POLLIN)
+		{
+			u64 count;
+			read(audio->wake_fd, &count, sizeof(count));
+		}
+
+		if (all_poll_fds[1].revents)
+		{
+			collect_speech(audio, false);
+		}
+
+		if (all_poll_fds[2].revents)
+		{
+			collect_mixer(audio, false);
+		}
+	}
+
+	return NULL;
+}
+
+b32 audio_start(Audio *audio, Config *config, Speech *speech)
+{
+	audio->config = config;
+	audio->speech = (speech && speech->pid) ? speech : NULL;
+	audio->clip_cache = speech;
+	audio->running = false;
+	audio->music_broken = false;
+	audio->mixer_pending_count = 0;
+
+	audio->sent_count = 0;
+	audio->done_count = 0;
+
+	if ((audio->wake_fd = eventfd(0, EFD_CLOEXEC)) == -1)
+	{
+		perror("eventfd");
+		return false;
+	}
+
+	// NOTE: Without it, speech and music go through festival and the
+	//       music commands.
+	audio->mixing = mixer_start(&audio->mixer, config);
+
+	// What was left from the last run has been taken note of.
+	ring_free(&audio->events);
+
+	ring_init(&audio->commands, sizeof(AudioCommand), 64);
+	ring_init(&audio->events, sizeof(AudioEvent), 64);
+
+	if (pthread_create(&audio->thread, NULL, audio_thread, audio) != 0)
+	{
+		fprintf(stderr, "%s: could not start the audio thread.\n", PROGRAM);
+
+		ring_free(&audio->commands);
+		ring_free(&audio->events);
+		close(audio->wake_fd);
+
+		if (audio->mixing)
+		{
+			mixer_stop(&audio->mixer);
+			audio->mixing = false;
+		}
+
+		return false;
+	}
+
+	audio->running = true;
+
+	return true;
+}
+
+void audio_stop(Audio *audio)
+{
+	if (!audio->running)
+	{
+		return;
+	}
+
+	// Waits for room, the thread is not going anywhere else.
+	while (!audio_send(audio, AUDIO_QUIT))
+	{
+		usleep(1000);
+	}
+
+	pthread_join(audio->thread, NULL);
+
+	audio->running = false;
+
+	if (audio->mixing)
+	{
+		mixer_stop(&audio->mixer);
+		audio->mixing = false;
+	}
+
+	close(audio->wake_fd);
+	ring_free(&audio->commands);
+
+	// NOTE: The events are kept until the next start, so whatever was
+	//       said last can still be taken note of.
+}
+
+b32 audio_send(Audio *audio, u32 type, u32 text)
+{
+	AudioCommand command = { type, text };
+
+	if (!audio->running || !ring_push(&audio->commands, &command))
+	{
+		return false;
+	}
+
+	if (type == AUDIO_SAY)
+	{
+		++audio->sent_count;
+	}
+
+	u64 one = 1;
+	write(audio->wake_fd, &one, sizeof(one));
+
+	return true;
+}
+
+b32 audio_next_event(Audio *audio, AudioEvent *event)
+{
+	return (audio->events.all_elements && ring_pop(&audio->events, event));
+}
+
+b32 audio_is_busy(Audio *audio)
+{
+	return (audio->sent_count != ATOMIC_LOAD(&audio->done_count));
+}
@@ -0,0 +1,163 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "mixer.h"
+#include "ring.h"
+#include "supervisor.h"
+
+// In milliseconds: nothing we say takes more than that.
+#define SPEECH_TIMEOUT 10000
+
+// In milliseconds, for each music command (see run_music_command).
+#define MUSIC_COMMAND_TIMEOUT 1000
+
+// In milliseconds, for render_speech.
+#define RENDER_TTS_TIMEOUT 30000
+
+#define MAX_SPEECH_LENGTH_COUNT		128
+#define MAX_PENDING_UTTERANCE_COUNT 8
+#define MAX_SPEECH_CLIP_COUNT		256
+
+// How long an utterance took to say last time (see estimate_speech).
+struct SpeechLength
+{
+	// Interned.
+	u32 text;
+
+	// In milliseconds.
+	u32 duration;
+};
+
+// A text said once through render_tts, for the mixer to say again.
+struct SpeechClip
+{
+	// Interned.
+	u32 text;
+
+	i16 *samples;
+	u32 sample_count;
+};
+
+// Resident festival process, so each cue does not pay for its
+// start-up (see tts_warm_up).
+struct Speech
+{
+	int pid;
+
+	int in_fd;
+	int out_fd;
+
+	// Sent to festival, not said yet (oldest first). Times are
+	// CLOCK_MONOTONIC, as a Speech outlives sessions.
+	// Only the audio thread touches those while it runs.
+	u32 all_pending_texts[MAX_PENDING_UTTERANCE_COUNT];
+	u64 all_pending_starts[MAX_PENDING_UTTERANCE_COUNT];
+	int pending_count;
+
+	u64 last_done;
+
+	// Kept across runs (see tts_warm_up and tts_shutdown).
+	// Only the session's thread touches those while it runs.
+	SpeechLength all_lengths[MAX_SPEECH_LENGTH_COUNT];
+	int length_count;
+	int next_replaced_length;
+
+	// Kept for as long as the Speech is (see speak_through_mixer).
+	// Only the audio thread touches those while it runs.
+	SpeechClip all_clips[MAX_SPEECH_CLIP_COUNT];
+	int clip_count;
+};
+
+enum AudioCommandType
+{
+	AUDIO_SAY,
+	AUDIO_MUSIC_INIT,
+	AUDIO_MUSIC_ON,
+	AUDIO_QUIT,
+};
+
+struct AudioCommand
+{
+	u32 type;
+
+	// Interned, for AUDIO_SAY.
+	u32 text;
+};
+
+// A text has been said.
+struct AudioEvent
+{
+	// Interned.
+	u32 text;
+
+	// In milliseconds, how long it took.
+	u32 duration;
+};
+
+// Speech and music commands, run by their own thread: however long
+// they take (festival falling behind, a music command hanging), the
+// session's timers are not held back.
+// Commands come from a single thread (the session's), which is the
+// only one getting the events back.
+struct Audio
+{
+	Config *config;
+
+	// NULL if there is no resident festival.
+	Speech *speech;
+
+	// Where clips are kept (see speak_through_mixer), NULL if nowhere.
+	Speech *clip_cache;
+
+	// Speech and music go through it, rather than through festival
+	// and the music commands, if it could be started (see mixer_start).
+	Mixer mixer;
+	b32 mixing;
+
+	// Clips given to the mixer, not said yet.
+	int mixer_pending_count;
+
+	SpscRing commands;
+	SpscRing events;
+
+	// Written to after each command, so the thread wakes up.
+	int wake_fd;
+
+	// A music command hung, they are not run anymore.
+	b32 music_broken;
+
+	// Texts given to the thread (see audio_send), and texts it is done
+	// with (said, or given up on), each written by a single side.
+	u32 sent_count;
+	u32 done_count;
+
+	pthread_t thread;
+	b32 running;
+};
+
+// Says TEXT through COMMAND (see render_tts), *SAMPLES getting what it
+// wrote (to be freed), *SAMPLE_COUNT 0 if it failed.
+// Returns false if it failed.
+b32 render_speech(Command *command, const char *text, i16 **samples, u64 *sample_count);
+
+int  tts_warm_up(Config *config, Speech *speech);
+void tts_shutdown(Speech *speech);
+
+b32 audio_start(Audio *audio, Config *config, Speech *speech);
+
+// Once everything it was given has been said.
+void audio_stop(Audio *audio);
+
+// Returns false if the command could not be queued (the audio thread
+// is that far behind, or not running).
+b32 audio_send(Audio *audio, u32 type, u32 text = 0);
+
+b32 audio_next_event(Audio *audio, AudioEvent *event);
+
+// Whether some text has not been said yet.
+b32 audio_is_busy(Audio *audio);
+
+#endif
@@ -0,0 +1,427 @@
+// Runtime latency benchmarks (see `make bench`).
+// Festival and the music commands are replaced by stubs (this very
+// binary, under another name), so only go-muscu's own costs are
+// measured. The report goes to stdout, one line per measure:
+//   NAME KEY=VALUE ...
+// times being in microseconds.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "intern.h"
+#include "session.h"
+
+#define CHILD_EXEC_RUN_COUNT 200
+#define TTS_SAY_RUN_COUNT	 100
+#define COUNTDOWN_RUN_COUNT	 3
+
+// Long enough for the renders to dominate the per second counts.
+#define LOAD_COUNTDOWN_DURATION 2000
+
+internal u32 all_countdown_durations[] = { 50, 250, 1000, 3000 };
+
+struct Bench
+{
+	char stub_dir[64];
+	char music_path[128];
+
+	Config config;
+
+	// The session prints as it goes, the report does not mix with it.
+	FILE *report;
+};
+
+// festival --pipe: says "done" once a text is said (see tts_warm_up).
+// festival --tts: says what is on its stdin.
+// music: does nothing.
+internal int run_stub(char *name, int argc, char **argv)
+{
+	if (strcmp(name, "festival") == 0)
+	{
+		b32 pipe_mode = ((argc > 1) && (strcmp(argv[1], "--pipe") == 0));
+
+		char buffer[1024];
+
+		while (fgets(buffer, sizeof(buffer), stdin))
+		{
+			if (pipe_mode && (strncmp(buffer, "(format", 7) == 0))
+			{
+				printf("done\n");
+				fflush(stdout);
+			}
+		}
+	}
+
+	return 0;
+}
+
+internal b32 create_stubs(Bench *bench)
+{
+	char exe_path[512];
+	ssize_t exe_len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+
+	strcpy(bench->stub_dir, "/tmp/" PROGRAM "-bench.XXXXXX");
+
+	if ((exe_len == -1) || !mkdtemp(bench->stub_dir))
+	{
+		perror(PROGRAM "-bench");
+		return false;
+	}
+
+	exe_path[exe_len] = '\0';
+
+	char festival_path[128];
+	snprintf(festival_path, sizeof(festival_path), "%s/festival", bench->stub_dir);
+	snprintf(bench->music_path, sizeof(bench->music_path), "%s/music", bench->stub_dir);
+
+	if ((symlink(exe_path, festival_path) == -1) ||
+		(symlink(exe_path, bench->music_path) == -1))
+	{
+		perror(PROGRAM "-bench");
+		return false;
+	}
+
+	// Festival is looked for in the PATH, and the speech lengths must
+	// not end up in the user's cache.
+	char path[4096];
+	snprintf(path, sizeof(path), "%s:%s", bench->stub_dir, getenv("PATH") ? getenv("PATH") : "");
+
+	setenv("PATH", path, 1);
+	setenv("XDG_CACHE_HOME", bench->stub_dir, 1);
+
+	return true;
+}
+
+internal void remove_stubs(Bench *bench)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), "%s/festival", bench->stub_dir);
+	unlink(path);
+	unlink(bench->music_path);
+
+	snprintf(path, sizeof(path), "%s/%s/spoken_lengths", bench->stub_dir, PROGRAM);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/%s", bench->stub_dir, PROGRAM);
+	rmdir(path);
+
+	rmdir(bench->stub_dir);
+}
+
+internal void init_stub_command(Command *command, char *path, char *argument)
+{
+	init_command(command, path, strlen(path));
+	add_argument(command, argument, strlen(argument));
+}
+
+internal int compare_u64(const void *a, const void *b)
+{
+	u64 x = *(u64 *) a;
+	u64 y = *(u64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+// ALL_SAMPLES (in nanoseconds) gets sorted.
+internal void report_samples(Bench *bench, char *name, char *parameters, u64 *all_samples, int sample_count)
+{
+	qsort(all_samples, sample_count, sizeof(u64), compare_u64);
+
+	fprintf(bench->report, "%s%s runs=%d min_us=%.1f median_us=%.1f p99_us=%.1f max_us=%.1f\n",
+			name, parameters, sample_count,
+			all_samples[0] / 1000.0,
+			all_samples[sample_count / 2] / 1000.0,
+			all_samples[(sample_count * 99) / 100] / 1000.0,
+			all_samples[sample_count - 1] / 1000.0);
+	fflush(bench->report);
+}
+
+internal void bench_child_exec(Bench *bench)
+{
+	u64 all_samples[CHILD_EXEC_RUN_COUNT];
+
+	for (int i = 0; i < CHILD_EXEC_RUN_COUNT; ++i)
+	{
+		u64 start = get_monotonic_ns();
+
+		child_exec(&bench->config.music_on, CHILD_EXEC_NO_STDOUT);
+
+		all_samples[i] = get_monotonic_ns() - start;
+	}
+
+	report_samples(bench, "child_exec", "", all_samples, CHILD_EXEC_RUN_COUNT);
+}
+
+// From the text being given to the audio thread to it being said
+// (NAME), and what giving it costs the session's thread (audio_send).
+// SPEECH is NULL for one process per text.
+internal void bench_say(Bench *bench, char *name, Speech *speech)
+{
+	Audio audio = {};
+
+	if (!audio_start(&audio, &bench->config, speech))
+	{
+		fprintf(bench->report, "%s error=audio_start\n", name);
+		return;
+	}
+
+	u32 text = intern_string("Go");
+
+	u64 all_samples[TTS_SAY_RUN_COUNT];
+	u64 all_send_samples[TTS_SAY_RUN_COUNT];
+
+	for (int i = 0; i < TTS_SAY_RUN_COUNT; ++i)
+	{
+		u64 start = get_monotonic_ns();
+
+		audio_send(&audio, AUDIO_SAY, text);
+
+		all_send_samples[i] = get_monotonic_ns() - start;
+
+		// What the session's speech timer would do, more often.
+		while (audio_is_busy(&audio))
+		{
+			usleep(50);
+		}
+
+		all_samples[i] = get_monotonic_ns() - start;
+	}
+
+	audio_stop(&audio);
+	ring_free(&audio.events);
+
+	char parameters[32];
+	snprintf(parameters, sizeof(parameters), " mode=%s", speech ? "resident" : "process");
+
+	report_samples(bench, name, "", all_samples, TTS_SAY_RUN_COUNT);
+	report_samples(bench, "audio_send", parameters, all_send_samples, TTS_SAY_RUN_COUNT);
+}
+
+// One process per text: festival and the music off command are waited
+// for.
+internal void bench_tts_say_process(Bench *bench)
+{
+	bench_say(bench, "tts_say_process", NULL);
+}
+
+// Resident festival.
+internal void bench_tts_say_resident(Bench *bench)
+{
+	Speech speech = {};
+
+	if (tts_warm_up(&bench->config, &speech) != 0)
+	{
+		fprintf(bench->report, "tts_say_resident error=warm_up\n");
+		return;
+	}
+
+	bench_say(bench, "tts_say_resident", &speech);
+
+	tts_shutdown(&speech);
+}
+
+// A single set of DURATION (in milliseconds), no setup time.
+internal void init_countdown_session(Session *session, Config *config, u32 duration)
+{
+	// Kept by the last run (see audio_stop).
+	ring_free(&session->audio.events);
+
+	// Kept for as long as the session is.
+	if (session->wake_open)
+	{
+		close(session->wake_fd);
+	}
+
+	memset(session, 0, sizeof(*session));
+
+	session->config = config;
+	session->program_count = 1;
+
+	Program *program = session->all_programs;
+	Exercise *exercise = program->all_exercises;
+
+	exercise->name = intern_string("Bench");
+	exercise->series_count = 1;
+	exercise->duration = duration;
+
+	program->exercise_count = 1;
+}
+
+// How late the very last countdown ends, after its deadline (the
+// session's planned end).
+internal void bench_countdown_end(Bench *bench, Session *session)
+{
+	Config config = bench->config;
+	config.voice_on = false;
+	config.setup_time = 0;
+
+	FOR_EACH_IT(u32, all_countdown_durations)
+	{
+		u64 all_samples[COUNTDOWN_RUN_COUNT];
+
+		for (int i = 0; i < COUNTDOWN_RUN_COUNT; ++i)
+		{
+			init_countdown_session(session, &config, *it);
+
+			run_session(session);
+
+			u64 end = get_monotonic_ns();
+			u64 planned_end = session->wheel.epoch_ns + session->timeline;
+
+			all_samples[i] = (end > planned_end) ? end - planned_end : 0;
+		}
+
+		char parameters[32];
+		snprintf(parameters, sizeof(parameters), " duration_ms=%u", *it);
+
+		report_samples(bench, "countdown_end_error", parameters, all_samples, COUNTDOWN_RUN_COUNT);
+	}
+}
+
+// Wakeups are context switches (the session only sleeps between
+// timers), syscalls are counted by tracing a child running the same
+// session.
+internal void bench_countdown_load(Bench *bench, Session *session)
+{
+	Config config = bench->config;
+	config.voice_on = false;
+	config.setup_time = 0;
+
+	r64 seconds = LOAD_COUNTDOWN_DURATION / 1000.0;
+
+	init_countdown_session(session, &config, LOAD_COUNTDOWN_DURATION);
+
+	struct rusage before, after;
+	getrusage(RUSAGE_SELF, &before);
+
+	run_session(session);
+
+	getrusage(RUSAGE_SELF, &after);
+
+	long wakeup_count = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw);
+
+	fprintf(bench->report, "countdown_wakeups duration_ms=%d per_s=%.1f\n",
+			LOAD_COUNTDOWN_DURATION, wakeup_count / seconds);
+	fflush(bench->report);
+
+	init_countdown_session(session, &config, LOAD_COUNTDOWN_DURATION);
+
+	pid_t child_pid = fork();
+
+	if (child_pid == 0)
+	{
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+
+		run_session(session);
+
+		_exit(0);
+	}
+
+	long syscall_count = -1;
+	int status;
+
+	if ((child_pid != -1) && (waitpid(child_pid, &status, 0) == child_pid) && WIFSTOPPED(status))
+	{
+		ptrace(PTRACE_SETOPTIONS, child_pid, NULL, PTRACE_O_TRACESYSGOOD);
+
+		long stop_count = 0;
+		int signal_number = 0;
+
+		while (ptrace(PTRACE_SYSCALL, child_pid, NULL, signal_number) == 0)
+		{
+			if ((waitpid(child_pid, &status, 0) != child_pid) || !WIFSTOPPED(status))
+			{
+				break;
+			}
+
+			signal_number = 0;
+
+			if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+			{
+				++stop_count;
+			}
+			else
+			{
+				signal_number = WSTOPSIG(status);
+			}
+		}
+
+		// A stop on the way in, and one on the way out.
+		syscall_count = stop_count / 2;
+	}
+
+	if (syscall_count == -1)
+	{
+		fprintf(bench->report, "countdown_syscalls duration_ms=%d error=ptrace\n", LOAD_COUNTDOWN_DURATION);
+	}
+	else
+	{
+		fprintf(bench->report, "countdown_syscalls duration_ms=%d per_s=%.1f\n",
+				LOAD_COUNTDOWN_DURATION, syscall_count / seconds);
+	}
+
+	fflush(bench->report);
+}
+
+int main(int argc, char *argv[])
+{
+	char *name = strrchr(argv[0], '/');
+	name = (name) ? name + 1 : argv[0];
+
+	if ((strcmp(name, "festival") == 0) || (strcmp(name, "music") == 0))
+	{
+		return run_stub(name, argc, argv);
+	}
+
+	Bench bench = {};
+
+	if (!create_stubs(&bench))
+	{
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	// The session's display goes nowhere.
+	int report_fd = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+
+	if ((report_fd == -1) || (null_fd == -1))
+	{
+		perror(PROGRAM "-bench");
+		remove_stubs(&bench);
+		return 1;
+	}
+
+	bench.report = fdopen(report_fd, "w");
+
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+
+	bench.config.voice_on = true;
+	bench.config.setup_time = DEFAULT_SETUP_TIME;
+
+	init_stub_command(&bench.config.music_on, bench.music_path, "on");
+	init_stub_command(&bench.config.music_off, bench.music_path, "off");
+
+	Session *session = (Session *) calloc(1, sizeof(Session));
+	session->config = &bench.config;
+
+	bench_child_exec(&bench);
+	bench_tts_say_process(&bench);
+	bench_tts_say_resident(&bench);
+	bench_countdown_end(&bench, session);
+	bench_countdown_load(&bench, session);
+
+	ring_free(&session->audio.events);
+	free(session);
+	remove_stubs(&bench);
+
+	return 0;
+}
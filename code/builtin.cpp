@@ -0,0 +1,118 @@
+#include "builtin.h"
+#include "intern.h"
+
+// Any error in those fails the build.
+#define DEFINE_BUILTIN_PROGRAM(identifier, name, text)					\
+	internal constexpr BuiltinProgram identifier = parse_builtin_program(name, text); \
+	static_assert(identifier.error_line == 0, "built-in program '" name "' is invalid")
+
+DEFINE_BUILTIN_PROGRAM(weird_workout, "weird_workout",
+					   "# tags: upper, core\n"
+					   "Push-ups (10 Reps)\n"
+					   "10 90\n"
+					   "\n"
+					   "Sit-ups (20 Reps)\n"
+					   "5 90\n"
+					   "\n"
+					   "Plank (hold for 60 seconds)\n"
+					   "4 60 15 90\n");
+
+DEFINE_BUILTIN_PROGRAM(tabata, "tabata",
+					   "# tags: cardio\n"
+					   "Tabata (20 seconds on, 10 seconds off)\n"
+					   "8 20 10\n");
+
+DEFINE_BUILTIN_PROGRAM(five_by_five, "5x5",
+					   "# tags: upper, lower, strength\n"
+					   "Squats (5 Reps)\n"
+					   "5 180\n"
+					   "\n"
+					   "Bench press (5 Reps)\n"
+					   "5 180\n"
+					   "\n"
+					   "Barbell rows (5 Reps)\n"
+					   "5 180\n");
+
+DEFINE_BUILTIN_PROGRAM(plank_ladder, "plank_ladder",
+					   "# tags: core\n"
+					   "Plank (hold for 30 seconds)\n"
+					   "1 30 10 30\n"
+					   "\n"
+					   "Plank (hold for 60 seconds)\n"
+					   "1 60 15 45\n"
+					   "\n"
+					   "Plank (hold for 90 seconds)\n"
+					   "1 90 30 60\n");
+
+DEFINE_BUILTIN_PROGRAM(morning_stretch, "morning_stretch",
+					   "# tags: stretch\n"
+					   "Neck rolls\n"
+					   "2 30 15\n"
+					   "\n"
+					   "Shoulder circles\n"
+					   "2 30 15\n"
+					   "\n"
+					   "Hamstring stretch (each leg)\n"
+					   "2 45 15\n"
+					   "\n"
+					   "Cat-cow\n"
+					   "2 45 15\n");
+
+#undef DEFINE_BUILTIN_PROGRAM
+
+internal const BuiltinProgram * const all_builtin_programs[] =
+{
+	&weird_workout,
+	&tabata,
+	&five_by_five,
+	&plank_ladder,
+	&morning_stretch,
+};
+
+b32 load_builtin_program(char *name, Program *program)
+{
+	size_t prefix_len = strlen(BUILTIN_PREFIX);
+
+	if (strncmp(name, BUILTIN_PREFIX, prefix_len) != 0)
+	{
+		return false;
+	}
+
+	name += prefix_len;
+
+	FOR_EACH_IT(const BuiltinProgram * const, all_builtin_programs)
+	{
+		if (strcmp((*it)->name, name) == 0)
+		{
+			*program = (*it)->program;
+
+			for (int i = 0; i < program->exercise_count; ++i)
+			{
+				program->all_exercises[i].name = intern_string((*it)->all_exercise_names[i],
+															   (*it)->all_exercise_name_lengths[i]);
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void list_builtin_programs(FILE *file)
+{
+	FOR_EACH_IT(const BuiltinProgram * const, all_builtin_programs)
+	{
+		fprintf(file, "%s%s\n", BUILTIN_PREFIX, (*it)->name);
+	}
+}
+
+int builtin_program_count()
+{
+	return ARRAY_SIZE(all_builtin_programs);
+}
+
+const BuiltinProgram *get_builtin_program(int index)
+{
+	return all_builtin_programs[index];
+}
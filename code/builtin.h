@@ -0,0 +1,254 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include "common.h"
+#include "parsing.h"
+
+#define BUILTIN_PREFIX "builtin:"
+
+// Program embedded in the binary, parsed at compile time (see
+// builtin.cpp).
+struct BuiltinProgram
+{
+	char name[32];
+
+	// Same syntax as a program file, checked against parse_program_line
+	// by the tests.
+	const char *text;
+
+	// Exercise names are interned when the program is loaded (see
+	// load_builtin_program), so they are kept here (pointing into TEXT)
+	// until then.
+	Program program;
+	const char *all_exercise_names[ARRAY_SIZE(((Program *) 0)->all_exercises)];
+	size_t all_exercise_name_lengths[ARRAY_SIZE(((Program *) 0)->all_exercises)];
+
+	// From its PROGRAM_TAGS_PREFIX comment, if any.
+	char tags[64];
+
+	// Line of the first error, 0 if none.
+	int error_line;
+};
+
+internal constexpr b32 builtin_is_space(char c)
+{
+	return ((c == ' ') || (c == '\t'));
+}
+
+// Same syntax as a program file (see parse_program_line), except
+// references to other programs and exercises of the library are not
+// allowed.
+internal constexpr BuiltinProgram parse_builtin_program(const char *name, const char *text)
+{
+	BuiltinProgram result = {};
+
+	for (size_t i = 0; name[i] && (i < ARRAY_SIZE(result.name) - 1); ++i)
+	{
+		result.name[i] = name[i];
+	}
+
+	result.text = text;
+
+	Program *program = &result.program;
+	Exercise *exercise = program->all_exercises;
+
+	int state = PROGRAM_PARSING_NAME;
+	int line = 0;
+
+	for (const char *c = text; *c;)
+	{
+		const char *start = c;
+
+		while (*c && (*c != '\n'))
+		{
+			++c;
+		}
+
+		const char *end = c;
+
+		if (*c)
+		{
+			++c;
+		}
+
+		++line;
+
+		while ((start < end) && builtin_is_space(*start))
+		{
+			++start;
+		}
+
+		if ((start < end) && (*start == '#'))
+		{
+			const char *prefix = PROGRAM_TAGS_PREFIX;
+			const char *t = start;
+
+			while (*prefix && (t < end) && (*t == *prefix))
+			{
+				++prefix;
+				++t;
+			}
+
+			for (size_t i = 0; !*prefix && (t + i < end) && (i < ARRAY_SIZE(result.tags) - 1); ++i)
+			{
+				result.tags[i] = t[i];
+			}
+
+			continue;
+		}
+
+		for (const char *s = start; s < end; ++s)
+		{
+			if (*s == '#')
+			{
+				end = s;
+				break;
+			}
+		}
+
+		while ((end > start) && builtin_is_space(*(end - 1)))
+		{
+			--end;
+		}
+
+		if (start == end)
+		{
+			if (state == PROGRAM_PARSING_PROPERTIES)
+			{
+				result.error_line = line;
+				return result;
+			}
+
+			state = PROGRAM_PARSING_NAME;
+			continue;
+		}
+
+		// A name right after some properties (the empty line in
+		// between is missing) is an error too.
+		if (state == PROGRAM_PARSING_END)
+		{
+			result.error_line = line;
+			return result;
+		}
+
+		if (state == PROGRAM_PARSING_NAME)
+		{
+			if ((*start == '@') || (*start == LIBRARY_EXERCISE_PREFIX) ||
+				(program->exercise_count == ARRAY_SIZE(program->all_exercises)))
+			{
+				result.error_line = line;
+				return result;
+			}
+
+			exercise = program->all_exercises + program->exercise_count;
+
+			result.all_exercise_names[program->exercise_count]		  = start;
+			result.all_exercise_name_lengths[program->exercise_count] = end - start;
+
+			state = PROGRAM_PARSING_PROPERTIES;
+			continue;
+		}
+
+		// SERIES [TEMPO] [DURATION] [MILESTONE] PAUSE_DURATION
+		u32 values[4] = {};
+		int value_count = 0;
+
+		for (const char *s = start; s < end;)
+		{
+			const char *token_end = s;
+
+			while ((token_end < end) && !builtin_is_space(*token_end))
+			{
+				++token_end;
+			}
+
+			if (value_count == (int) ARRAY_SIZE(values))
+			{
+				result.error_line = line;
+				return result;
+			}
+
+			u32 value = 0;
+
+			// The tempo is told apart by its dashes.
+			b32 is_tempo = false;
+
+			for (const char *d = s; (value_count == 1) && (d < token_end); ++d)
+			{
+				is_tempo = is_tempo || (*d == '-');
+			}
+
+			if (is_tempo)
+			{
+				if (!parse_tempo(s, token_end, exercise->tempo))
+				{
+					result.error_line = line;
+					return result;
+				}
+			}
+			else if (value_count == 0)
+			{
+				for (const char *d = s; d < token_end; ++d)
+				{
+					if ((*d < '0') || (*d > '9') || (value > UINT8_MAX))
+					{
+						result.error_line = line;
+						return result;
+					}
+
+					value = value * 10 + (*d - '0');
+				}
+			}
+			else if (!parse_duration(s, token_end, &value))
+			{
+				result.error_line = line;
+				return result;
+			}
+
+			if (!is_tempo)
+			{
+				values[value_count++] = value;
+			}
+
+			s = token_end;
+
+			while ((s < end) && builtin_is_space(*s))
+			{
+				++s;
+			}
+		}
+
+		if ((value_count < 2) ||
+			(values[0] == 0) || (values[0] > UINT8_MAX))
+		{
+			result.error_line = line;
+			return result;
+		}
+
+		exercise->series_count	 = values[0];
+		exercise->pause_duration = values[value_count - 1];
+		exercise->duration		 = (value_count > 2) ? values[1] : 0;
+		exercise->milestone		 = (value_count > 3) ? values[2] : 0;
+
+		++program->exercise_count;
+		state = PROGRAM_PARSING_END;
+	}
+
+	if ((state == PROGRAM_PARSING_PROPERTIES) || !program->exercise_count)
+	{
+		result.error_line = line;
+	}
+
+	return result;
+}
+
+// NAME is given with its BUILTIN_PREFIX.
+// Returns false if there is no such built-in program.
+b32 load_builtin_program(char *name, Program *program);
+
+void list_builtin_programs(FILE *file);
+
+int builtin_program_count();
+const BuiltinProgram *get_builtin_program(int index);
+
+#endif
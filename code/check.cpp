@@ -0,0 +1,490 @@
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "parsing.h"
+
+#define NO_TARGET		-1
+#define EXTERNAL_TARGET -2
+
+#define COLOR_WHITE 0
+#define COLOR_GRAY	1
+#define COLOR_BLACK 2
+
+struct ProgramReference
+{
+	char *name;
+	int line;
+
+	int target;
+};
+
+struct ProgramCheck
+{
+	char *name;
+
+	// What the parser had to say, printed once every file is done.
+	char *report;
+	size_t report_size;
+
+	int error_count;
+	int warning_count;
+
+	ProgramReference *all_references;
+	int reference_count;
+	int reference_capacity;
+
+	int color;
+	b32 in_cycle;
+};
+
+struct CheckQueue
+{
+	char *dir;
+
+	ProgramCheck *all_checks;
+	int check_count;
+
+	int next_check;
+};
+
+internal void add_reference(ProgramCheck *check, char *name, int line)
+{
+	if (check->reference_count == check->reference_capacity)
+	{
+		check->reference_capacity = MAX(8, check->reference_capacity * 2);
+		check->all_references = (ProgramReference *) realloc(check->all_references,
+															 check->reference_capacity * sizeof(ProgramReference));
+	}
+
+	ProgramReference *reference = check->all_references + check->reference_count++;
+
+	STRING_COPY(reference->name, name);
+	reference->line	  = line;
+	reference->target = NO_TARGET;
+}
+
+internal void check_program_file(char *dir, ProgramCheck *check, Program *program)
+{
+	FILE *report = open_memstream(&check->report, &check->report_size);
+
+	char filename[512];
+	snprintf(filename, sizeof(filename), "%s/%s", dir, check->name);
+
+	FILE *file;
+
+	if (!(file = fopen(filename, "r")))
+	{
+		fprintf(report, "%s: %s: could not be read.\n", PROGRAM, check->name);
+		check->error_count = 1;
+
+		fclose(report);
+		return;
+	}
+
+	memset(program, 0, sizeof(*program));
+
+	ProgramParser parser;
+	init_program_parser(&parser, check->name, program, report);
+
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+
+	while (getline(&buffer, &buffer_size, file) != -1)
+	{
+		char *reference;
+		int result = parse_program_line(&parser, buffer, &reference);
+
+		if (result == PROGRAM_LINE_STOP)
+		{
+			break;
+		}
+
+		if (result == PROGRAM_LINE_REFERENCE)
+		{
+			add_reference(check, reference, parser.line_count);
+		}
+	}
+
+	free(buffer);
+	fclose(file);
+
+	check->error_count	 = end_program_parsing(&parser);
+	check->warning_count = parser.warning_count;
+
+	fclose(report);
+}
+
+internal void *check_worker(void *data)
+{
+	CheckQueue *queue = (CheckQueue *) data;
+	Program *program = (Program *) malloc(sizeof(Program));
+
+	for (;;)
+	{
+		int index = __atomic_fetch_add(&queue->next_check, 1, __ATOMIC_RELAXED);
+
+		if (index >= queue->check_count)
+		{
+			break;
+		}
+
+		check_program_file(queue->dir, queue->all_checks + index, program);
+	}
+
+	free(program);
+
+	return NULL;
+}
+
+internal int compare_checks(const void *a, const void *b)
+{
+	return strcmp(((ProgramCheck *) a)->name, ((ProgramCheck *) b)->name);
+}
+
+internal int list_program_files(char *dir, ProgramCheck **all_checks)
+{
+	DIR *directory;
+
+	if (!(directory = opendir(dir)))
+	{
+		return -1;
+	}
+
+	int check_count = 0,
+		check_capacity = 0;
+
+	*all_checks = NULL;
+
+	struct dirent *entry;
+
+	while ((entry = readdir(directory)))
+	{
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		// Symbolic links (or file systems that do not give the type)
+		// need a closer look.
+		if ((entry->d_type == DT_LNK) || (entry->d_type == DT_UNKNOWN))
+		{
+			char filename[512];
+			snprintf(filename, sizeof(filename), "%s/%s", dir, entry->d_name);
+
+			struct stat file_stat;
+
+			if ((stat(filename, &file_stat) == -1) || !S_ISREG(file_stat.st_mode))
+			{
+				continue;
+			}
+		}
+		else if (entry->d_type != DT_REG)
+		{
+			continue;
+		}
+
+		if (check_count == check_capacity)
+		{
+			check_capacity = MAX(64, check_capacity * 2);
+			*all_checks = (ProgramCheck *) realloc(*all_checks, check_capacity * sizeof(ProgramCheck));
+		}
+
+		ProgramCheck *check = *all_checks + check_count++;
+
+		memset(check, 0, sizeof(*check));
+		STRING_COPY(check->name, entry->d_name);
+	}
+
+	closedir(directory);
+
+	qsort(*all_checks, check_count, sizeof(ProgramCheck), compare_checks);
+
+	return check_count;
+}
+
+internal int resolve_references(char *dir, ProgramCheck *all_checks, int check_count)
+{
+	int error_count = 0;
+
+	for (int i = 0; i < check_count; ++i)
+	{
+		ProgramCheck *check = all_checks + i;
+
+		for (int j = 0; j < check->reference_count; ++j)
+		{
+			ProgramReference *reference = check->all_references + j;
+
+			ProgramCheck key = {};
+			key.name = reference->name;
+
+			ProgramCheck *target = (ProgramCheck *) bsearch(&key, all_checks, check_count,
+															sizeof(ProgramCheck), compare_checks);
+
+			if (target)
+			{
+				reference->target = target - all_checks;
+				continue;
+			}
+
+			// Not in DIR itself (e.g: '@some_dir/program'), so it is
+			// not checked, but it exists.
+			char filename[512];
+			snprintf(filename, sizeof(filename), "%s/%s", dir, reference->name);
+
+			if (access(filename, R_OK) == 0)
+			{
+				reference->target = EXTERNAL_TARGET;
+				continue;
+			}
+
+			printf("%s: %s (line %d): reference to '%s': no such program.\n",
+				   PROGRAM, check->name, reference->line, reference->name);
+			++error_count;
+		}
+	}
+
+	return error_count;
+}
+
+internal void print_cycle(ProgramCheck *all_checks, int *stack, int from, int to)
+{
+	printf("%s: reference cycle: ", PROGRAM);
+
+	for (int i = from; i <= to; ++i)
+	{
+		ProgramCheck *check = all_checks + stack[i];
+
+		check->in_cycle = true;
+		printf("%s -> ", check->name);
+	}
+
+	printf("%s.\n", all_checks[stack[from]].name);
+}
+
+// How many programs ROOT uses at the same time, itself included, each
+// one counted once however many times it is referenced (see
+// parse_program_file). Stops counting past MAX_PROGRAM_COUNT.
+// ALL_MARKS is what the last call left there (all -1 at first).
+internal int count_used_programs(ProgramCheck *all_checks, int root, int *stack, int *all_marks)
+{
+	// Outside the directory, told apart by their names only.
+	char *all_external_names[MAX_PROGRAM_COUNT];
+	int external_count = 0;
+
+	int used_count = 0;
+
+	int top = 0;
+	stack[top] = root;
+	all_marks[root] = root;
+
+	while ((top >= 0) && (used_count <= MAX_PROGRAM_COUNT))
+	{
+		ProgramCheck *check = all_checks + stack[top--];
+		++used_count;
+
+		for (int i = 0; i < check->reference_count; ++i)
+		{
+			ProgramReference *reference = check->all_references + i;
+
+			if (reference->target == EXTERNAL_TARGET)
+			{
+				b32 seen = false;
+
+				for (int j = 0; (j < external_count) && !seen; ++j)
+				{
+					seen = (strcmp(all_external_names[j], reference->name) == 0);
+				}
+
+				if (!seen)
+				{
+					if (external_count < MAX_PROGRAM_COUNT)
+					{
+						all_external_names[external_count++] = reference->name;
+					}
+
+					++used_count;
+				}
+			}
+			else if ((reference->target >= 0) && (all_marks[reference->target] != root))
+			{
+				all_marks[reference->target] = root;
+				stack[++top] = reference->target;
+			}
+		}
+	}
+
+	return used_count;
+}
+
+// Depth-first walk of the reference graph, finding cycles and how
+// many programs each one uses.
+internal int walk_references(ProgramCheck *all_checks, int check_count)
+{
+	int error_count = 0;
+
+	int *stack		  = (int *) malloc(check_count * sizeof(int));
+	int *next_reference = (int *) malloc(check_count * sizeof(int));
+
+	for (int root = 0; root < check_count; ++root)
+	{
+		if (all_checks[root].color != COLOR_WHITE)
+		{
+			continue;
+		}
+
+		int top = 0;
+		stack[top] = root;
+		next_reference[top] = 0;
+		all_checks[root].color = COLOR_GRAY;
+
+		while (top >= 0)
+		{
+			ProgramCheck *check = all_checks + stack[top];
+
+			if (next_reference[top] < check->reference_count)
+			{
+				int target = check->all_references[next_reference[top]++].target;
+
+				if (target < 0)
+				{
+					continue;
+				}
+
+				if (all_checks[target].color == COLOR_GRAY)
+				{
+					int from = top;
+
+					while (stack[from] != target)
+					{
+						--from;
+					}
+
+					print_cycle(all_checks, stack, from, top);
+					++error_count;
+				}
+				else if (all_checks[target].color == COLOR_WHITE)
+				{
+					all_checks[target].color = COLOR_GRAY;
+
+					++top;
+					stack[top] = target;
+					next_reference[top] = 0;
+				}
+
+				continue;
+			}
+
+			check->color = COLOR_BLACK;
+			--top;
+		}
+	}
+
+	// Reused as the marks of count_used_programs.
+	for (int i = 0; i < check_count; ++i)
+	{
+		next_reference[i] = -1;
+	}
+
+	for (int i = 0; i < check_count; ++i)
+	{
+		ProgramCheck *check = all_checks + i;
+
+		if (!check->in_cycle &&
+			(count_used_programs(all_checks, i, stack, next_reference) > MAX_PROGRAM_COUNT))
+		{
+			printf("%s: %s: uses more than %d programs at the same time.\n",
+				   PROGRAM, check->name, MAX_PROGRAM_COUNT);
+			++error_count;
+		}
+	}
+
+	free(next_reference);
+	free(stack);
+
+	return error_count;
+}
+
+int check_programs(char *dir)
+{
+	ProgramCheck *all_checks;
+	int check_count = list_program_files(dir, &all_checks);
+
+	if (check_count < 0)
+	{
+		fprintf(stderr, "%s: %s: no such directory.\n", PROGRAM, dir);
+		return 1;
+	}
+
+	CheckQueue queue = {};
+	queue.dir		  = dir;
+	queue.all_checks  = all_checks;
+	queue.check_count = check_count;
+
+	long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+	int worker_count = CLAMP(core_count, 1, 64);
+	worker_count = MIN(worker_count, MAX(check_count, 1));
+
+	pthread_t all_workers[64];
+	int started_count = 0;
+
+	for (int i = 1; i < worker_count; ++i)
+	{
+		if (pthread_create(all_workers + started_count, NULL, check_worker, &queue) == 0)
+		{
+			++started_count;
+		}
+	}
+
+	// This thread works too.
+	check_worker(&queue);
+
+	for (int i = 0; i < started_count; ++i)
+	{
+		pthread_join(all_workers[i], NULL);
+	}
+
+	int error_count = 0,
+		warning_count = 0;
+
+	// In order, whichever thread checked which file.
+	fflush(stdout);
+
+	for (int i = 0; i < check_count; ++i)
+	{
+		ProgramCheck *check = all_checks + i;
+
+		fwrite(check->report, 1, check->report_size, stdout);
+
+		error_count	  += check->error_count;
+		warning_count += check->warning_count;
+	}
+
+	error_count += resolve_references(dir, all_checks, check_count);
+	error_count += walk_references(all_checks, check_count);
+
+	printf("Checked %d program%s: %d error%s, %d warning%s.\n",
+		   check_count, (check_count > 1) ? "s" : "",
+		   error_count, (error_count > 1) ? "s" : "",
+		   warning_count, (warning_count > 1) ? "s" : "");
+
+	for (int i = 0; i < check_count; ++i)
+	{
+		ProgramCheck *check = all_checks + i;
+
+		for (int j = 0; j < check->reference_count; ++j)
+		{
+			free(check->all_references[j].name);
+		}
+
+		free(check->all_references);
+		free(check->report);
+		free(check->name);
+	}
+
+	free(all_checks);
+
+	return error_count;
+}
@@ -0,0 +1,12 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "common.h"
+
+// Parses every program file in DIR (on every core), then checks the
+// references between them (dangling references, cycles, too many
+// programs at once).
+// Returns the number of errors.
+int check_programs(char *dir);
+
+#endif
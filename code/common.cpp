@@ -1,3 +1,5 @@
+#include <sys/stat.h>
+
 #include "common.h"
 
 void init_command(Command *command, char *name, size_t name_len)
@@ -22,3 +24,99 @@ void add_argument(Command *command, char *argument, size_t argument_len)
 	STRING_N_COPY(command->argv[command->argc - 1], argument, argument_len);
 	command->argv[command->argc] = NULL;
 }
+
+void free_command(Command *command)
+{
+	if (!command->argv)
+	{
+		return;
+	}
+
+	// NOTE: argc may have been set to 0 (e.g: music turned off), argv
+	//       is still NULL-terminated.
+	for (char **argument = command->argv; *argument; ++argument)
+	{
+		free(*argument);
+	}
+
+	free(command->argv);
+
+	command->argv = NULL;
+	command->argc = 0;
+}
+
+b32 cache_file_path(char *path, size_t size, const char *name, b32 create_dirs)
+{
+	char *cache_dir = getenv("XDG_CACHE_HOME");
+	char *home_dir = getenv("HOME");
+
+	if (cache_dir)
+	{
+		snprintf(path, size, "%s", cache_dir);
+	}
+	else if (home_dir)
+	{
+		snprintf(path, size, "%s/.cache", home_dir);
+	}
+	else
+	{
+		return false;
+	}
+
+	if (create_dirs)
+	{
+		mkdir(path, 0755);
+	}
+
+	size_t len = strlen(path);
+	snprintf(path + len, size - len, "/%s", PROGRAM);
+
+	if (create_dirs)
+	{
+		mkdir(path, 0755);
+	}
+
+	len = strlen(path);
+	snprintf(path + len, size - len, "/%s", name);
+
+	return true;
+}
+
+void escape_json(const char *string, char *output, size_t size)
+{
+	size_t length = 0;
+
+	output[length++] = '"';
+
+	for (const char *c = string; *c; ++c)
+	{
+		char escaped[8];
+
+		if ((*c == '"') || (*c == '\\'))
+		{
+			snprintf(escaped, sizeof(escaped), "\\%c", *c);
+		}
+		else if ((u8) *c < 0x20)
+		{
+			snprintf(escaped, sizeof(escaped), "\\u%04x", (u8) *c);
+		}
+		else
+		{
+			escaped[0] = *c;
+			escaped[1] = '\0';
+		}
+
+		size_t escaped_length = strlen(escaped);
+
+		if (length + escaped_length + 2 > size)
+		{
+			break;
+		}
+
+		memcpy(output + length, escaped, escaped_length);
+		length += escaped_length;
+	}
+
+	output[length++] = '"';
+	output[length]	 = '\0';
+}
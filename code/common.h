@@ -5,18 +5,53 @@
 
 #define PROGRAM "go-muscu"
 
-#define DEFAULT_SETUP_TIME 3
+// In milliseconds.
+#define DEFAULT_SETUP_TIME 3000
+
+// Command saying the text on its stdin, writing the audio (see
+// metronome.h's format) to its stdout, if render_tts is not set.
+#define DEFAULT_RENDER_TTS "text2wave", "-otype", "raw", "-F", "48000", "-o", "/dev/stdout"
+
+// Sets without a duration last until ENTER is pressed, so this is a
+// guess (in milliseconds) wherever they have to be timed in advance.
+#define REP_SET_DURATION 45000
+
+// Programs at the same time (a program and the ones it references,
+// each counted once however many times it is referenced).
+#define MAX_PROGRAM_COUNT 10
+
+// References ("@NAME [xN]" lines) in a single program.
+#define MAX_PROGRAM_REFERENCE_COUNT 32
+
+// "@NAME xN", N being at most that.
+#define MAX_REFERENCE_REPEAT UINT16_MAX
+
+// Eccentric, pause, concentric, pause.
+#define TEMPO_PHASE_COUNT 4
+
+// In milliseconds.
+#define MAX_TEMPO_PHASE 60000
 
 struct Exercise
 {
-	char name[64];
+	// In milliseconds.
+	u32 duration;
+	u32 pause_duration;
+	u32 milestone;
+
+	// In milliseconds (MAX_TEMPO_PHASE fits), all 0 if the exercise has
+	// no tempo.
+	u16 tempo[TEMPO_PHASE_COUNT];
+
+	// Interned (see intern.h).
+	u32 name;
+
+	// Interned, what is said instead of NAME (e.g: without the number
+	// of reps), or EMPTY_STRING_ID to say NAME.
+	u32 spoken_name;
 
     u8 series_count;
 	u8 current_series;
-
-	u16 duration;
-	u16 pause_duration;
-	u16 milestone;
 };
 
 struct Program
@@ -25,6 +60,13 @@ struct Program
 	u8 exercise_count;
 
 	u8 current_exercise;
+
+	// For a program made of references: which of the session's
+	// programs each one is, and how many times in a row it is run
+	// (see parse_program_file and ProgramWalk).
+	u8 reference_count;
+	u8 all_reference_targets[MAX_PROGRAM_REFERENCE_COUNT];
+	u16 all_reference_repeats[MAX_PROGRAM_REFERENCE_COUNT];
 };
 
 struct Command
@@ -35,14 +77,23 @@ struct Command
 
 struct Config
 {
-	char default_program[ARRAY_SIZE(((Exercise *) 0)->name)];
+	char default_program[256];
 	
 	Command tts,
 		    music_init,
 		    music_on,
-		    music_off;
+		    music_off,
+		    metronome,
+		    render_tts,
+		    mixer,
+		    music_source;
 
-	u8 setup_time;
+	// Where the mixer writes instead of to the mixer command, if not
+	// empty (see mixer_start).
+	char mixer_file[256];
+
+	// In milliseconds.
+	u32 setup_time;
 
     b32 voice_on;
 	b32 tts_stdin;
@@ -50,5 +101,14 @@ struct Config
 
 void add_argument(Command *command, char *argument, size_t argument_len);
 void init_command(Command *command, char *name, size_t name_len);
+void free_command(Command *command);
+
+// Where NAME is kept across runs (in $XDG_CACHE_HOME/go-muscu, or
+// ~/.cache/go-muscu). Returns false if there is nowhere to keep it.
+b32 cache_file_path(char *path, size_t size, const char *name, b32 create_dirs);
+
+// OUTPUT gets STRING as a JSON string (quotes included), cut short if
+// it does not fit.
+void escape_json(const char *string, char *output, size_t size);
 
 #endif
@@ -0,0 +1,687 @@
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "builtin.h"
+#include "daemon.h"
+#include "intern.h"
+#include "parsing.h"
+#include "session.h"
+#include "supervisor.h"
+#include "watch.h"
+
+#define MAX_CACHED_PROGRAM_COUNT 16
+
+struct CachedProgram
+{
+	char name[256];
+	time_t mtime;
+
+	Program all_programs[MAX_PROGRAM_COUNT];
+	int program_count;
+
+	// Interned, the file each of ALL_PROGRAMS was read from: the
+	// program's own, and every one it references (transitively).
+	u32 all_file_names[MAX_PROGRAM_COUNT];
+
+	u32 last_used;
+};
+
+#define MAX_WATCH_EVENT_COUNT 64
+
+// Configuration read again as it changes (see reload_config), and the
+// ones it replaced, freed once no session can be using them anymore.
+struct DaemonConfig
+{
+	Config *current;
+
+	// Given to run_daemon, not ours to free.
+	Config *initial;
+
+	Config **all_retired;
+	int retired_count;
+
+	b32 voice_off;
+	b32 music_off;
+};
+
+internal volatile sig_atomic_t global_quit = false;
+
+internal void handle_quit_signal(int)
+{
+	global_quit = true;
+}
+
+internal void socket_path(char *path, size_t size)
+{
+	char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+	if (runtime_dir)
+	{
+		snprintf(path, size, "%s/%s.sock", runtime_dir, PROGRAM);
+	}
+	else
+	{
+		snprintf(path, size, "/tmp/%s-%d.sock", PROGRAM, (int) getuid());
+	}
+}
+
+internal int connect_to_daemon()
+{
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	socket_path(address.sun_path, sizeof(address.sun_path));
+
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	{
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int daemon_request(char *request, char *reply, size_t reply_size)
+{
+	int fd;
+
+	if ((fd = connect_to_daemon()) == -1)
+	{
+		return -1;
+	}
+
+	char buffer[300];
+	int num_written = snprintf(buffer, sizeof(buffer), "%s\n", request);
+
+	if (write(fd, buffer, num_written) != num_written)
+	{
+		close(fd);
+		return -1;
+	}
+
+	size_t total_read = 0;
+	ssize_t num_read;
+
+	while ((total_read < reply_size - 1) &&
+		   ((num_read = read(fd, reply + total_read, reply_size - 1 - total_read)) > 0))
+	{
+		total_read += num_read;
+	}
+
+	reply[total_read] = '\0';
+	close(fd);
+
+	return (strncmp(reply, "ok", 2) == 0) ? 0 : 1;
+}
+
+// Returns false (CACHED being cleared) if the program is invalid, or
+// not there anymore.
+internal b32 load_cached_program(CachedProgram *cached, char *program_dir, char *program_name)
+{
+	char full_program_path[512];
+	snprintf(full_program_path, sizeof(full_program_path), "%s/programs/%s", program_dir, program_name);
+
+	// Copied first, as PROGRAM_NAME may be CACHED's.
+	char name[sizeof(cached->name)];
+	snprintf(name, sizeof(name), "%s", program_name);
+
+	u32 last_used = cached->last_used;
+
+	memset(cached, 0, sizeof(*cached));
+
+	struct stat program_stat;
+
+	if ((stat(full_program_path, &program_stat) == -1) ||
+		(parse_program_file(full_program_path, cached->all_programs, &cached->program_count,
+							ARRAY_SIZE(cached->all_programs), cached->all_file_names) != 0))
+	{
+		memset(cached, 0, sizeof(*cached));
+		return false;
+	}
+
+	memcpy(cached->name, name, sizeof(name));
+	cached->mtime	  = program_stat.st_mtime;
+	cached->last_used = last_used;
+
+	return true;
+}
+
+// Programs are only parsed again if their file changed since (see
+// also reload_programs).
+// NOTE: Only the top-level file is checked here, the ones it
+//       references are watched.
+internal CachedProgram *get_cached_program(CachedProgram *cache, char *program_dir,
+										   char *program_name, u32 now)
+{
+	char full_program_path[512];
+	snprintf(full_program_path, sizeof(full_program_path), "%s/programs/%s", program_dir, program_name);
+
+	struct stat program_stat;
+
+	if (stat(full_program_path, &program_stat) == -1)
+	{
+		return NULL;
+	}
+
+	CachedProgram *oldest = cache;
+
+	for (int i = 0; i < MAX_CACHED_PROGRAM_COUNT; ++i)
+	{
+		CachedProgram *cached = cache + i;
+
+		if (strcmp(cached->name, program_name) == 0)
+		{
+			if (cached->mtime == program_stat.st_mtime)
+			{
+				cached->last_used = now;
+				return cached;
+			}
+
+			oldest = cached;
+			break;
+		}
+
+		if (cached->last_used < oldest->last_used)
+		{
+			oldest = cached;
+		}
+	}
+
+	oldest->last_used = now;
+
+	return load_cached_program(oldest, program_dir, program_name) ? oldest : NULL;
+}
+
+// FILE_NAME (in the programs directory) changed: only the cached
+// programs made from it (referencing it included) are parsed again,
+// the others are left alone. If FILE_NAME is EMPTY_STRING_ID, anything
+// may have changed.
+// Returns how many were parsed again.
+internal int reload_programs(CachedProgram *cache, char *program_dir, u32 file_name)
+{
+	int reload_count = 0;
+
+	for (int i = 0; i < MAX_CACHED_PROGRAM_COUNT; ++i)
+	{
+		CachedProgram *cached = cache + i;
+
+		if (cached->name[0] == '\0')
+		{
+			continue;
+		}
+
+		b32 depends = (file_name == EMPTY_STRING_ID);
+
+		for (int j = 0; !depends && (j < cached->program_count); ++j)
+		{
+			depends = (cached->all_file_names[j] == file_name);
+		}
+
+		if (depends)
+		{
+			// Left out if it is now invalid, so the next start says why.
+			load_cached_program(cached, program_dir, cached->name);
+			++reload_count;
+		}
+	}
+
+	return reload_count;
+}
+
+// Read into a new Config, given to the running session (if any) for
+// its next series. The one it replaces is kept until then.
+// Returns false if it could not be read.
+internal b32 reload_config(DaemonConfig *daemon_config, Session *session, char *program_dir)
+{
+	char config_file[512];
+	snprintf(config_file, sizeof(config_file), "%s/%s.conf", program_dir, PROGRAM);
+
+	Config *config = (Config *) calloc(1, sizeof(Config));
+
+	if (load_config_file(config_file, config, daemon_config->voice_off, daemon_config->music_off) < 0)
+	{
+		// Gone: the one we have is as good as any.
+		free(config);
+		return false;
+	}
+
+	int count = daemon_config->retired_count++;
+
+	daemon_config->all_retired = (Config **) realloc(daemon_config->all_retired,
+													 daemon_config->retired_count * sizeof(Config *));
+	daemon_config->all_retired[count] = daemon_config->current;
+
+	daemon_config->current = config;
+
+	ATOMIC_STORE(&session->next_config, config);
+
+	return true;
+}
+
+internal void free_config(Config *config)
+{
+	free_command(&config->tts);
+	free_command(&config->music_init);
+	free_command(&config->music_on);
+	free_command(&config->music_off);
+	free_command(&config->metronome);
+	free_command(&config->render_tts);
+	free_command(&config->mixer);
+	free_command(&config->music_source);
+
+	free(config);
+}
+
+// Once no session runs.
+internal void free_retired_configs(DaemonConfig *daemon_config)
+{
+	for (int i = 0; i < daemon_config->retired_count; ++i)
+	{
+		if (daemon_config->all_retired[i] != daemon_config->initial)
+		{
+			free_config(daemon_config->all_retired[i]);
+		}
+	}
+
+	daemon_config->retired_count = 0;
+}
+
+internal void handle_changes(Watch *watch, int config_directory, DaemonConfig *daemon_config,
+							 Session *session, CachedProgram *cache, char *program_dir)
+{
+	WatchEvent all_events[MAX_WATCH_EVENT_COUNT];
+	int event_count = watch_read(watch, all_events, ARRAY_SIZE(all_events));
+
+	if (event_count == -1)
+	{
+		printf("Too many changes, reading everything again...\n");
+
+		reload_config(daemon_config, session, program_dir);
+		reload_programs(cache, program_dir, EMPTY_STRING_ID);
+
+		return;
+	}
+
+	for (int i = 0; i < event_count; ++i)
+	{
+		WatchEvent *event = all_events + i;
+
+		if (event->directory == config_directory)
+		{
+			if ((strcmp(event->name, PROGRAM ".conf") == 0) &&
+				reload_config(daemon_config, session, program_dir))
+			{
+				printf("Configuration read again.\n");
+			}
+		}
+		else
+		{
+			// Not interned (e.g: an editor's temporary file), so no
+			// cached program was read from it.
+			u32 file_name = find_string(event->name);
+
+			if (file_name == EMPTY_STRING_ID)
+			{
+				continue;
+			}
+
+			int reload_count = reload_programs(cache, program_dir, file_name);
+
+			if (reload_count)
+			{
+				printf("%s changed, %d program%s read again.\n", event->name,
+					   reload_count, (reload_count > 1) ? "s" : "");
+			}
+		}
+	}
+}
+
+internal void *session_thread(void *data)
+{
+	run_session((Session *) data);
+
+	return NULL;
+}
+
+internal void get_status(Session *session, char *reply, size_t reply_size)
+{
+	if (!ATOMIC_LOAD(&session->running))
+	{
+		snprintf(reply, reply_size, "ok idle\n");
+		return;
+	}
+
+	Program *program = session->all_programs + ATOMIC_LOAD(&session->current_program);
+	int exercise_index = MAX(program->current_exercise - 1, 0);
+	Exercise *exercise = program->all_exercises + exercise_index;
+
+	snprintf(reply, reply_size, "ok running %s: %s (series %d/%d)%s\n",
+			 session->program_name, get_string(exercise->name),
+			 MIN(exercise->current_series, exercise->series_count), exercise->series_count,
+			 ATOMIC_LOAD(&session->paused) ? " paused" : "");
+}
+
+int run_daemon(Config *config, char *program_dir, b32 voice_off, b32 music_off, Dashboard *dashboard,
+			   EventStream *events)
+{
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	socket_path(address.sun_path, sizeof(address.sun_path));
+
+	int test_fd;
+
+	if ((test_fd = connect_to_daemon()) != -1)
+	{
+		close(test_fd);
+
+		fprintf(stderr, "%s: a daemon is already listening on '%s'.\n", PROGRAM, address.sun_path);
+		return 1;
+	}
+
+	// Left over by a daemon that did not exit properly.
+	unlink(address.sun_path);
+
+	int listen_fd;
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	{
+		perror("socket");
+		return 1;
+	}
+
+	if ((bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) == -1) ||
+		(listen(listen_fd, 8) == -1))
+	{
+		perror(address.sun_path);
+
+		close(listen_fd);
+		return 1;
+	}
+
+	struct sigaction quit_action = {};
+	quit_action.sa_handler = handle_quit_signal;
+
+	sigaction(SIGINT, &quit_action, NULL);
+	sigaction(SIGTERM, &quit_action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	Speech speech = {};
+	tts_warm_up(config, &speech);
+
+	CachedProgram *cache = (CachedProgram *) calloc(MAX_CACHED_PROGRAM_COUNT, sizeof(CachedProgram));
+
+	DaemonConfig daemon_config = {};
+	daemon_config.current	= config;
+	daemon_config.initial	= config;
+	daemon_config.voice_off = voice_off;
+	daemon_config.music_off = music_off;
+
+	// NOTE: Without it, programs are still parsed again when their own
+	//       file changes (see get_cached_program), not when one they
+	//       reference does, and the configuration is not.
+	Watch watch;
+	int config_directory = -1;
+
+	if (watch_open(&watch))
+	{
+		char programs_dir[512];
+		snprintf(programs_dir, sizeof(programs_dir), "%s/programs", program_dir);
+
+		config_directory = watch_directory(&watch, program_dir);
+		watch_directory(&watch, programs_dir);
+	}
+
+	Session *session = (Session *) calloc(1, sizeof(Session));
+	session->config	   = config;
+	session->speech	   = &speech;
+	session->dashboard = dashboard;
+	session->events	   = events;
+
+	// NOTE: No keyboard: the daemon runs in the background, where
+	//       touching the terminal would stop it (SIGTTOU, SIGTTIN).
+	//       Sessions are controlled through requests (see --control).
+
+	pthread_t thread;
+	b32 thread_started = false;
+
+	u32 request_count = 0;
+
+	printf("Listening on '%s'...\n", address.sun_path);
+
+	while (!global_quit)
+	{
+		if (thread_started && !ATOMIC_LOAD(&session->running))
+		{
+			pthread_join(thread, NULL);
+			thread_started = false;
+		}
+
+		if (!thread_started)
+		{
+			free_retired_configs(&daemon_config);
+		}
+
+		// What the last session left running (e.g: a metronome
+		// player that never quit).
+		reap_children();
+
+		struct pollfd all_poll_fds[] =
+		{
+			{ listen_fd, POLLIN, 0 },
+			{ watch.fd, POLLIN, 0 },
+		};
+
+		// NOTE: A negative fd (no inotify) is left out by poll.
+		if (poll(all_poll_fds, ARRAY_SIZE(all_poll_fds), 500) <= 0)
+		{
+			continue;
+		}
+
+		if (all_poll_fds[1].revents)
+		{
+			handle_changes(&watch, config_directory, &daemon_config, session, cache, program_dir);
+		}
+
+		if (!all_poll_fds[0].revents)
+		{
+			continue;
+		}
+
+		int client_fd;
+
+		if ((client_fd = accept(listen_fd, NULL, NULL)) == -1)
+		{
+			continue;
+		}
+
+		++request_count;
+
+		char request[300];
+		ssize_t total_read = 0;
+		ssize_t num_read = 0;
+
+		struct pollfd client_poll_fd = { client_fd, POLLIN, 0 };
+
+		// A client that does not send a full line in time is dropped.
+		while ((total_read < (ssize_t) sizeof(request) - 1) &&
+			   (poll(&client_poll_fd, 1, 1000) > 0) &&
+			   ((num_read = read(client_fd, request + total_read,
+								 sizeof(request) - 1 - total_read)) > 0))
+		{
+			total_read += num_read;
+
+			if (request[total_read - 1] == '\n')
+			{
+				break;
+			}
+		}
+
+		request[total_read] = '\0';
+
+		char *end_request = strchr(request, '\n');
+
+		if (end_request)
+		{
+			*end_request = '\0';
+		}
+
+		char reply[512];
+
+		if (strncmp(request, "start", 5) == 0)
+		{
+			char *program_name = request + 5;
+
+			while (*program_name == ' ')
+			{
+				++program_name;
+			}
+
+			if (*program_name == '\0')
+			{
+				program_name = daemon_config.current->default_program;
+			}
+
+			CachedProgram *cached = NULL;
+
+			if (thread_started)
+			{
+				snprintf(reply, sizeof(reply), "error: a session is already running.\n");
+			}
+			else if (!load_builtin_program(program_name, session->all_programs) &&
+					 !(cached = get_cached_program(cache, program_dir, program_name, request_count)))
+			{
+				snprintf(reply, sizeof(reply), "error: %s: no such program (or invalid).\n", program_name);
+			}
+			else
+			{
+				if (cached)
+				{
+					memcpy(session->all_programs, cached->all_programs, sizeof(session->all_programs));
+					session->program_count = cached->program_count;
+				}
+				else
+				{
+					session->program_count = 1;
+				}
+
+				strncpy(session->program_name, program_name, sizeof(session->program_name) - 1);
+				session->program_name[sizeof(session->program_name) - 1] = '\0';
+
+				session->config		 = daemon_config.current;
+				session->next_config = NULL;
+
+				session->paused			= false;
+				session->skip_requested = false;
+				session->suspend_requested = false;
+				session->current_program = 0;
+
+				// Never a stream, nor generated.
+				session->resumable = true;
+				session->restored  = false;
+
+				// Set before the thread starts, so a 'status' right
+				// after 'start' does not say 'idle'.
+				session->running = true;
+
+				if (pthread_create(&thread, NULL, session_thread, session) != 0)
+				{
+					session->running = false;
+					snprintf(reply, sizeof(reply), "error: could not start the session.\n");
+				}
+				else
+				{
+					thread_started = true;
+					snprintf(reply, sizeof(reply), "ok started %s\n", program_name);
+				}
+			}
+		}
+		else if (strcmp(request, "pause") == 0)
+		{
+			ATOMIC_STORE(&session->paused, true);
+			session_wake(session);
+
+			snprintf(reply, sizeof(reply), "ok paused\n");
+		}
+		else if (strcmp(request, "resume") == 0)
+		{
+			ATOMIC_STORE(&session->paused, false);
+			session_wake(session);
+
+			snprintf(reply, sizeof(reply), "ok resumed\n");
+		}
+		else if (strcmp(request, "skip") == 0)
+		{
+			ATOMIC_STORE(&session->skip_requested, true);
+			session_wake(session);
+
+			snprintf(reply, sizeof(reply), "ok skipped\n");
+		}
+		else if (strcmp(request, "suspend") == 0)
+		{
+			if (!ATOMIC_LOAD(&session->running))
+			{
+				snprintf(reply, sizeof(reply), "error: no session is running.\n");
+			}
+			else
+			{
+				// Saved by the session's thread, as it stops.
+				ATOMIC_STORE(&session->suspend_requested, true);
+				session_wake(session);
+
+				snprintf(reply, sizeof(reply), "ok suspended\n");
+			}
+		}
+		else if (strcmp(request, "status") == 0)
+		{
+			get_status(session, reply, sizeof(reply));
+		}
+		else
+		{
+			snprintf(reply, sizeof(reply), "error: unknown request '%s'.\n", request);
+		}
+
+		write(client_fd, reply, strlen(reply));
+		close(client_fd);
+	}
+
+	if (thread_started)
+	{
+		// Blocked in a countdown or waiting for ENTER most of the
+		// time, both of which are cancellation points.
+		pthread_cancel(thread);
+		pthread_join(thread, NULL);
+	}
+
+	tts_shutdown(&speech);
+	stop_all_children();
+
+	watch_close(&watch);
+
+	if (daemon_config.current != config)
+	{
+		free_config(daemon_config.current);
+	}
+
+	free_retired_configs(&daemon_config);
+	free(daemon_config.all_retired);
+
+	close(listen_fd);
+	unlink(address.sun_path);
+
+	free(session);
+	free(cache);
+
+	return 0;
+}
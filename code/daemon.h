@@ -0,0 +1,18 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "common.h"
+#include "dashboard.h"
+#include "events.h"
+
+// Sessions are shown on DASHBOARD, and told to EVENTS, if not NULL.
+// The configuration and programs (in PROGRAM_DIR) are read again as
+// they change, voice and music staying off if VOICE_OFF and MUSIC_OFF.
+int run_daemon(Config *config, char *program_dir, b32 voice_off, b32 music_off, Dashboard *dashboard,
+			   EventStream *events);
+
+// Returns -1 if no daemon is listening, 0 if it replied "ok...",
+// 1 if it replied with an error.
+int daemon_request(char *request, char *reply, size_t reply_size);
+
+#endif
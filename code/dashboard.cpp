@@ -0,0 +1,943 @@
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "dashboard.h"
+#include "intern.h"
+#include "timer.h"
+
+#define MAX_DASHBOARD_REQUEST_SIZE 2048
+#define MAX_DASHBOARD_OUTPUT_SIZE  8192
+#define MAX_DASHBOARD_JSON_SIZE	   2048
+
+// What epoll tells apart: client slots come first.
+#define DASHBOARD_LISTEN_ID MAX_DASHBOARD_CLIENT_COUNT
+#define DASHBOARD_WAKE_ID	(MAX_DASHBOARD_CLIENT_COUNT + 1)
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+struct DashboardClient
+{
+	// -1 for a free slot.
+	int fd;
+
+	// Upgraded to a WebSocket: sent every state from then on.
+	b32 viewer;
+
+	// Closed once its output is written (plain HTTP requests).
+	b32 closing;
+
+	// Its output was too far behind for a state to fit: the latest one
+	// is sent once it drains.
+	b32 missed_state;
+
+	u32 request_size;
+	u32 output_start;
+	u32 output_end;
+
+	char request[MAX_DASHBOARD_REQUEST_SIZE];
+	char output[MAX_DASHBOARD_OUTPUT_SIZE];
+};
+
+internal const char *global_page =
+	"<!DOCTYPE html>\n"
+	"<html><head><meta charset='utf-8'><meta name='viewport' content='width=device-width'>\n"
+	"<title>go-muscu</title>\n"
+	"<style>\n"
+	"body{font-family:sans-serif;background:#111;color:#eee;text-align:center;margin:0;padding:2em}\n"
+	".dim{color:#888;font-size:1.5em}\n"
+	"#exercise{font-size:3em;margin:.4em 0}\n"
+	"#time{font-size:8em;font-variant-numeric:tabular-nums}\n"
+	"</style></head><body>\n"
+	"<div class='dim' id='program'></div>\n"
+	"<div id='exercise'>Connecting...</div>\n"
+	"<div class='dim' id='series'></div>\n"
+	"<div id='time'></div>\n"
+	"<div class='dim' id='phase'></div>\n"
+	"<div class='dim' id='next'></div>\n"
+	"<script>\n"
+	"function set(id,text){document.getElementById(id).textContent=text}\n"
+	"function show(s){\n"
+	" set('program',s.program);\n"
+	" set('exercise',s.phase=='idle'?'Idle':s.phase=='finished'?'Finished':s.exercise);\n"
+	" set('series',s.series_count?'Series '+s.series+'/'+s.series_count:'');\n"
+	" set('time',s.time_left==null?'':s.time_left.toFixed(1));\n"
+	" set('phase',s.paused?'paused':s.phase);\n"
+	" set('next',s.next?'Next: '+s.next:'');\n"
+	"}\n"
+	"function connect(){\n"
+	" var ws=new WebSocket((location.protocol=='https:'?'wss://':'ws://')+location.host+'/ws');\n"
+	" ws.onmessage=function(e){show(JSON.parse(e.data))};\n"
+	" ws.onclose=function(){set('exercise','Connecting...');setTimeout(connect,1000)};\n"
+	"}\n"
+	"connect();\n"
+	"</script></body></html>\n";
+
+internal const char *global_phase_names[] =
+{
+	"idle", "setup", "work", "waiting", "rest", "finished",
+};
+
+internal inline u32 rotate_left(u32 value, int count)
+{
+	return (value << count) | (value >> (32 - count));
+}
+
+// Only for the WebSocket handshake.
+internal void sha1(const u8 *data, size_t size, u8 *digest)
+{
+	u32 h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	u64 bit_size = (u64) size * 8;
+
+	// Room for the 0x80 byte and the 64-bit size, in 64-byte blocks.
+	size_t total_size = ((size + 8) / 64 + 1) * 64;
+
+	for (size_t offset = 0; offset < total_size; offset += 64)
+	{
+		u8 block[64];
+
+		for (size_t i = 0; i < 64; ++i)
+		{
+			size_t at = offset + i;
+
+			if (at < size)
+			{
+				block[i] = data[at];
+			}
+			else if (at == size)
+			{
+				block[i] = 0x80;
+			}
+			else if (at >= total_size - 8)
+			{
+				block[i] = (u8) (bit_size >> (8 * (total_size - 1 - at)));
+			}
+			else
+			{
+				block[i] = 0;
+			}
+		}
+
+		u32 w[80];
+
+		for (int i = 0; i < 16; ++i)
+		{
+			w[i] = ((u32) block[4 * i] << 24) | ((u32) block[4 * i + 1] << 16) |
+				   ((u32) block[4 * i + 2] << 8) | (u32) block[4 * i + 3];
+		}
+
+		for (int i = 16; i < 80; ++i)
+		{
+			w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+		for (int i = 0; i < 80; ++i)
+		{
+			u32 f, k;
+
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			u32 temp = rotate_left(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotate_left(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	for (int i = 0; i < 20; ++i)
+	{
+		digest[i] = (u8) (h[i / 4] >> (24 - 8 * (i % 4)));
+	}
+}
+
+// OUTPUT gets 4 * ceil(SIZE / 3) characters, and a '\0'.
+internal void base64_encode(const u8 *data, size_t size, char *output)
+{
+	const char *digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	for (size_t i = 0; i < size; i += 3)
+	{
+		u32 group = (u32) data[i] << 16;
+		group |= (i + 1 < size) ? (u32) data[i + 1] << 8 : 0;
+		group |= (i + 2 < size) ? (u32) data[i + 2] : 0;
+
+		*output++ = digits[(group >> 18) & 63];
+		*output++ = digits[(group >> 12) & 63];
+		*output++ = (i + 1 < size) ? digits[(group >> 6) & 63] : '=';
+		*output++ = (i + 2 < size) ? digits[group & 63] : '=';
+	}
+
+	*output = '\0';
+}
+
+// Time left in tenths of a second (rounded up), -1 if there is no
+// countdown.
+internal i64 get_time_left(DashboardState *state, u64 now)
+{
+	if (!state->end)
+	{
+		return -1;
+	}
+
+	u64 left = state->paused ? state->end : ((state->end > now) ? state->end - now : 0);
+
+	return (i64) ((left + DASHBOARD_FRAME_PERIOD_NS - 1) / DASHBOARD_FRAME_PERIOD_NS);
+}
+
+// Returns the length, 0 if it does not fit.
+internal int format_state(DashboardState *state, i64 time_left, char *buffer, int size)
+{
+	char program[300], exercise[300], next_exercise[300];
+
+	escape_json(get_string(state->program), program, sizeof(program));
+	escape_json(get_string(state->exercise), exercise, sizeof(exercise));
+	escape_json(get_string(state->next_exercise), next_exercise, sizeof(next_exercise));
+
+	char time_left_text[32];
+
+	if (time_left < 0)
+	{
+		snprintf(time_left_text, sizeof(time_left_text), "null");
+	}
+	else
+	{
+		snprintf(time_left_text, sizeof(time_left_text), "%lld.%lld",
+				 (long long) (time_left / 10), (long long) (time_left % 10));
+	}
+
+	u32 phase = (state->phase < ARRAY_SIZE(global_phase_names)) ? state->phase : (u32) DASHBOARD_IDLE;
+
+	int length = snprintf(buffer, size,
+						  "{\"program\":%s,\"phase\":\"%s\",\"exercise\":%s,\"series\":%d,"
+						  "\"series_count\":%d,\"time_left\":%s,\"paused\":%s,\"next\":%s}",
+						  program, global_phase_names[phase], exercise, state->series, state->series_count,
+						  time_left_text, state->paused ? "true" : "false", next_exercise);
+
+	return (length < size) ? length : 0;
+}
+
+internal void close_client(Dashboard *dashboard, DashboardClient *client)
+{
+	if (client->viewer)
+	{
+		--dashboard->viewer_count;
+	}
+
+	// NOTE: Closing it removes it from the epoll set.
+	close(client->fd);
+
+	client->fd = -1;
+}
+
+internal void watch_output(Dashboard *dashboard, DashboardClient *client, b32 watch)
+{
+	struct epoll_event event = {};
+	event.events = watch ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	event.data.u32 = (u32) (client - dashboard->all_clients);
+
+	epoll_ctl(dashboard->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+// Returns false if it does not fit (nothing is queued then).
+internal b32 queue_output(DashboardClient *client, const char *data, u32 size)
+{
+	if (client->output_start)
+	{
+		memmove(client->output, client->output + client->output_start, client->output_end - client->output_start);
+
+		client->output_end -= client->output_start;
+		client->output_start = 0;
+	}
+
+	if (client->output_end + size > sizeof(client->output))
+	{
+		return false;
+	}
+
+	memcpy(client->output + client->output_end, data, size);
+	client->output_end += size;
+
+	return true;
+}
+
+// An unmasked text frame (servers never mask theirs).
+internal u32 make_state_frame(DashboardState *state, u64 now, char *frame, u32 size)
+{
+	char json[MAX_DASHBOARD_JSON_SIZE];
+	int json_size = format_state(state, get_time_left(state, now), json, sizeof(json));
+
+	u32 header_size;
+
+	frame[0] = (char) 0x81;
+
+	if (json_size < 126)
+	{
+		frame[1] = (char) json_size;
+		header_size = 2;
+	}
+	else
+	{
+		frame[1] = 126;
+		frame[2] = (char) (json_size >> 8);
+		frame[3] = (char) (json_size & 0xFF);
+		header_size = 4;
+	}
+
+	if (header_size + json_size > size)
+	{
+		return 0;
+	}
+
+	memcpy(frame + header_size, json, json_size);
+
+	return header_size + json_size;
+}
+
+// Writes what the socket takes, without waiting for the rest.
+// Returns false if CLIENT was closed.
+internal b32 flush_client(Dashboard *dashboard, DashboardClient *client)
+{
+	b32 was_pending = (client->output_start != client->output_end);
+
+	for (;;)
+	{
+		while (client->output_start != client->output_end)
+		{
+			ssize_t num_written = send(client->fd, client->output + client->output_start,
+									   client->output_end - client->output_start, MSG_NOSIGNAL);
+
+			if (num_written == -1)
+			{
+				if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				{
+					if (!was_pending)
+					{
+						watch_output(dashboard, client, true);
+					}
+
+					return true;
+				}
+
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				close_client(dashboard, client);
+				return false;
+			}
+
+			client->output_start += num_written;
+		}
+
+		client->output_start = 0;
+		client->output_end	 = 0;
+
+		if (!client->missed_state)
+		{
+			break;
+		}
+
+		client->missed_state = false;
+
+		char frame[MAX_DASHBOARD_JSON_SIZE + 4];
+		u32 frame_size = make_state_frame(&dashboard->state, get_monotonic_ns(), frame, sizeof(frame));
+
+		queue_output(client, frame, frame_size);
+	}
+
+	if (was_pending)
+	{
+		watch_output(dashboard, client, false);
+	}
+
+	if (client->closing)
+	{
+		close_client(dashboard, client);
+		return false;
+	}
+
+	return true;
+}
+
+internal void broadcast_state(Dashboard *dashboard, u64 now)
+{
+	dashboard->shown_time_left = (u64) get_time_left(&dashboard->state, now);
+
+	if (!dashboard->viewer_count)
+	{
+		return;
+	}
+
+	// Made once, whoever watches.
+	char frame[MAX_DASHBOARD_JSON_SIZE + 4];
+	u32 frame_size = make_state_frame(&dashboard->state, now, frame, sizeof(frame));
+
+	for (int i = 0; i < MAX_DASHBOARD_CLIENT_COUNT; ++i)
+	{
+		DashboardClient *client = dashboard->all_clients + i;
+
+		if ((client->fd == -1) || !client->viewer)
+		{
+			continue;
+		}
+
+		// NOTE: Whole frames only: a viewer that cannot keep up skips
+		//       states, it gets the latest one once it caught up.
+		if (client->missed_state || !queue_output(client, frame, frame_size))
+		{
+			client->missed_state = true;
+			continue;
+		}
+
+		flush_client(dashboard, client);
+	}
+}
+
+internal void reply(DashboardClient *client, const char *status, const char *content_type,
+					const char *body, u32 body_size)
+{
+	char header[256];
+	int header_size = snprintf(header, sizeof(header),
+							   "HTTP/1.1 %s\r\n"
+							   "Content-Type: %s\r\n"
+							   "Content-Length: %u\r\n"
+							   "Cache-Control: no-store\r\n"
+							   "Connection: close\r\n\r\n",
+							   status, content_type, body_size);
+
+	if (queue_output(client, header, header_size))
+	{
+		queue_output(client, body, body_size);
+	}
+
+	client->closing = true;
+}
+
+// HEADERS start right after the request line.
+// Returns the value of the header NAME (case insensitive), NULL if
+// there is none.
+internal char *find_header(char *headers, const char *name)
+{
+	size_t name_length = strlen(name);
+
+	for (char *line = headers; line && (line[0] != '\r');)
+	{
+		if ((strncasecmp(line, name, name_length) == 0) && (line[name_length] == ':'))
+		{
+			char *value = line + name_length + 1;
+			return value + strspn(value, " \t");
+		}
+
+		line = strstr(line, "\r\n");
+		line = line ? line + 2 : NULL;
+	}
+
+	return NULL;
+}
+
+internal void handle_request(Dashboard *dashboard, DashboardClient *client)
+{
+	char *request = client->request;
+
+	char *end_line = strstr(request, "\r\n");
+	*end_line = '\0';
+
+	char path[256] = {};
+
+	if (sscanf(request, "GET %255s HTTP/1.%*d", path) != 1)
+	{
+		const char *body = "Bad request.\n";
+		reply(client, "400 Bad Request", "text/plain", body, strlen(body));
+		return;
+	}
+
+	char *headers = end_line + 2;
+
+	if (strcmp(path, "/") == 0)
+	{
+		reply(client, "200 OK", "text/html; charset=utf-8", global_page, strlen(global_page));
+	}
+	else if (strcmp(path, "/state") == 0)
+	{
+		char json[MAX_DASHBOARD_JSON_SIZE];
+		u64 now = get_monotonic_ns();
+		int json_size = format_state(&dashboard->state, get_time_left(&dashboard->state, now), json, sizeof(json));
+
+		reply(client, "200 OK", "application/json", json, json_size);
+	}
+	else if (strcmp(path, "/ws") == 0)
+	{
+		char *upgrade = find_header(headers, "Upgrade");
+		char *key = find_header(headers, "Sec-WebSocket-Key");
+
+		if (!upgrade || (strncasecmp(upgrade, "websocket", 9) != 0) ||
+			(upgrade[9 + strspn(upgrade + 9, " \t")] != '\r') || !key)
+		{
+			const char *body = "Bad request.\n";
+			reply(client, "400 Bad Request", "text/plain", body, strlen(body));
+			return;
+		}
+
+		int key_length = (int) strcspn(key, " \t\r\n");
+
+		char accept_input[128];
+		int accept_input_size = snprintf(accept_input, sizeof(accept_input), "%.*s%s",
+										 MIN(key_length, 64), key, WEBSOCKET_GUID);
+
+		u8 digest[20];
+		sha1((u8 *) accept_input, accept_input_size, digest);
+
+		char accept[32];
+		base64_encode(digest, sizeof(digest), accept);
+
+		char header[256];
+		int header_size = snprintf(header, sizeof(header),
+								   "HTTP/1.1 101 Switching Protocols\r\n"
+								   "Upgrade: websocket\r\n"
+								   "Connection: Upgrade\r\n"
+								   "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+
+		queue_output(client, header, header_size);
+
+		client->viewer = true;
+		++dashboard->viewer_count;
+
+		// What is going on right now, not at the next change.
+		char frame[MAX_DASHBOARD_JSON_SIZE + 4];
+		u32 frame_size = make_state_frame(&dashboard->state, get_monotonic_ns(), frame, sizeof(frame));
+
+		queue_output(client, frame, frame_size);
+	}
+	else
+	{
+		const char *body = "Not found.\n";
+		reply(client, "404 Not Found", "text/plain", body, strlen(body));
+	}
+}
+
+internal void read_client(Dashboard *dashboard, DashboardClient *client)
+{
+	if (client->viewer)
+	{
+		char buffer[512];
+		ssize_t num_read = recv(client->fd, buffer, sizeof(buffer), 0);
+
+		// NOTE: Viewers send nothing but close frames (and pongs): one
+		//       is enough to tell they are leaving.
+		if ((num_read == 0) || ((num_read == -1) && (errno != EAGAIN) && (errno != EINTR)) ||
+			((num_read > 0) && ((buffer[0] & 0x0F) == 0x8)))
+		{
+			close_client(dashboard, client);
+		}
+
+		return;
+	}
+
+	u32 room = sizeof(client->request) - 1 - client->request_size;
+	ssize_t num_read = recv(client->fd, client->request + client->request_size, room, 0);
+
+	if ((num_read == -1) && ((errno == EAGAIN) || (errno == EINTR)))
+	{
+		return;
+	}
+
+	if (num_read <= 0)
+	{
+		close_client(dashboard, client);
+		return;
+	}
+
+	if (client->closing)
+	{
+		// Whatever comes after the request is of no use.
+		return;
+	}
+
+	client->request_size += num_read;
+	client->request[client->request_size] = '\0';
+
+	if (strstr(client->request, "\r\n\r\n"))
+	{
+		handle_request(dashboard, client);
+		flush_client(dashboard, client);
+	}
+	else if (client->request_size == sizeof(client->request) - 1)
+	{
+		close_client(dashboard, client);
+	}
+}
+
+internal void accept_clients(Dashboard *dashboard)
+{
+	for (;;)
+	{
+		int fd = accept4(dashboard->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd == -1)
+		{
+			return;
+		}
+
+		DashboardClient *client = NULL;
+
+		for (int i = 0; (i < MAX_DASHBOARD_CLIENT_COUNT) && !client; ++i)
+		{
+			if (dashboard->all_clients[i].fd == -1)
+			{
+				client = dashboard->all_clients + i;
+			}
+		}
+
+		if (!client)
+		{
+			close(fd);
+			continue;
+		}
+
+		client->fd			 = fd;
+		client->viewer		 = false;
+		client->closing		 = false;
+		client->missed_state = false;
+		client->request_size = 0;
+		client->output_start = 0;
+		client->output_end	 = 0;
+
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u32 = (u32) (client - dashboard->all_clients);
+
+		if (epoll_ctl(dashboard->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+		{
+			close(fd);
+			client->fd = -1;
+		}
+	}
+}
+
+// In milliseconds, -1 for none: until what viewers are shown changes,
+// if a countdown is running.
+internal int get_timeout(Dashboard *dashboard, u64 now)
+{
+	DashboardState *state = &dashboard->state;
+
+	if (!dashboard->viewer_count || !state->end || state->paused || (state->end <= now))
+	{
+		return -1;
+	}
+
+	u64 left = state->end - now;
+	u64 shown = (left + DASHBOARD_FRAME_PERIOD_NS - 1) / DASHBOARD_FRAME_PERIOD_NS;
+	u64 until_change = left - (shown - 1) * DASHBOARD_FRAME_PERIOD_NS;
+
+	return (int) ((until_change + 999999) / 1000000);
+}
+
+// Returns false if the latest state was read already, or kept changing
+// (the session wakes the thread up again once it is done writing).
+internal b32 read_latest_state(Dashboard *dashboard)
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+		u32 sequence = ATOMIC_LOAD(&dashboard->sequence);
+
+		if (sequence == dashboard->shown_sequence)
+		{
+			return false;
+		}
+
+		if (sequence & 1)
+		{
+			continue;
+		}
+
+		DashboardState state;
+		memcpy(&state, &dashboard->latest_state, sizeof(state));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&dashboard->sequence, __ATOMIC_RELAXED) == sequence)
+		{
+			dashboard->state = state;
+			dashboard->shown_sequence = sequence;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+internal void *dashboard_thread(void *data)
+{
+	Dashboard *dashboard = (Dashboard *) data;
+
+	for (;;)
+	{
+		u64 now = get_monotonic_ns();
+
+		struct epoll_event all_events[16];
+		int event_count = epoll_wait(dashboard->epoll_fd, all_events, ARRAY_SIZE(all_events),
+									 get_timeout(dashboard, now));
+
+		now = get_monotonic_ns();
+
+		for (int i = 0; i < event_count; ++i)
+		{
+			u32 id = all_events[i].data.u32;
+
+			if (id == DASHBOARD_LISTEN_ID)
+			{
+				accept_clients(dashboard);
+			}
+			else if (id == DASHBOARD_WAKE_ID)
+			{
+				u64 count;
+				read(dashboard->wake_fd, &count, sizeof(count));
+
+				if (ATOMIC_LOAD(&dashboard->quitting))
+				{
+					return NULL;
+				}
+
+				if (read_latest_state(dashboard))
+				{
+					broadcast_state(dashboard, now);
+				}
+			}
+			else
+			{
+				DashboardClient *client = dashboard->all_clients + id;
+
+				// Closed earlier in this batch.
+				if (client->fd == -1)
+				{
+					continue;
+				}
+
+				if (all_events[i].events & (EPOLLERR | EPOLLHUP))
+				{
+					close_client(dashboard, client);
+					continue;
+				}
+
+				if ((all_events[i].events & EPOLLOUT) && !flush_client(dashboard, client))
+				{
+					continue;
+				}
+
+				if (all_events[i].events & EPOLLIN)
+				{
+					read_client(dashboard, client);
+				}
+			}
+		}
+
+		if ((u64) get_time_left(&dashboard->state, now) != dashboard->shown_time_left)
+		{
+			broadcast_state(dashboard, now);
+		}
+	}
+}
+
+// Returns the listening socket, -1 if it could not be opened.
+internal int listen_on(char *address)
+{
+	char host[256] = "127.0.0.1";
+	char *port = address;
+	char *colon = strrchr(address, ':');
+
+	if (colon)
+	{
+		snprintf(host, sizeof(host), "%.*s", (int) (colon - address), address);
+		port = colon + 1;
+	}
+
+	struct addrinfo hints = {};
+	hints.ai_family	  = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags	  = AI_PASSIVE | AI_NUMERICSERV;
+
+	struct addrinfo *all_infos;
+	int error;
+
+	if ((error = getaddrinfo(host, port, &hints, &all_infos)) != 0)
+	{
+		fprintf(stderr, "%s: dashboard address '%s': %s.\n", PROGRAM, address, gai_strerror(error));
+		return -1;
+	}
+
+	int fd = -1;
+
+	for (struct addrinfo *info = all_infos; info && (fd == -1); info = info->ai_next)
+	{
+		if ((fd = socket(info->ai_family, info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+						 info->ai_protocol)) == -1)
+		{
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		if ((bind(fd, info->ai_addr, info->ai_addrlen) == -1) || (listen(fd, 16) == -1))
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	if (fd != -1)
+	{
+		printf("Dashboard on http://%s:%s/\n", host, port);
+	}
+	else
+	{
+		char buffer[300];
+		snprintf(buffer, sizeof(buffer), "%s: dashboard address '%s'", PROGRAM, address);
+
+		perror(buffer);
+	}
+
+	freeaddrinfo(all_infos);
+
+	return fd;
+}
+
+b32 dashboard_start(Dashboard *dashboard, char *address)
+{
+	memset(dashboard, 0, sizeof(*dashboard));
+
+	if ((dashboard->listen_fd = listen_on(address)) == -1)
+	{
+		return false;
+	}
+
+	if (((dashboard->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) ||
+		((dashboard->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1))
+	{
+		perror("dashboard");
+
+		(dashboard->epoll_fd != -1) ? close(dashboard->epoll_fd) : 0;
+		close(dashboard->listen_fd);
+		return false;
+	}
+
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+
+	event.data.u32 = DASHBOARD_LISTEN_ID;
+	epoll_ctl(dashboard->epoll_fd, EPOLL_CTL_ADD, dashboard->listen_fd, &event);
+
+	event.data.u32 = DASHBOARD_WAKE_ID;
+	epoll_ctl(dashboard->epoll_fd, EPOLL_CTL_ADD, dashboard->wake_fd, &event);
+
+	dashboard->all_clients = (DashboardClient *) calloc(MAX_DASHBOARD_CLIENT_COUNT, sizeof(DashboardClient));
+
+	for (int i = 0; i < MAX_DASHBOARD_CLIENT_COUNT; ++i)
+	{
+		dashboard->all_clients[i].fd = -1;
+	}
+
+	dashboard->state.next_exercise = EMPTY_STRING_ID;
+	dashboard->shown_time_left = (u64) -1;
+
+	if (pthread_create(&dashboard->thread, NULL, dashboard_thread, dashboard) != 0)
+	{
+		fprintf(stderr, "%s: could not start the dashboard thread.\n", PROGRAM);
+
+		free(dashboard->all_clients);
+		close(dashboard->wake_fd);
+		close(dashboard->epoll_fd);
+		close(dashboard->listen_fd);
+		return false;
+	}
+
+	dashboard->running = true;
+
+	return true;
+}
+
+void dashboard_stop(Dashboard *dashboard)
+{
+	if (!dashboard->running)
+	{
+		return;
+	}
+
+	ATOMIC_STORE(&dashboard->quitting, true);
+
+	u64 one = 1;
+	write(dashboard->wake_fd, &one, sizeof(one));
+
+	pthread_join(dashboard->thread, NULL);
+
+	dashboard->running = false;
+
+	for (int i = 0; i < MAX_DASHBOARD_CLIENT_COUNT; ++i)
+	{
+		if (dashboard->all_clients[i].fd != -1)
+		{
+			close(dashboard->all_clients[i].fd);
+		}
+	}
+
+	free(dashboard->all_clients);
+
+	close(dashboard->wake_fd);
+	close(dashboard->epoll_fd);
+	close(dashboard->listen_fd);
+}
+
+void dashboard_publish(Dashboard *dashboard, DashboardState *state)
+{
+	if (!dashboard || !dashboard->running)
+	{
+		return;
+	}
+
+	u32 sequence = dashboard->sequence;
+
+	// Odd: the thread knows not to trust what it copies from now on.
+	ATOMIC_STORE(&dashboard->sequence, sequence + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	dashboard->latest_state = *state;
+
+	ATOMIC_STORE(&dashboard->sequence, sequence + 2);
+
+	u64 one = 1;
+	write(dashboard->wake_fd, &one, sizeof(one));
+}
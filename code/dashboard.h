@@ -0,0 +1,96 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <pthread.h>
+
+#include "common.h"
+
+#define MAX_DASHBOARD_CLIENT_COUNT 64
+
+// The time left is shown to the tenth of a second: viewers are sent
+// it when that changes (and only if there are any).
+#define DASHBOARD_FRAME_PERIOD_NS 100000000ULL
+
+enum DashboardPhase
+{
+	DASHBOARD_IDLE,
+
+	// From "Ready" to "Go".
+	DASHBOARD_SETUP,
+
+	// A timed set.
+	DASHBOARD_WORK,
+
+	// A set lasting until SPACE or ENTER is pressed.
+	DASHBOARD_WAITING,
+
+	DASHBOARD_REST,
+	DASHBOARD_FINISHED,
+};
+
+// What the session is doing, sent whole on every change.
+struct DashboardState
+{
+	u32 phase;
+
+	// Interned.
+	u32 program;
+	u32 exercise;
+	u32 next_exercise;
+
+	u8 series;
+	u8 series_count;
+
+	b32 paused;
+
+	// When the countdown ends (CLOCK_MONOTONIC), 0 if there is none.
+	// While paused, how long it has left instead.
+	u64 end;
+};
+
+struct DashboardClient;
+
+// Status page served over HTTP, the state being pushed to it over a
+// WebSocket, by its own thread: viewers (however many, however slow)
+// never hold the session back.
+// States come from a single thread (the session's).
+struct Dashboard
+{
+	int listen_fd;
+	int epoll_fd;
+
+	// Written to after each state, so the thread wakes up.
+	int wake_fd;
+
+	// The latest state, each one replacing the one before (only the
+	// latest is worth showing).
+	// NOTE: A seqlock, SEQUENCE being odd while it is written (see
+	//       dashboard_publish and read_latest_state).
+	DashboardState latest_state;
+	u32 sequence;
+
+	// Set by dashboard_stop.
+	b32 quitting;
+
+	pthread_t thread;
+	b32 running;
+
+	// Only the dashboard's thread touches those.
+	u32 shown_sequence;
+	DashboardState state;
+	DashboardClient *all_clients;
+	int viewer_count;
+
+	// In tenths of a second, what viewers were last sent.
+	u64 shown_time_left;
+};
+
+// ADDRESS is [HOST:]PORT, HOST being 127.0.0.1 by default.
+b32 dashboard_start(Dashboard *dashboard, char *address);
+void dashboard_stop(Dashboard *dashboard);
+
+// Never blocks (if the dashboard's thread is behind, it skips the
+// states before STATE). DASHBOARD can be NULL.
+void dashboard_publish(Dashboard *dashboard, DashboardState *state);
+
+#endif
@@ -41,9 +41,9 @@ typedef int			b32;
 		b				 = ef__temp;			\
 	}while (0)
 
-#define CLAMP(x, min, max) ((x) < (min)) ? (min) : (x) > (max) ? (max) : (x)
-#define MIN(a, b) ((a) < (b)) ? (a) : (b)
-#define MAX(a, b) ((a) > (b)) ? (a) : (b)
+#define CLAMP(x, min, max) (((x) < (min)) ? (min) : ((x) > (max)) ? (max) : (x))
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 #define OFFSET_OF(type, f) (size_t) &((type *)0)->f
 
@@ -72,6 +72,10 @@ typedef int			b32;
 													\
 	}while (0)
 
+// Atomics (for flags shared between threads)
+#define ATOMIC_LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
 #define STRING_COPY(dest, src) STRING_N_COPY(dest, src, strlen(src))
 
 #define STRING_N_COPY(dest, src, n)do			\
@@ -0,0 +1,167 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+
+#include "events.h"
+#include "timer.h"
+
+b32 event_stream_open(EventStream *stream)
+{
+	stream->size = 0;
+	stream->dropped_count = 0;
+
+	fflush(stdout);
+
+	if ((stream->fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3)) == -1)
+	{
+		perror("--events");
+		return false;
+	}
+
+	// Nothing else writes to it from now on.
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	stream->saved_flags = fcntl(stream->fd, F_GETFL);
+	fcntl(stream->fd, F_SETFL, stream->saved_flags | O_NONBLOCK);
+
+	return true;
+}
+
+void event_stream_flush(EventStream *stream)
+{
+	u32 written = 0;
+
+	while (written < stream->size)
+	{
+		ssize_t num_written = write(stream->fd, stream->buffer + written, stream->size - written);
+
+		if (num_written == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			// EAGAIN: the rest waits for the reader. Anything else
+			// (e.g: EPIPE): it is gone, so is what is left.
+			if (errno != EAGAIN)
+			{
+				written = stream->size;
+			}
+
+			break;
+		}
+
+		written += num_written;
+	}
+
+	memmove(stream->buffer, stream->buffer + written, stream->size - written);
+	stream->size -= written;
+}
+
+b32 event_stream_pending(EventStream *stream)
+{
+	return (stream && (stream->fd != -1) && stream->size);
+}
+
+void event_stream_close(EventStream *stream)
+{
+	if (stream->fd == -1)
+	{
+		return;
+	}
+
+	u64 deadline = get_monotonic_ns() + EVENT_CLOSE_TIMEOUT * 1000000ULL;
+
+	event_stream_flush(stream);
+
+	while (stream->size)
+	{
+		u64 now = get_monotonic_ns();
+
+		struct pollfd poll_fd = { stream->fd, POLLOUT, 0 };
+
+		if ((now >= deadline) || (poll(&poll_fd, 1, (int) ((deadline - now) / 1000000ULL)) <= 0))
+		{
+			break;
+		}
+
+		event_stream_flush(stream);
+	}
+
+	fcntl(stream->fd, F_SETFL, stream->saved_flags);
+	close(stream->fd);
+
+	stream->fd = -1;
+}
+
+// Returns false if there is no room for LENGTH more bytes.
+internal b32 append_event(EventStream *stream, const char *event, int length)
+{
+	if ((length <= 0) || (stream->size + length > EVENT_BUFFER_SIZE))
+	{
+		return false;
+	}
+
+	memcpy(stream->buffer + stream->size, event, length);
+	stream->size += length;
+
+	return true;
+}
+
+void emit_event(EventStream *stream, const char *type, const char *fields, ...)
+{
+	if (!stream || (stream->fd == -1))
+	{
+		return;
+	}
+
+	// Room is made first.
+	event_stream_flush(stream);
+
+	u64 now = get_monotonic_ns();
+
+	char event[MAX_EVENT_SIZE];
+
+	if (stream->dropped_count)
+	{
+		int length = snprintf(event, sizeof(event), "{\"t\":%llu,\"type\":\"dropped\",\"count\":%u}\n",
+							  (unsigned long long) now, stream->dropped_count);
+
+		if (!append_event(stream, event, length))
+		{
+			++stream->dropped_count;
+			return;
+		}
+
+		stream->dropped_count = 0;
+	}
+
+	int length = snprintf(event, sizeof(event), "{\"t\":%llu,\"type\":\"%s\"", (unsigned long long) now, type);
+
+	va_list arguments;
+	va_start(arguments, fields);
+	length += vsnprintf(event + length, sizeof(event) - length, fields, arguments);
+	va_end(arguments);
+
+	if (length + 2 >= (int) sizeof(event))
+	{
+		// NOTE: Names are cut short before they get here (see
+		//       escape_json), so this is never the case.
+		++stream->dropped_count;
+		return;
+	}
+
+	event[length++] = '}';
+	event[length++] = '\n';
+
+	if (!append_event(stream, event, length))
+	{
+		++stream->dropped_count;
+		return;
+	}
+
+	event_stream_flush(stream);
+}
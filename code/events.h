@@ -0,0 +1,55 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "common.h"
+
+// Events not written yet, at most (in bytes).
+#define EVENT_BUFFER_SIZE 65536
+
+#define MAX_EVENT_SIZE 1024
+
+// In milliseconds: how long event_stream_close waits for the reader.
+#define EVENT_CLOSE_TIMEOUT 1000
+
+// --events json: what a session does, one JSON object per line (see
+// emit_event), on stdout, for whatever wraps us. Anything else that
+// would have gone to stdout (the countdown, commands' output) goes to
+// stderr instead.
+// NOTE: Never blocks: events a slow reader has no room for yet are
+//       kept, and once there is no room left either, dropped (the
+//       reader is then told how many, by a "dropped" event).
+// Events come from a single thread (the session's).
+struct EventStream
+{
+	// Non-blocking, -1 if there is none.
+	int fd;
+
+	// Of the fd, before it was made non-blocking: it may be shared
+	// (e.g: with the shell, for a terminal).
+	int saved_flags;
+
+	char buffer[EVENT_BUFFER_SIZE];
+	u32 size;
+
+	u32 dropped_count;
+};
+
+// Takes stdout over.
+b32 event_stream_open(EventStream *stream);
+
+// Writes what is left (giving up after EVENT_CLOSE_TIMEOUT).
+void event_stream_close(EventStream *stream);
+
+// Writes what it can of the events kept, without blocking.
+void event_stream_flush(EventStream *stream);
+
+// Some events are kept, waiting for the fd to be writable (POLLOUT).
+b32 event_stream_pending(EventStream *stream);
+
+// Writes {"t":<now>,"type":"TYPE"<FIELDS>}, FIELDS being printf-like
+// (each field preceded by a comma), "t" in nanoseconds
+// (CLOCK_MONOTONIC, as DashboardState::end).
+// Does nothing if STREAM is NULL.
+void emit_event(EventStream *stream, const char *type, const char *fields, ...);
+
+#endif
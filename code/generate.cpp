@@ -0,0 +1,489 @@
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "builtin.h"
+#include "generate.h"
+#include "parsing.h"
+
+// Searches done again after dropping a program sharing an exercise
+// with the others, before settling for less.
+#define MAX_SEARCH_COUNT 64
+
+#define MAX_CANDIDATE_EXERCISE_COUNT ARRAY_SIZE(((Program *) 0)->all_exercises)
+
+struct Candidate
+{
+	// File name, or BUILTIN_PREFIX and the name.
+	char name[256];
+
+	// In milliseconds, every pause included.
+	u32 duration;
+
+	// What the search works with (rounded up, so the session is never
+	// longer than what it was planned for).
+	u32 seconds;
+
+	// Not waited for if the program ends the session.
+	u32 last_pause;
+
+	b32 has_rep_sets;
+	b32 removed;
+
+	// Interned, so equal names have equal ids.
+	u32 all_exercise_names[MAX_CANDIDATE_EXERCISE_COUNT];
+	int exercise_count;
+};
+
+struct CandidateList
+{
+	Candidate *all_candidates;
+	int count;
+	int capacity;
+};
+
+internal b32 is_tag_separator(char c)
+{
+	return ((c == ',') || (c == ' ') || (c == '\t') || (c == '\n'));
+}
+
+// Returns true if TAGS has every tag of WANTED_TAGS (or if there are
+// none of the latter).
+internal b32 has_tags(const char *tags, char *wanted_tags)
+{
+	if (!wanted_tags)
+	{
+		return true;
+	}
+
+	for (char *wanted = wanted_tags; *wanted;)
+	{
+		while (*wanted && is_tag_separator(*wanted))
+		{
+			++wanted;
+		}
+
+		size_t wanted_len = 0;
+
+		while (wanted[wanted_len] && !is_tag_separator(wanted[wanted_len]))
+		{
+			++wanted_len;
+		}
+
+		if (!wanted_len)
+		{
+			break;
+		}
+
+		b32 found = false;
+
+		for (const char *tag = tags; *tag && !found;)
+		{
+			while (*tag && is_tag_separator(*tag))
+			{
+				++tag;
+			}
+
+			size_t tag_len = 0;
+
+			while (tag[tag_len] && !is_tag_separator(tag[tag_len]))
+			{
+				++tag_len;
+			}
+
+			found = ((tag_len == wanted_len) && (strncmp(tag, wanted, tag_len) == 0));
+			tag += tag_len;
+		}
+
+		if (!found)
+		{
+			return false;
+		}
+
+		wanted += wanted_len;
+	}
+
+	return true;
+}
+
+internal void add_candidate(CandidateList *list, char *name, Program *program, u32 setup_time)
+{
+	if (list->count == list->capacity)
+	{
+		list->capacity = MAX(64, list->capacity * 2);
+		list->all_candidates = (Candidate *) realloc(list->all_candidates,
+													 list->capacity * sizeof(Candidate));
+	}
+
+	Candidate *candidate = list->all_candidates + list->count++;
+	memset(candidate, 0, sizeof(*candidate));
+
+	strncpy(candidate->name, name, sizeof(candidate->name) - 1);
+
+	u64 duration = 0;
+
+	for (int i = 0; i < program->exercise_count; ++i)
+	{
+		Exercise *exercise = program->all_exercises + i;
+		u32 set_duration = exercise->duration;
+
+		if (!set_duration)
+		{
+			set_duration = REP_SET_DURATION;
+			candidate->has_rep_sets = true;
+		}
+
+		duration += (u64) exercise->series_count * ((u64) setup_time + set_duration + exercise->pause_duration);
+
+		candidate->all_exercise_names[candidate->exercise_count++] = exercise->name;
+	}
+
+	candidate->last_pause = program->all_exercises[program->exercise_count - 1].pause_duration;
+
+	candidate->duration = MIN(duration, (u64) UINT32_MAX);
+	candidate->seconds	= (candidate->duration + 999) / 1000;
+}
+
+// Only programs without references: the generated session is what
+// puts programs together.
+internal b32 read_program(char *dir, char *file_name, char *tags, Program *program, FILE *errors)
+{
+	char filename[512];
+	snprintf(filename, sizeof(filename), "%s/%s", dir, file_name);
+
+	FILE *file;
+
+	if (!(file = fopen(filename, "r")))
+	{
+		return false;
+	}
+
+	memset(program, 0, sizeof(*program));
+
+	ProgramParser parser;
+	init_program_parser(&parser, file_name, program, errors);
+
+	char program_tags[256];
+	program_tags[0] = '\0';
+
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+	b32 valid = true;
+
+	while (valid && (getline(&buffer, &buffer_size, file) != -1))
+	{
+		char *line = buffer;
+
+		while ((*line == ' ') || (*line == '\t'))
+		{
+			++line;
+		}
+
+		if (strncmp(line, PROGRAM_TAGS_PREFIX, strlen(PROGRAM_TAGS_PREFIX)) == 0)
+		{
+			strncpy(program_tags, line + strlen(PROGRAM_TAGS_PREFIX), sizeof(program_tags) - 1);
+			program_tags[sizeof(program_tags) - 1] = '\0';
+		}
+
+		char *reference;
+
+		valid = (parse_program_line(&parser, buffer, &reference) == PROGRAM_LINE_OK);
+	}
+
+	free(buffer);
+	fclose(file);
+
+	return ((end_program_parsing(&parser) == 0) && valid &&
+			program->exercise_count && has_tags(program_tags, tags));
+}
+
+internal void list_candidates(CandidateList *list, char *dir, char *tags, u32 setup_time)
+{
+	Program *program = (Program *) malloc(sizeof(Program));
+
+	for (int i = 0; i < builtin_program_count(); ++i)
+	{
+		const BuiltinProgram *builtin = get_builtin_program(i);
+
+		if (has_tags(builtin->tags, tags))
+		{
+			char name[256];
+			snprintf(name, sizeof(name), "%s%s", BUILTIN_PREFIX, builtin->name);
+
+			load_builtin_program(name, program);
+			add_candidate(list, name, program, setup_time);
+		}
+	}
+
+	DIR *directory;
+
+	if ((directory = opendir(dir)))
+	{
+		// Broken programs are not candidates, --check-programs is
+		// there to tell what is wrong with them.
+		FILE *errors = fopen("/dev/null", "w");
+
+		struct dirent *entry;
+
+		while (errors && (entry = readdir(directory)))
+		{
+			if ((entry->d_name[0] != '.') &&
+				read_program(dir, entry->d_name, tags, program, errors))
+			{
+				add_candidate(list, entry->d_name, program, setup_time);
+			}
+		}
+
+		if (errors)
+		{
+			fclose(errors);
+		}
+
+		closedir(directory);
+	}
+
+	free(program);
+}
+
+// 0/1 knapsack over the candidates' durations (in seconds), with at
+// most MAX_PROGRAM_COUNT of them: REACHED[K] is the set (as a bitset)
+// of the durations K candidates add up to, and FIRST_CANDIDATE the
+// candidate that first reached each of them, for it to be walked back.
+// Returns the number of candidates put in ALL_CHOSEN.
+internal int search(Candidate *all_candidates, int candidate_count, u32 budget,
+					int max_program_count, int *all_chosen)
+{
+	int word_count = budget / 64 + 1;
+	int bit_count = budget + 1;
+
+	u64 *reached = (u64 *) calloc((max_program_count + 1) * word_count, sizeof(u64));
+	int *first_candidate = (int *) malloc((max_program_count + 1) * bit_count * sizeof(int));
+
+	// Bits past the budget are never set.
+	u64 last_word_mask = (bit_count % 64) ? ((1ULL << (bit_count % 64)) - 1) : ~0ULL;
+
+	reached[0] = 1;
+
+	for (int i = 0; i < candidate_count; ++i)
+	{
+		Candidate *candidate = all_candidates + i;
+
+		if (candidate->removed || (candidate->seconds > budget))
+		{
+			continue;
+		}
+
+		int word_shift = candidate->seconds / 64;
+		int bit_shift  = candidate->seconds % 64;
+
+		// Downwards, so this candidate is only added once.
+		for (int k = max_program_count; k > 0; --k)
+		{
+			u64 *from = reached + (k - 1) * word_count;
+			u64 *to	  = reached + k * word_count;
+
+			for (int j = word_count - 1; j >= word_shift; --j)
+			{
+				u64 shifted = from[j - word_shift] << bit_shift;
+
+				if (bit_shift && (j - word_shift > 0))
+				{
+					shifted |= from[j - word_shift - 1] >> (64 - bit_shift);
+				}
+
+				if (j == word_count - 1)
+				{
+					shifted &= last_word_mask;
+				}
+
+				u64 new_bits = shifted & ~to[j];
+
+				while (new_bits)
+				{
+					int bit = __builtin_ctzll(new_bits);
+					new_bits &= new_bits - 1;
+
+					first_candidate[k * bit_count + j * 64 + bit] = i;
+				}
+
+				to[j] |= shifted;
+			}
+		}
+	}
+
+	int best_k = 0;
+	u32 best_duration = 0;
+
+	for (int k = 1; k <= max_program_count; ++k)
+	{
+		u64 *words = reached + k * word_count;
+
+		for (int j = word_count - 1; j >= 0; --j)
+		{
+			if (words[j])
+			{
+				u32 duration = j * 64 + (63 - __builtin_clzll(words[j]));
+
+				if (duration > best_duration)
+				{
+					best_duration = duration;
+					best_k = k;
+				}
+
+				break;
+			}
+		}
+	}
+
+	int chosen_count = 0;
+	u32 duration = best_duration;
+
+	// Each step goes back to a duration reached before that candidate
+	// was looked at, so none comes twice.
+	for (int k = best_k; k > 0; --k)
+	{
+		int i = first_candidate[k * bit_count + duration];
+
+		all_chosen[chosen_count++] = i;
+		duration -= all_candidates[i].seconds;
+	}
+
+	free(first_candidate);
+	free(reached);
+
+	return chosen_count;
+}
+
+// Returns the index (in ALL_CHOSEN) of the first candidate with an
+// exercise some candidate before it already has, -1 if none.
+internal int find_repeated_exercise(Candidate *all_candidates, int *all_chosen, int chosen_count)
+{
+	for (int i = 1; i < chosen_count; ++i)
+	{
+		Candidate *candidate = all_candidates + all_chosen[i];
+
+		for (int j = 0; j < i; ++j)
+		{
+			Candidate *previous = all_candidates + all_chosen[j];
+
+			for (int a = 0; a < candidate->exercise_count; ++a)
+			{
+				for (int b = 0; b < previous->exercise_count; ++b)
+				{
+					if (candidate->all_exercise_names[a] == previous->all_exercise_names[b])
+					{
+						return i;
+					}
+				}
+			}
+		}
+	}
+
+	return -1;
+}
+
+internal void print_duration(u32 duration)
+{
+	u32 seconds = (duration + 999) / 1000;
+
+	printf("%u:%02u", seconds / 60, seconds % 60);
+}
+
+int generate_session(char *dir, char *tags, u32 budget, u32 setup_time,
+					 Program *all_programs, int max_program_count)
+{
+	CandidateList list = {};
+	list_candidates(&list, dir, tags, setup_time);
+
+	Candidate *all_candidates = list.all_candidates;
+
+	// Random order, so the search picks a different session (among
+	// the equally good ones) each time.
+	srand(time(NULL) ^ getpid());
+
+	for (int i = list.count - 1; i > 0; --i)
+	{
+		int j = rand() % (i + 1);
+
+		SWAP(Candidate, all_candidates[i], all_candidates[j]);
+	}
+
+	max_program_count = MIN(max_program_count, MAX_PROGRAM_COUNT);
+
+	int all_chosen[MAX_PROGRAM_COUNT];
+	int chosen_count = 0;
+
+	for (int i = 0; i < MAX_SEARCH_COUNT; ++i)
+	{
+		chosen_count = search(all_candidates, list.count, budget / 1000, max_program_count, all_chosen);
+
+		int repeated = find_repeated_exercise(all_candidates, all_chosen, chosen_count);
+
+		if (repeated == -1)
+		{
+			break;
+		}
+
+		all_candidates[all_chosen[repeated]].removed = true;
+
+		// Out of searches: whatever is left without repeats.
+		if (i == MAX_SEARCH_COUNT - 1)
+		{
+			while ((repeated = find_repeated_exercise(all_candidates, all_chosen, chosen_count)) != -1)
+			{
+				all_chosen[repeated] = all_chosen[--chosen_count];
+			}
+		}
+	}
+
+	u64 total = 0;
+	u32 last_pause = 0;
+
+	b32 has_rep_sets = false;
+
+	int program_count = 0;
+
+	for (int i = 0; i < chosen_count; ++i)
+	{
+		Candidate *candidate = all_candidates + all_chosen[i];
+
+		memset(all_programs + program_count, 0, sizeof(Program));
+
+		if (load_builtin_program(candidate->name, all_programs + program_count))
+		{
+			++program_count;
+		}
+		else
+		{
+			char filename[512];
+			snprintf(filename, sizeof(filename), "%s/%s", dir, candidate->name);
+
+			// Self-contained, so a single program.
+			if (parse_program_file(filename, all_programs, &program_count, program_count + 1) != 0)
+			{
+				continue;
+			}
+		}
+
+		total += candidate->duration;
+		last_pause = candidate->last_pause;
+		has_rep_sets = has_rep_sets || candidate->has_rep_sets;
+
+		printf("  %s (%s", candidate->name, candidate->has_rep_sets ? "~" : "");
+		print_duration(candidate->duration);
+		printf(")\n");
+	}
+
+	if (program_count)
+	{
+		printf("%s", has_rep_sets ? "About " : "");
+		print_duration(total - last_pause);
+		printf(" out of ");
+		print_duration(budget);
+		printf(", out of %d candidate program%s.\n", list.count, (list.count > 1) ? "s" : "");
+	}
+
+	free(all_candidates);
+
+	return program_count;
+}
@@ -0,0 +1,16 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "common.h"
+
+// Picks programs, among the self-contained ones of DIR and the built-in
+// ones having every tag of TAGS (comma-separated, NULL for any), so the
+// session lasts as close to BUDGET as possible without going over, and
+// no exercise comes twice. Among equally good sessions, one is picked
+// at random.
+// BUDGET and SETUP_TIME are in milliseconds.
+// Returns the number of programs put in ALL_PROGRAMS (0 if none fits).
+int generate_session(char *dir, char *tags, u32 budget, u32 setup_time,
+					 Program *all_programs, int max_program_count);
+
+#endif
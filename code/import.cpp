@@ -0,0 +1,1372 @@
+#include <unistd.h>
+#include <errno.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "import.h"
+#include "intern.h"
+#include "library.h"
+#include "parsing.h"
+#include "timer.h"
+
+enum
+{
+	IMPORT_PROGRAM,
+	IMPORT_ID,
+	IMPORT_EXERCISE,
+	IMPORT_SAY,
+	IMPORT_SERIES,
+	IMPORT_TEMPO,
+	IMPORT_DURATION,
+	IMPORT_MILESTONE,
+	IMPORT_PAUSE,
+
+	IMPORT_FIELD_COUNT,
+
+	// A column (or key) that is not one of the above.
+	IMPORT_IGNORED = IMPORT_FIELD_COUNT
+};
+
+// CSV column names, or JSON keys (whatever their case).
+internal const char *all_field_names[IMPORT_FIELD_COUNT] =
+{
+	"program", "id", "exercise", "say", "series", "tempo", "duration", "milestone", "pause"
+};
+
+struct ImportRow
+{
+	// Empty if not given.
+	char all_fields[IMPORT_FIELD_COUNT][MAX_IMPORT_FIELD_SIZE];
+
+	// Where it starts.
+	int line;
+
+	// Why it cannot be imported, whatever it has (empty if it can).
+	char error[128];
+};
+
+struct ImportReader
+{
+	FILE *file;
+	int line;
+
+	// CSV: ',', ';' or '\t' (whichever comes first in the header), and
+	// which field each column is.
+	int separator;
+	u8 all_columns[MAX_IMPORT_COLUMN_COUNT];
+	int column_count;
+};
+
+struct Importer
+{
+	// For messages.
+	char *filename;
+
+	char program_dir[512];
+	b32 to_library;
+	FILE *library;
+
+	ImportRow row;
+
+	// Checks rows (see parse_row), exercises going into PROGRAM.
+	ProgramParser parser;
+	Program program;
+
+	// Program files: the program being imported, its parts being
+	// written to temporary files (see part_path) as it goes, moved
+	// into place once it has been read through without an error.
+	char program_name[MAX_IMPORT_FIELD_SIZE];
+	b32 has_program;
+	b32 program_valid;
+	u32 program_row_count;
+	FILE *part;
+	int part_count;
+
+	// Of every program imported so far, so rows of the same program
+	// that are not next to each other are told (0: empty slot).
+	u64 *all_program_hashes;
+	u32 program_count;
+
+	u32 row_count;
+	u32 imported_row_count;
+	u32 written_count;
+	int error_count;
+};
+
+#define IMPORT_ERROR(importer, line, format, ...) do						\
+	{																	\
+		fprintf(stderr, "%s: %s (line %d): " format "\n",				\
+				PROGRAM, (importer)->filename, line, ##__VA_ARGS__);	\
+		++(importer)->error_count;										\
+	} while (0)
+
+internal int find_field(const char *name)
+{
+	if (strcasecmp(name, "name") == 0)
+	{
+		return IMPORT_EXERCISE;
+	}
+
+	for (int i = 0; i < IMPORT_FIELD_COUNT; ++i)
+	{
+		if (strcasecmp(name, all_field_names[i]) == 0)
+		{
+			return i;
+		}
+	}
+
+	return IMPORT_IGNORED;
+}
+
+internal void clear_row(ImportRow *row, int line)
+{
+	for (int i = 0; i < IMPORT_FIELD_COUNT; ++i)
+	{
+		row->all_fields[i][0] = '\0';
+	}
+
+	row->line = line;
+	row->error[0] = '\0';
+}
+
+// Spreadsheets keep whatever spaces were typed around a value.
+internal void trim_field(char *field)
+{
+	size_t start = strspn(field, " \t");
+	size_t length = strlen(field + start);
+
+	while (length && ((field[start + length - 1] == ' ') || (field[start + length - 1] == '\t')))
+	{
+		--length;
+	}
+
+	memmove(field, field + start, length);
+	field[length] = '\0';
+}
+
+// FIELD (NULL to skip it) gets C, as long as there is room.
+internal inline void put_char(char *field, u32 *length, int c)
+{
+	if (field && (*length < MAX_IMPORT_FIELD_SIZE - 1))
+	{
+		field[*length] = (char) c;
+	}
+
+	++(*length);
+}
+
+internal inline void end_field(char *field, u32 length)
+{
+	if (field)
+	{
+		field[MIN(length, MAX_IMPORT_FIELD_SIZE - 1)] = '\0';
+	}
+}
+
+internal void check_field_length(ImportRow *row, int field, u32 length)
+{
+	if ((length >= MAX_IMPORT_FIELD_SIZE) && (row->error[0] == '\0'))
+	{
+		snprintf(row->error, sizeof(row->error), "%s too long (max %d characters)",
+				 all_field_names[field], MAX_IMPORT_FIELD_SIZE - 1);
+	}
+}
+
+// Skips spaces and newlines. Returns the next character (read).
+internal int skip_blank(ImportReader *reader)
+{
+	int c;
+
+	while ((c = getc_unlocked(reader->file)) != EOF)
+	{
+		if (c == '\n')
+		{
+			++reader->line;
+		}
+		else if ((c != ' ') && (c != '\t') && (c != '\r'))
+		{
+			break;
+		}
+	}
+
+	return c;
+}
+
+//
+// CSV (RFC 4180: fields may be quoted, a quote in there being doubled,
+// and hold newlines then).
+//
+
+// Reads a field into FIELD (NULL to skip it), *LENGTH being set to its
+// length (even if it did not fit).
+// Returns what ended it: the separator, '\n' or EOF.
+internal int read_csv_field(ImportReader *reader, char *field, u32 *length)
+{
+	FILE *file = reader->file;
+
+	b32 quoted = false;
+	b32 at_start = true;
+	int c;
+
+	*length = 0;
+
+	while ((c = getc_unlocked(file)) != EOF)
+	{
+		if (quoted)
+		{
+			if (c == '"')
+			{
+				c = getc_unlocked(file);
+
+				if (c != '"')
+				{
+					quoted = false;
+
+					if (c == EOF)
+					{
+						break;
+					}
+				}
+			}
+
+			if (quoted)
+			{
+				if (c == '\n')
+				{
+					++reader->line;
+				}
+
+				put_char(field, length, c);
+				continue;
+			}
+		}
+		else if ((c == '"') && at_start)
+		{
+			quoted = true;
+			at_start = false;
+			continue;
+		}
+
+		at_start = false;
+
+		if (c == '\r')
+		{
+			continue;
+		}
+
+		if ((c == '\n') || (c == reader->separator))
+		{
+			break;
+		}
+
+		// Still reading the header.
+		if (!reader->separator && ((c == ',') || (c == ';') || (c == '\t')))
+		{
+			reader->separator = c;
+			break;
+		}
+
+		put_char(field, length, c);
+	}
+
+	end_field(field, *length);
+
+	return c;
+}
+
+// Returns false if a column the rows need is missing.
+internal b32 read_csv_header(Importer *importer, ImportReader *reader)
+{
+	char name[MAX_IMPORT_FIELD_SIZE];
+	b32 all_found[IMPORT_FIELD_COUNT] = {};
+
+	reader->separator = 0;
+	reader->column_count = 0;
+
+	int end;
+
+	do
+	{
+		u32 length;
+		end = read_csv_field(reader, name, &length);
+
+		trim_field(name);
+
+		int field = find_field(name);
+
+		if (reader->column_count < MAX_IMPORT_COLUMN_COUNT)
+		{
+			reader->all_columns[reader->column_count++] = field;
+		}
+
+		if (field != IMPORT_IGNORED)
+		{
+			all_found[field] = true;
+		}
+	}
+	while ((end != '\n') && (end != EOF));
+
+	++reader->line;
+
+	// A single column.
+	if (!reader->separator)
+	{
+		reader->separator = ',';
+	}
+
+	int all_needed[] = { IMPORT_PROGRAM, IMPORT_EXERCISE, IMPORT_SERIES, IMPORT_PAUSE };
+	b32 valid = true;
+
+	for (u32 i = (importer->to_library ? 1 : 0); i < ARRAY_SIZE(all_needed); ++i)
+	{
+		if (!all_found[all_needed[i]])
+		{
+			fprintf(stderr, "%s: %s: no '%s' column (e.g: program,exercise,series,duration,pause).\n",
+					PROGRAM, importer->filename, all_field_names[all_needed[i]]);
+			++importer->error_count;
+
+			valid = false;
+		}
+	}
+
+	return valid;
+}
+
+// Returns false once there is no row left. Empty rows are skipped.
+internal b32 read_csv_row(ImportReader *reader, ImportRow *row)
+{
+	for (;;)
+	{
+		clear_row(row, reader->line);
+
+		b32 empty = true;
+		int column = 0;
+		int end;
+
+		do
+		{
+			int field = (column < reader->column_count) ? reader->all_columns[column] : (int) IMPORT_IGNORED;
+			u32 length;
+
+			end = read_csv_field(reader, (field != IMPORT_IGNORED) ? row->all_fields[field] : NULL, &length);
+
+			if (field != IMPORT_IGNORED)
+			{
+				check_field_length(row, field, length);
+			}
+
+			empty = empty && !length;
+			++column;
+		}
+		while (end == reader->separator);
+
+		if (end == '\n')
+		{
+			++reader->line;
+		}
+
+		if (!empty)
+		{
+			return true;
+		}
+
+		if (end == EOF)
+		{
+			return false;
+		}
+	}
+}
+
+//
+// JSON (objects of strings and numbers, null being the same as a key
+// that is not there).
+//
+
+internal void put_utf8(char *field, u32 *length, u32 code_point)
+{
+	if (code_point < 0x80)
+	{
+		put_char(field, length, code_point);
+	}
+	else if (code_point < 0x800)
+	{
+		put_char(field, length, 0xC0 | (code_point >> 6));
+		put_char(field, length, 0x80 | (code_point & 0x3F));
+	}
+	else if (code_point < 0x10000)
+	{
+		put_char(field, length, 0xE0 | (code_point >> 12));
+		put_char(field, length, 0x80 | ((code_point >> 6) & 0x3F));
+		put_char(field, length, 0x80 | (code_point & 0x3F));
+	}
+	else
+	{
+		put_char(field, length, 0xF0 | (code_point >> 18));
+		put_char(field, length, 0x80 | ((code_point >> 12) & 0x3F));
+		put_char(field, length, 0x80 | ((code_point >> 6) & 0x3F));
+		put_char(field, length, 0x80 | (code_point & 0x3F));
+	}
+}
+
+// The 4 hexadecimal digits after "\u". Returns false if they are not.
+internal b32 read_json_hex(ImportReader *reader, u32 *value)
+{
+	*value = 0;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		int c = getc_unlocked(reader->file);
+		u32 digit;
+
+		if ((c >= '0') && (c <= '9'))
+		{
+			digit = c - '0';
+		}
+		else if ((c >= 'a') && (c <= 'f'))
+		{
+			digit = c - 'a' + 10;
+		}
+		else if ((c >= 'A') && (c <= 'F'))
+		{
+			digit = c - 'A' + 10;
+		}
+		else
+		{
+			return false;
+		}
+
+		*value = (*value << 4) | digit;
+	}
+
+	return true;
+}
+
+// After its opening quote, into FIELD (NULL to skip it).
+// Returns false if it is not a valid string.
+internal b32 read_json_string(ImportReader *reader, char *field, u32 *length)
+{
+	FILE *file = reader->file;
+	int c;
+
+	*length = 0;
+
+	while ((c = getc_unlocked(file)) != '"')
+	{
+		if ((c == EOF) || (c == '\n'))
+		{
+			return false;
+		}
+
+		if (c != '\\')
+		{
+			put_char(field, length, c);
+			continue;
+		}
+
+		switch (c = getc_unlocked(file))
+		{
+			case '"':
+			case '\\':
+			case '/': { put_char(field, length, c); } break;
+			case 'b': { put_char(field, length, '\b'); } break;
+			case 'f': { put_char(field, length, '\f'); } break;
+			case 'n': { put_char(field, length, '\n'); } break;
+			case 'r': { put_char(field, length, '\r'); } break;
+			case 't': { put_char(field, length, '\t'); } break;
+
+			case 'u':
+			{
+				u32 code_point;
+
+				if (!read_json_hex(reader, &code_point))
+				{
+					return false;
+				}
+
+				// A surrogate pair.
+				if ((code_point >= 0xD800) && (code_point < 0xDC00))
+				{
+					u32 low;
+
+					if ((getc_unlocked(file) != '\\') || (getc_unlocked(file) != 'u') ||
+						!read_json_hex(reader, &low) || (low < 0xDC00) || (low >= 0xE000))
+					{
+						return false;
+					}
+
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+				}
+
+				put_utf8(field, length, code_point);
+			} break;
+
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+	end_field(field, *length);
+
+	return true;
+}
+
+// After its first character C (e.g: '[', a digit...), into FIELD
+// (NULL to skip it). ROW->error is set if it is not a string or a
+// number.
+// Returns false if it is not a valid value.
+internal b32 read_json_value(ImportReader *reader, int c, ImportRow *row, int field_index)
+{
+	FILE *file = reader->file;
+
+	char *field = (field_index != IMPORT_IGNORED) ? row->all_fields[field_index] : NULL;
+	u32 length = 0;
+
+	if (c == '"')
+	{
+		if (!read_json_string(reader, field, &length))
+		{
+			return false;
+		}
+	}
+	else if (((c >= '0') && (c <= '9')) || (c == '-'))
+	{
+		// Checked as a duration or count later on, like any string.
+		do
+		{
+			put_char(field, &length, c);
+			c = getc_unlocked(file);
+		}
+		while (((c >= '0') && (c <= '9')) || (c == '.') || (c == 'e') || (c == 'E') ||
+			   (c == '+') || (c == '-'));
+
+		ungetc(c, file);
+		end_field(field, length);
+	}
+	else if ((c >= 'a') && (c <= 'z'))
+	{
+		char word[8];
+		u32 word_length = 0;
+
+		do
+		{
+			if (word_length < sizeof(word) - 1)
+			{
+				word[word_length] = (char) c;
+			}
+
+			++word_length;
+			c = getc_unlocked(file);
+		}
+		while ((c >= 'a') && (c <= 'z'));
+
+		ungetc(c, file);
+		word[MIN(word_length, sizeof(word) - 1)] = '\0';
+
+		if ((strcmp(word, "true") == 0) || (strcmp(word, "false") == 0))
+		{
+			if ((field_index != IMPORT_IGNORED) && (row->error[0] == '\0'))
+			{
+				snprintf(row->error, sizeof(row->error), "%s is a boolean", all_field_names[field_index]);
+			}
+		}
+		else if (strcmp(word, "null") != 0)
+		{
+			return false;
+		}
+	}
+	else if ((c == '{') || (c == '['))
+	{
+		// Skipped whole, strings and all.
+		int depth = 1;
+
+		while (depth)
+		{
+			c = getc_unlocked(file);
+
+			if (c == EOF)
+			{
+				return false;
+			}
+
+			if (c == '\n')
+			{
+				++reader->line;
+			}
+			else if ((c == '{') || (c == '['))
+			{
+				++depth;
+			}
+			else if ((c == '}') || (c == ']'))
+			{
+				--depth;
+			}
+			else if ((c == '"') && !read_json_string(reader, NULL, &length))
+			{
+				return false;
+			}
+		}
+
+		if ((field_index != IMPORT_IGNORED) && (row->error[0] == '\0'))
+		{
+			snprintf(row->error, sizeof(row->error), "%s is not a string or a number",
+					 all_field_names[field_index]);
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	if (field_index != IMPORT_IGNORED)
+	{
+		check_field_length(row, field_index, length);
+	}
+
+	return true;
+}
+
+// After its '{'. Returns false if it is not a valid object.
+internal b32 read_json_row(ImportReader *reader, ImportRow *row)
+{
+	int c = skip_blank(reader);
+
+	if (c == '}')
+	{
+		return true;
+	}
+
+	for (;;)
+	{
+		char key[32];
+		u32 length;
+
+		if ((c != '"') || !read_json_string(reader, key, &length))
+		{
+			return false;
+		}
+
+		int field = (length < sizeof(key)) ? find_field(key) : IMPORT_IGNORED;
+
+		if ((skip_blank(reader) != ':') || !read_json_value(reader, skip_blank(reader), row, field))
+		{
+			return false;
+		}
+
+		c = skip_blank(reader);
+
+		if (c == '}')
+		{
+			return true;
+		}
+
+		if (c != ',')
+		{
+			return false;
+		}
+
+		c = skip_blank(reader);
+	}
+}
+
+//
+// Rows.
+//
+
+internal b32 is_valid_program_name(char *name)
+{
+	return (name[0] != '.') && !strpbrk(name, "/#\n");
+}
+
+// What parse_program_line would take for something else, or
+// misread.
+internal b32 check_row(Importer *importer)
+{
+	ImportRow *row = &importer->row;
+	char *name = row->all_fields[IMPORT_EXERCISE];
+
+	if (row->error[0] != '\0')
+	{
+		IMPORT_ERROR(importer, row->line, "%s.", row->error);
+		return false;
+	}
+
+	if (!importer->to_library && (row->all_fields[IMPORT_PROGRAM][0] == '\0'))
+	{
+		IMPORT_ERROR(importer, row->line, "no program for exercise '%s'.", name);
+		return false;
+	}
+
+	if (name[0] == '\0')
+	{
+		IMPORT_ERROR(importer, row->line, "no exercise name.");
+		return false;
+	}
+
+	if ((name[0] == '@') || (name[0] == LIBRARY_EXERCISE_PREFIX) || strpbrk(name, "#\n"))
+	{
+		IMPORT_ERROR(importer, row->line, "invalid exercise name '%s' (starting with '@' or '%c', or with a '#').",
+					 name, LIBRARY_EXERCISE_PREFIX);
+		return false;
+	}
+
+	char *id = row->all_fields[IMPORT_ID];
+
+	if (importer->to_library && strpbrk(id, " \t\n=[]#"))
+	{
+		IMPORT_ERROR(importer, row->line, "invalid exercise id '%s' (e.g: plank, without spaces).", id);
+		return false;
+	}
+
+	// Properties are single words on a program's properties line.
+	for (int field = IMPORT_SERIES; field <= IMPORT_PAUSE; ++field)
+	{
+		char *value = row->all_fields[field];
+
+		if (strpbrk(value, " \t\n#"))
+		{
+			IMPORT_ERROR(importer, row->line, "invalid %s '%s' for exercise '%s'.",
+						 all_field_names[field], value, name);
+			return false;
+		}
+	}
+
+	if (row->all_fields[IMPORT_SERIES][0] == '\0')
+	{
+		IMPORT_ERROR(importer, row->line, "no series count for exercise '%s'.", name);
+		return false;
+	}
+
+	if (row->all_fields[IMPORT_PAUSE][0] == '\0')
+	{
+		IMPORT_ERROR(importer, row->line, "missing pause duration for exercise '%s'.", name);
+		return false;
+	}
+
+	// It would be read as the duration.
+	if ((row->all_fields[IMPORT_MILESTONE][0] != '\0') && (row->all_fields[IMPORT_DURATION][0] == '\0'))
+	{
+		IMPORT_ERROR(importer, row->line, "milestone without a duration for exercise '%s'.", name);
+		return false;
+	}
+
+	return true;
+}
+
+// The row is given to the parser as a program file would give it, so
+// it is held to the same rules (and errors are the same), PROPERTIES
+// getting its properties line.
+// Returns false if it is not valid.
+internal b32 parse_row(Importer *importer, char *properties, size_t size)
+{
+	ImportRow *row = &importer->row;
+	ProgramParser *parser = &importer->parser;
+
+	// SERIES [TEMPO] [DURATION] [MILESTONE] PAUSE_DURATION
+	int length = snprintf(properties, size, "%s", row->all_fields[IMPORT_SERIES]);
+
+	for (int field = IMPORT_TEMPO; field <= IMPORT_PAUSE; ++field)
+	{
+		if (row->all_fields[field][0] != '\0')
+		{
+			length += snprintf(properties + length, size - length, " %s", row->all_fields[field]);
+		}
+	}
+
+	int error_count = parser->error_count;
+	int exercise_count = parser->program->exercise_count;
+
+	// Name, properties, and the empty line after them.
+	char line[MAX_IMPORT_FIELD_SIZE * IMPORT_FIELD_COUNT];
+	char *all_lines[] = { row->all_fields[IMPORT_EXERCISE], properties, "" };
+
+	for (u32 i = 0; i < ARRAY_SIZE(all_lines); ++i)
+	{
+		snprintf(line, sizeof(line), "%s", all_lines[i]);
+
+		// Errors are told at the row's line.
+		parser->line_count = row->line - 1;
+
+		char *reference;
+		parse_program_line(parser, line, &reference);
+	}
+
+	importer->error_count += parser->error_count - error_count;
+
+	return ((parser->error_count == error_count) && (parser->program->exercise_count > exercise_count));
+}
+
+internal void part_path(Importer *importer, int part, b32 temporary, char *path, size_t size)
+{
+	char *name = importer->program_name;
+
+	if (temporary)
+	{
+		// NOTE: Hidden, so not taken for a program until it is renamed.
+		snprintf(path, size, "%s/programs/.%s-%d.import", importer->program_dir, name, part);
+	}
+	else if (importer->part_count == 1)
+	{
+		snprintf(path, size, "%s/programs/%s", importer->program_dir, name);
+	}
+	else
+	{
+		snprintf(path, size, "%s/programs/%s-%d", importer->program_dir, name, part);
+	}
+}
+
+// 64-bit FNV-1a.
+internal u64 hash_program_name(char *name)
+{
+	u64 hash = 14695981039346656037ULL;
+
+	for (char *c = name; *c; ++c)
+	{
+		hash = (hash ^ (u8) *c) * 1099511628211ULL;
+	}
+
+	return hash ? hash : 1;
+}
+
+// Returns false if it was imported already (or there are too many
+// programs to tell).
+internal b32 add_program_name(Importer *importer, char *name)
+{
+	u64 hash = hash_program_name(name);
+	u32 mask = 2 * MAX_IMPORT_PROGRAM_COUNT - 1;
+
+	for (u32 i = hash & mask;; i = (i + 1) & mask)
+	{
+		if (importer->all_program_hashes[i] == hash)
+		{
+			IMPORT_ERROR(importer, importer->row.line,
+						 "rows of program '%s' are not next to each other (it was imported already).", name);
+			return false;
+		}
+
+		if (!importer->all_program_hashes[i])
+		{
+			if (importer->program_count == MAX_IMPORT_PROGRAM_COUNT)
+			{
+				IMPORT_ERROR(importer, importer->row.line, "too many programs (max %d).",
+							 MAX_IMPORT_PROGRAM_COUNT);
+				return false;
+			}
+
+			importer->all_program_hashes[i] = hash;
+			++importer->program_count;
+
+			return true;
+		}
+	}
+}
+
+internal void begin_program(Importer *importer, char *name)
+{
+	snprintf(importer->program_name, sizeof(importer->program_name), "%s", name);
+
+	importer->has_program		= true;
+	importer->program_row_count = 0;
+	importer->part				= NULL;
+	importer->part_count		= 1;
+
+	importer->program.exercise_count = 0;
+	init_program_parser(&importer->parser, importer->filename, &importer->program, stderr);
+
+	importer->program_valid = true;
+
+	if (!is_valid_program_name(name))
+	{
+		IMPORT_ERROR(importer, importer->row.line, "invalid program name '%s' (starting with '.', or with a '/' or a '#').",
+					 name);
+
+		importer->program_valid = false;
+	}
+	else if (!add_program_name(importer, name))
+	{
+		importer->program_valid = false;
+	}
+}
+
+// References each part, in order.
+internal b32 write_parts_program(Importer *importer)
+{
+	char path[1024],
+		 temporary_path[1024];
+
+	snprintf(path, sizeof(path), "%s/programs/%s", importer->program_dir, importer->program_name);
+	snprintf(temporary_path, sizeof(temporary_path), "%s/programs/.%s.import",
+			 importer->program_dir, importer->program_name);
+
+	FILE *file = fopen(temporary_path, "w");
+
+	if (!file)
+	{
+		perror(temporary_path);
+		return false;
+	}
+
+	for (int i = 1; i <= importer->part_count; ++i)
+	{
+		fprintf(file, "@%s-%d\n", importer->program_name, i);
+	}
+
+	if ((fclose(file) != 0) || (rename(temporary_path, path) == -1))
+	{
+		perror(path);
+		unlink(temporary_path);
+
+		return false;
+	}
+
+	return true;
+}
+
+// Moves its parts into place if it is valid, drops them otherwise.
+internal void end_program(Importer *importer)
+{
+	if (!importer->has_program)
+	{
+		return;
+	}
+
+	importer->has_program = false;
+
+	if (importer->part && (fclose(importer->part) != 0))
+	{
+		perror(importer->program_name);
+		importer->program_valid = false;
+	}
+
+	importer->part = NULL;
+
+	char temporary_path[1024],
+		 path[1024];
+
+	for (int i = 1; i <= importer->part_count; ++i)
+	{
+		part_path(importer, i, true, temporary_path, sizeof(temporary_path));
+
+		if (!importer->program_valid)
+		{
+			unlink(temporary_path);
+			continue;
+		}
+
+		part_path(importer, i, false, path, sizeof(path));
+
+		if (rename(temporary_path, path) == -1)
+		{
+			perror(path);
+			importer->program_valid = false;
+		}
+	}
+
+	if (importer->program_valid && (importer->part_count > 1))
+	{
+		importer->program_valid = write_parts_program(importer);
+	}
+
+	if (!importer->program_valid)
+	{
+		fprintf(stderr, "%s: %s: program '%s' not imported.\n", PROGRAM, importer->filename,
+				importer->program_name);
+		return;
+	}
+
+	++importer->written_count;
+	importer->imported_row_count += importer->program_row_count;
+}
+
+internal void import_program_row(Importer *importer)
+{
+	ImportRow *row = &importer->row;
+	char *name = row->all_fields[IMPORT_PROGRAM];
+
+	if (!importer->has_program || (strcmp(name, importer->program_name) != 0))
+	{
+		end_program(importer);
+
+		if (name[0] != '\0')
+		{
+			begin_program(importer, name);
+		}
+	}
+
+	if (!check_row(importer))
+	{
+		importer->program_valid = false;
+		return;
+	}
+
+	Program *program = &importer->program;
+
+	// The part is full, this row starts the next one.
+	if (program->exercise_count == ARRAY_SIZE(program->all_exercises))
+	{
+		program->exercise_count = 0;
+		init_program_parser(&importer->parser, importer->filename, program, stderr);
+
+		if (importer->part)
+		{
+			if (fclose(importer->part) != 0)
+			{
+				perror(importer->program_name);
+				importer->program_valid = false;
+			}
+
+			importer->part = NULL;
+		}
+
+		if (++importer->part_count == MAX_IMPORT_PART_COUNT + 1)
+		{
+			IMPORT_ERROR(importer, row->line, "too many exercises for program '%s' (max %zu).",
+						 importer->program_name, MAX_IMPORT_PART_COUNT * ARRAY_SIZE(program->all_exercises));
+		}
+	}
+
+	char properties[MAX_IMPORT_FIELD_SIZE * IMPORT_FIELD_COUNT];
+
+	if (!parse_row(importer, properties, sizeof(properties)) ||
+		(importer->part_count > MAX_IMPORT_PART_COUNT))
+	{
+		importer->program_valid = false;
+	}
+
+	// NOTE: Rows are still checked once the program is not valid (so
+	//       every error is told), just not written.
+	if (!importer->program_valid)
+	{
+		return;
+	}
+
+	if (!importer->part)
+	{
+		char path[1024];
+		part_path(importer, importer->part_count, true, path, sizeof(path));
+
+		if (!(importer->part = fopen(path, "w")))
+		{
+			perror(path);
+			++importer->error_count;
+
+			importer->program_valid = false;
+			return;
+		}
+	}
+
+	fprintf(importer->part, "%s\n%s\n\n", row->all_fields[IMPORT_EXERCISE], properties);
+
+	++importer->program_row_count;
+}
+
+// Its id, if it has none: its name, lowercase, anything but letters
+// and digits turned into dashes (e.g: "Push-ups (10 reps)" gives
+// "push-ups-10-reps").
+internal void make_exercise_id(char *name, char *id, size_t size)
+{
+	size_t length = 0;
+
+	for (char *c = name; *c && (length < size - 1); ++c)
+	{
+		if (((*c >= 'a') && (*c <= 'z')) || ((*c >= '0') && (*c <= '9')))
+		{
+			id[length++] = *c;
+		}
+		else if ((*c >= 'A') && (*c <= 'Z'))
+		{
+			id[length++] = *c - 'A' + 'a';
+		}
+		else if (length && (id[length - 1] != '-'))
+		{
+			id[length++] = '-';
+		}
+	}
+
+	while (length && (id[length - 1] == '-'))
+	{
+		--length;
+	}
+
+	id[length] = '\0';
+}
+
+internal void import_library_row(Importer *importer)
+{
+	ImportRow *row = &importer->row;
+
+	if (!check_row(importer))
+	{
+		return;
+	}
+
+	char id[MAX_IMPORT_FIELD_SIZE];
+
+	if (row->all_fields[IMPORT_ID][0] != '\0')
+	{
+		snprintf(id, sizeof(id), "%s", row->all_fields[IMPORT_ID]);
+	}
+	else
+	{
+		make_exercise_id(row->all_fields[IMPORT_EXERCISE], id, sizeof(id));
+	}
+
+	if (id[0] == '\0')
+	{
+		IMPORT_ERROR(importer, row->line, "no id for exercise '%s'.", row->all_fields[IMPORT_EXERCISE]);
+		return;
+	}
+
+	Program *program = &importer->program;
+
+	program->exercise_count = 0;
+	init_program_parser(&importer->parser, importer->filename, program, stderr);
+
+	char properties[MAX_IMPORT_FIELD_SIZE * IMPORT_FIELD_COUNT];
+
+	if (!parse_row(importer, properties, sizeof(properties)))
+	{
+		return;
+	}
+
+	Exercise exercise = program->all_exercises[0];
+	char *say = row->all_fields[IMPORT_SAY];
+
+	if (say[0] != '\0')
+	{
+		exercise.spoken_name = intern_string(say);
+	}
+
+	u32 interned_id = intern_string(id);
+
+	if (!add_library_exercise(interned_id, &exercise))
+	{
+		if (find_library_exercise(interned_id))
+		{
+			IMPORT_ERROR(importer, row->line, "exercise '%s' is already in the library.", id);
+		}
+		else
+		{
+			IMPORT_ERROR(importer, row->line, "too many exercises in the library (max %d).",
+						 MAX_LIBRARY_EXERCISE_COUNT);
+		}
+
+		return;
+	}
+
+	// NOTE: Written as given (e.g: "1.5m" is not turned into "90"),
+	//       once they are known to be valid.
+	fprintf(importer->library, "\n[%s]\nname=%s\n", id, row->all_fields[IMPORT_EXERCISE]);
+
+	for (int field = IMPORT_SAY; field <= IMPORT_PAUSE; ++field)
+	{
+		if (row->all_fields[field][0] != '\0')
+		{
+			fprintf(importer->library, "%s=%s\n", all_field_names[field], row->all_fields[field]);
+		}
+	}
+
+	++importer->written_count;
+	++importer->imported_row_count;
+}
+
+internal void import_row(Importer *importer)
+{
+	ImportRow *row = &importer->row;
+
+	for (int i = 0; i < IMPORT_FIELD_COUNT; ++i)
+	{
+		trim_field(row->all_fields[i]);
+	}
+
+	++importer->row_count;
+
+	if (importer->to_library)
+	{
+		import_library_row(importer);
+	}
+	else
+	{
+		import_program_row(importer);
+	}
+}
+
+internal void import_csv(Importer *importer, ImportReader *reader)
+{
+	if (!read_csv_header(importer, reader))
+	{
+		return;
+	}
+
+	while (read_csv_row(reader, &importer->row))
+	{
+		import_row(importer);
+	}
+}
+
+// C: the first character of the file.
+internal void import_json(Importer *importer, ImportReader *reader, int c)
+{
+	b32 is_array = (c == '[');
+
+	if (is_array)
+	{
+		c = skip_blank(reader);
+
+		if (c == ']')
+		{
+			c = skip_blank(reader);
+		}
+	}
+
+	while (c != EOF)
+	{
+		clear_row(&importer->row, reader->line);
+
+		if ((c != '{') || !read_json_row(reader, &importer->row))
+		{
+			IMPORT_ERROR(importer, reader->line, "invalid JSON (e.g: [{\"program\": \"legs\", \"exercise\": "
+						 "\"Squats\", \"series\": 4, \"pause\": 90}]), giving up.");
+
+			// Not read whole, so not written.
+			importer->program_valid = false;
+			return;
+		}
+
+		import_row(importer);
+
+		c = skip_blank(reader);
+
+		if (is_array)
+		{
+			if (c == ',')
+			{
+				c = skip_blank(reader);
+			}
+			else if (c == ']')
+			{
+				is_array = false;
+				c = skip_blank(reader);
+			}
+			else
+			{
+				c = 0;
+			}
+		}
+		else if (c == ',')
+		{
+			// One object a line, commas or not.
+			c = skip_blank(reader);
+		}
+	}
+}
+
+int import_workouts(char *filename, char *program_dir, b32 to_library)
+{
+	b32 from_stdin = (strcmp(filename, "-") == 0);
+	FILE *file = from_stdin ? stdin : fopen(filename, "r");
+
+	if (!file)
+	{
+		fprintf(stderr, "%s: %s: %s.\n", PROGRAM, filename, strerror(errno));
+		return 1;
+	}
+
+	setvbuf(file, NULL, _IOFBF, IMPORT_READ_BUFFER_SIZE);
+
+	Importer *importer = (Importer *) calloc(1, sizeof(Importer));
+
+	importer->filename	 = from_stdin ? (char *) "stdin" : basename(filename);
+	importer->to_library = to_library;
+
+	snprintf(importer->program_dir, sizeof(importer->program_dir), "%s", program_dir);
+
+	mkdir(program_dir, 0755);
+
+	char path[1024];
+
+	if (to_library)
+	{
+		snprintf(path, sizeof(path), "%s/exercises", program_dir);
+
+		if (!(importer->library = fopen(path, "a")))
+		{
+			perror(path);
+
+			if (!from_stdin)
+			{
+				fclose(file);
+			}
+
+			free(importer);
+			return 1;
+		}
+	}
+	else
+	{
+		snprintf(path, sizeof(path), "%s/programs", program_dir);
+		mkdir(path, 0755);
+
+		importer->all_program_hashes = (u64 *) calloc(2 * MAX_IMPORT_PROGRAM_COUNT, sizeof(u64));
+	}
+
+	u64 start = get_monotonic_ns();
+
+	ImportReader reader = {};
+	reader.file = file;
+	reader.line = 1;
+
+	int c = getc_unlocked(file);
+
+	// A UTF-8 BOM, as spreadsheets like to write.
+	if (c == 0xEF)
+	{
+		getc_unlocked(file);
+		getc_unlocked(file);
+
+		c = getc_unlocked(file);
+	}
+
+	if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))
+	{
+		ungetc(c, file);
+		c = skip_blank(&reader);
+	}
+
+	if ((c == '[') || (c == '{'))
+	{
+		import_json(importer, &reader, c);
+	}
+	else if (c != EOF)
+	{
+		ungetc(c, file);
+		import_csv(importer, &reader);
+	}
+
+	end_program(importer);
+
+	if (importer->library && (fclose(importer->library) != 0))
+	{
+		perror(path);
+		++importer->error_count;
+	}
+
+	double seconds = (get_monotonic_ns() - start) / 1e9;
+	int error_count = importer->error_count;
+
+	printf("%u/%u rows imported (%u %s) in %.3fs (%.0f rows/s), %d error%s.\n",
+		   importer->imported_row_count, importer->row_count, importer->written_count,
+		   to_library ? "exercises" : "programs", seconds,
+		   (seconds > 0) ? importer->row_count / seconds : 0.0, error_count, (error_count == 1) ? "" : "s");
+
+	if (!from_stdin)
+	{
+		fclose(file);
+	}
+
+	free(importer->all_program_hashes);
+	free(importer);
+
+	return error_count;
+}
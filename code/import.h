@@ -0,0 +1,36 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "common.h"
+
+// Longer fields are an error (their row is not imported).
+#define MAX_IMPORT_FIELD_SIZE 256
+
+// CSV columns past those are ignored.
+#define MAX_IMPORT_COLUMN_COUNT 64
+
+// Programs in a single import, at most.
+#define MAX_IMPORT_PROGRAM_COUNT 65536
+
+// A program with more exercises than a Program holds is split into
+// parts ("NAME-1", "NAME-2"...), NAME referencing each of them in
+// order: at most this many, so a session can load them all (see
+// MAX_PROGRAM_COUNT).
+#define MAX_IMPORT_PART_COUNT (MAX_PROGRAM_COUNT - 1)
+
+#define IMPORT_READ_BUFFER_SIZE 65536
+
+// --import: workouts exported from a spreadsheet, one exercise a row,
+// from FILENAME ('-': stdin), either CSV (with a header naming the
+// columns) or JSON (an array of objects, or one object after the
+// other), told apart by their first character.
+// Rows are read and checked one at a time, against the same rules as a
+// program file (see parse_program_line), so memory does not grow with
+// the file: consecutive rows of the same program are written to
+// PROGRAM_DIR/programs/PROGRAM once all of them are valid, or, with
+// TO_LIBRARY, each valid row is added to PROGRAM_DIR/exercises (see
+// parse_exercise_library, which must have read it already).
+// Returns the number of errors.
+int import_workouts(char *filename, char *program_dir, b32 to_library);
+
+#endif
@@ -0,0 +1,206 @@
+#include <pthread.h>
+
+#include "intern.h"
+
+// Strings are packed in chunks that are never moved nor freed, an id
+// being where the string starts, as if the chunks were one after the
+// other.
+#define STRING_CHUNK_SIZE		(64 * 1024)
+#define MAX_STRING_CHUNK_COUNT	4096
+
+// Longer ones are truncated (a line of a program file is nowhere near).
+#define MAX_STRING_LEN (STRING_CHUNK_SIZE - 1)
+
+struct StringPool
+{
+	char *all_chunks[MAX_STRING_CHUNK_COUNT];
+	u32 chunk_count;
+
+	// Where the next string goes.
+	u32 next_id;
+
+	// Open addressing, 0 being a free slot (the empty string is never
+	// stored). The hashes are kept so most misses do not touch the
+	// strings.
+	u32 *all_slot_ids;
+	u32 *all_slot_hashes;
+	u32 slot_count;
+	u32 string_count;
+};
+
+internal StringPool global_pool;
+internal pthread_mutex_t global_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+internal u32 hash_string(const char *string, size_t len)
+{
+	// FNV-1a
+	u32 hash = 2166136261u;
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		hash = (hash ^ (u8) string[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+const char *get_string(u32 id)
+{
+	if (id == EMPTY_STRING_ID)
+	{
+		return "";
+	}
+
+	return global_pool.all_chunks[id / STRING_CHUNK_SIZE] + (id % STRING_CHUNK_SIZE);
+}
+
+internal u32 *find_slot(StringPool *pool, const char *string, size_t len, u32 hash)
+{
+	u32 mask = pool->slot_count - 1;
+
+	for (u32 i = hash & mask;; i = (i + 1) & mask)
+	{
+		u32 id = pool->all_slot_ids[i];
+
+		if (!id)
+		{
+			return pool->all_slot_ids + i;
+		}
+
+		if (pool->all_slot_hashes[i] == hash)
+		{
+			const char *other = get_string(id);
+
+			if ((strncmp(other, string, len) == 0) && (other[len] == '\0'))
+			{
+				return pool->all_slot_ids + i;
+			}
+		}
+	}
+}
+
+internal void grow_slots(StringPool *pool)
+{
+	u32 *old_ids	= pool->all_slot_ids;
+	u32 *old_hashes = pool->all_slot_hashes;
+	u32 old_count	= pool->slot_count;
+
+	pool->slot_count = (old_count) ? old_count * 2 : 1024;
+	pool->all_slot_ids	  = (u32 *) calloc(pool->slot_count, sizeof(u32));
+	pool->all_slot_hashes = (u32 *) calloc(pool->slot_count, sizeof(u32));
+
+	u32 mask = pool->slot_count - 1;
+
+	for (u32 i = 0; i < old_count; ++i)
+	{
+		if (old_ids[i])
+		{
+			u32 slot = old_hashes[i] & mask;
+
+			while (pool->all_slot_ids[slot])
+			{
+				slot = (slot + 1) & mask;
+			}
+
+			pool->all_slot_ids[slot]	= old_ids[i];
+			pool->all_slot_hashes[slot] = old_hashes[i];
+		}
+	}
+
+	free(old_ids);
+	free(old_hashes);
+}
+
+// Returns EMPTY_STRING_ID if the pool is full.
+internal u32 store_string(StringPool *pool, const char *string, size_t len)
+{
+	u32 offset = pool->next_id % STRING_CHUNK_SIZE;
+
+	// Strings never straddle two chunks.
+	if (!pool->chunk_count || (offset + len + 1 > STRING_CHUNK_SIZE))
+	{
+		if (pool->chunk_count == MAX_STRING_CHUNK_COUNT)
+		{
+			return EMPTY_STRING_ID;
+		}
+
+		pool->all_chunks[pool->chunk_count] = (char *) malloc(STRING_CHUNK_SIZE);
+
+		// The very first byte is never used, so no string gets the
+		// empty string's id.
+		offset = (pool->chunk_count) ? 0 : 1;
+		pool->next_id = pool->chunk_count++ * STRING_CHUNK_SIZE + offset;
+	}
+
+	u32 id = pool->next_id;
+	char *stored = pool->all_chunks[id / STRING_CHUNK_SIZE] + offset;
+
+	memcpy(stored, string, len);
+	stored[len] = '\0';
+
+	pool->next_id += len + 1;
+
+	return id;
+}
+
+u32 intern_string(const char *string, size_t len)
+{
+	if (!len)
+	{
+		return EMPTY_STRING_ID;
+	}
+
+	len = MIN(len, MAX_STRING_LEN);
+
+	StringPool *pool = &global_pool;
+	u32 hash = hash_string(string, len);
+
+	pthread_mutex_lock(&global_pool_lock);
+
+	// At most half full.
+	if (2 * (pool->string_count + 1) > pool->slot_count)
+	{
+		grow_slots(pool);
+	}
+
+	u32 *slot = find_slot(pool, string, len, hash);
+
+	if (!*slot && (*slot = store_string(pool, string, len)))
+	{
+		pool->all_slot_hashes[slot - pool->all_slot_ids] = hash;
+		++pool->string_count;
+	}
+
+	u32 id = *slot;
+
+	pthread_mutex_unlock(&global_pool_lock);
+
+	return id;
+}
+
+u32 find_string(const char *string)
+{
+	size_t len = MIN(strlen(string), MAX_STRING_LEN);
+
+	StringPool *pool = &global_pool;
+	u32 id = EMPTY_STRING_ID;
+
+	if (!len)
+	{
+		return id;
+	}
+
+	u32 hash = hash_string(string, len);
+
+	pthread_mutex_lock(&global_pool_lock);
+
+	// Nothing interned yet, no slots either.
+	if (pool->slot_count)
+	{
+		id = *find_slot(pool, string, len, hash);
+	}
+
+	pthread_mutex_unlock(&global_pool_lock);
+
+	return id;
+}
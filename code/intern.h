@@ -0,0 +1,28 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "common.h"
+
+// Id of the empty string (what a zeroed Exercise is named).
+#define EMPTY_STRING_ID 0
+
+// Every string is kept once, for as long as the process runs, and known
+// by its id: equal strings get equal ids, so ids can be compared and
+// used as keys instead of the strings.
+// Interning takes a lock, getting a string back does not (strings never
+// move), so both can be done from any thread.
+u32 intern_string(const char *string, size_t len);
+
+inline u32 intern_string(const char *string)
+{
+	return intern_string(string, strlen(string));
+}
+
+// Same as intern_string, except an unknown string is not added (e.g:
+// to look up a name that may come from anywhere): EMPTY_STRING_ID is
+// returned instead.
+u32 find_string(const char *string);
+
+const char *get_string(u32 id);
+
+#endif
@@ -0,0 +1,185 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "keyboard.h"
+#include "timer.h"
+
+// What the signal handlers restore (only one keyboard is open at a
+// time).
+internal Keyboard *global_keyboard = NULL;
+
+// Those that would leave the terminal as it is if they were not
+// handled.
+internal int all_restoring_signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGTSTP };
+internal b32 all_handled_signals[ARRAY_SIZE(all_restoring_signals)];
+
+// A background job changing its terminal's mode is stopped (SIGTTOU).
+internal b32 in_foreground(Keyboard *keyboard)
+{
+	return (tcgetpgrp(keyboard->fd) == getpgrp());
+}
+
+internal void set_raw_mode(Keyboard *keyboard)
+{
+	// NOTE: Resumed in the background (bg): set again once brought
+	//       back (fg sends SIGCONT).
+	if (keyboard->is_terminal && in_foreground(keyboard))
+	{
+		struct termios raw = keyboard->saved_termios;
+
+		// Signals (e.g: ^C) are still sent.
+		raw.c_lflag &= ~(ICANON | ECHO);
+		raw.c_cc[VMIN]	= 0;
+		raw.c_cc[VTIME] = 0;
+
+		tcsetattr(keyboard->fd, TCSANOW, &raw);
+	}
+
+	fcntl(keyboard->fd, F_SETFL, keyboard->saved_flags | O_NONBLOCK);
+}
+
+internal void restore_mode(Keyboard *keyboard)
+{
+	if (keyboard->is_terminal)
+	{
+		// Even from the background (e.g: killed after bg): with
+		// SIGTTOU blocked, the terminal can be set without stopping.
+		sigset_t ttou, saved_mask;
+		sigemptyset(&ttou);
+		sigaddset(&ttou, SIGTTOU);
+
+		pthread_sigmask(SIG_BLOCK, &ttou, &saved_mask);
+		tcsetattr(keyboard->fd, TCSANOW, &keyboard->saved_termios);
+		pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+	}
+
+	fcntl(keyboard->fd, F_SETFL, keyboard->saved_flags);
+}
+
+internal void set_handler(int signal_number, void (*handler)(int))
+{
+	struct sigaction action = {};
+	action.sa_handler = handler;
+
+	sigaction(signal_number, &action, NULL);
+}
+
+internal void handle_signal(int signal_number)
+{
+	int saved_errno = errno;
+	Keyboard *keyboard = global_keyboard;
+
+	if (keyboard)
+	{
+		if (signal_number == SIGCONT)
+		{
+			set_raw_mode(keyboard);
+			set_handler(SIGTSTP, handle_signal);
+		}
+		else
+		{
+			restore_mode(keyboard);
+
+			// Blocked until this returns, then does what it would
+			// have done without us (SIGTSTP's handler is put back on
+			// SIGCONT).
+			set_handler(signal_number, SIG_DFL);
+			raise(signal_number);
+		}
+	}
+
+	errno = saved_errno;
+}
+
+b32 keyboard_open(Keyboard *keyboard, int fd)
+{
+	keyboard->fd = fd;
+	keyboard->closed = false;
+
+	if ((keyboard->saved_flags = fcntl(fd, F_GETFL)) == -1)
+	{
+		return false;
+	}
+
+	keyboard->is_terminal = (tcgetattr(fd, &keyboard->saved_termios) == 0);
+
+	// Not ours (started with '&'): reading it would stop us (SIGTTIN),
+	// so there is no keyboard.
+	if (keyboard->is_terminal && !in_foreground(keyboard))
+	{
+		return false;
+	}
+
+	if (keyboard->is_terminal)
+	{
+		// Typed before the session started.
+		tcflush(fd, TCIFLUSH);
+	}
+
+	global_keyboard = keyboard;
+
+	for (size_t i = 0; i < ARRAY_SIZE(all_restoring_signals); ++i)
+	{
+		struct sigaction previous;
+		sigaction(all_restoring_signals[i], NULL, &previous);
+
+		all_handled_signals[i] = (previous.sa_handler == SIG_DFL);
+
+		if (all_handled_signals[i])
+		{
+			set_handler(all_restoring_signals[i], handle_signal);
+		}
+	}
+
+	set_handler(SIGCONT, handle_signal);
+	set_raw_mode(keyboard);
+
+	return true;
+}
+
+void keyboard_close(Keyboard *keyboard)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(all_restoring_signals); ++i)
+	{
+		if (all_handled_signals[i])
+		{
+			set_handler(all_restoring_signals[i], SIG_DFL);
+			all_handled_signals[i] = false;
+		}
+	}
+
+	set_handler(SIGCONT, SIG_DFL);
+
+	restore_mode(keyboard);
+	global_keyboard = NULL;
+}
+
+int keyboard_read(Keyboard *keyboard, KeyPress *all_presses, int max_press_count)
+{
+	char buffer[32];
+	ssize_t num_read = read(keyboard->fd, buffer, MIN((size_t) max_press_count, sizeof(buffer)));
+
+	u64 now = get_monotonic_ns();
+
+	// A terminal without anything to read says 0 too.
+	if ((num_read == 0) && !keyboard->is_terminal)
+	{
+		keyboard->closed = true;
+	}
+
+	if (num_read <= 0)
+	{
+		return 0;
+	}
+
+	for (ssize_t i = 0; i < num_read; ++i)
+	{
+		all_presses[i].key	= buffer[i];
+		all_presses[i].time = now;
+	}
+
+	return num_read;
+}
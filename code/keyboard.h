@@ -0,0 +1,42 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <termios.h>
+
+#include "common.h"
+
+struct KeyPress
+{
+	char key;
+
+	// CLOCK_MONOTONIC, when it was read.
+	u64 time;
+};
+
+// Keys are read as soon as they are pressed: the terminal (if the fd
+// is one) is put in non-canonical mode, without echo, and the fd does
+// not block.
+struct Keyboard
+{
+	int fd;
+
+	b32 is_terminal;
+	struct termios saved_termios;
+	int saved_flags;
+
+	// Nothing more to read (e.g: the end of a pipe).
+	b32 closed;
+};
+
+// Until keyboard_close, or a signal kills or stops the process (the
+// terminal is restored first, and set again on SIGCONT). Signals
+// already handled by the caller are left alone.
+// Returns false if FD cannot be read from (or is a terminal we are
+// in the background of).
+b32 keyboard_open(Keyboard *keyboard, int fd);
+void keyboard_close(Keyboard *keyboard);
+
+// Returns how many keys were read (0 if none was pressed).
+int keyboard_read(Keyboard *keyboard, KeyPress *all_presses, int max_press_count);
+
+#endif
@@ -0,0 +1,82 @@
+#include "library.h"
+
+// Twice as many slots as exercises, so probes stay short.
+#define LIBRARY_SLOT_COUNT (2 * MAX_LIBRARY_EXERCISE_COUNT)
+
+struct ExerciseLibrary
+{
+	Exercise all_exercises[MAX_LIBRARY_EXERCISE_COUNT];
+	u32 all_ids[MAX_LIBRARY_EXERCISE_COUNT];
+	u32 exercise_count;
+
+	// Open addressing on the interned ids, 0 being a free slot (an
+	// exercise's index is stored plus one).
+	u32 all_slots[LIBRARY_SLOT_COUNT];
+};
+
+static_assert((LIBRARY_SLOT_COUNT & (LIBRARY_SLOT_COUNT - 1)) == 0,
+			  "LIBRARY_SLOT_COUNT must be a power of 2");
+
+internal ExerciseLibrary global_library;
+
+// Ids are offsets in the string pool, so close to each other: they are
+// mixed before being used as hashes.
+internal u32 hash_id(u32 id)
+{
+	id ^= id >> 16;
+	id *= 0x7feb352du;
+	id ^= id >> 15;
+	id *= 0x846ca68bu;
+	id ^= id >> 16;
+
+	return id;
+}
+
+internal u32 *find_slot(ExerciseLibrary *library, u32 id)
+{
+	u32 mask = LIBRARY_SLOT_COUNT - 1;
+
+	for (u32 i = hash_id(id) & mask;; i = (i + 1) & mask)
+	{
+		u32 slot = library->all_slots[i];
+
+		if (!slot || (library->all_ids[slot - 1] == id))
+		{
+			return library->all_slots + i;
+		}
+	}
+}
+
+b32 add_library_exercise(u32 id, Exercise *exercise)
+{
+	ExerciseLibrary *library = &global_library;
+
+	if (library->exercise_count == MAX_LIBRARY_EXERCISE_COUNT)
+	{
+		return false;
+	}
+
+	u32 *slot = find_slot(library, id);
+
+	if (*slot)
+	{
+		return false;
+	}
+
+	u32 index = library->exercise_count++;
+
+	library->all_exercises[index] = *exercise;
+	library->all_ids[index]		  = id;
+
+	*slot = index + 1;
+
+	return true;
+}
+
+Exercise *find_library_exercise(u32 id)
+{
+	ExerciseLibrary *library = &global_library;
+	u32 slot = *find_slot(library, id);
+
+	return slot ? library->all_exercises + slot - 1 : NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "common.h"
+
+#define MAX_LIBRARY_EXERCISE_COUNT 4096
+
+// Exercises known by an id (e.g: "plank"), loaded once from the
+// exercise library file (see parse_exercise_library) and shared by
+// every program, which refers to them as "$ID" (see
+// parse_program_line).
+// NOTE: Filled before any session starts, and only read from then on,
+//       so it can be read from any thread without a lock.
+
+// Returns false if ID is already in the library, or the library is
+// full.
+b32 add_library_exercise(u32 id, Exercise *exercise);
+
+// ID is interned (see intern.h). Returns NULL if there is no such
+// exercise.
+Exercise *find_library_exercise(u32 id);
+
+#endif
@@ -1,11 +1,23 @@
 #include <unistd.h>
-#include <wait.h>
 #include <fcntl.h>
 #include <pwd.h>
+#include <signal.h>
 #include <getopt.h>
 
+#include "builtin.h"
+#include "check.h"
 #include "common.h"
+#include "daemon.h"
+#include "dashboard.h"
+#include "events.h"
+#include "generate.h"
+#include "import.h"
+#include "intern.h"
+#include "offline.h"
 #include "parsing.h"
+#include "session.h"
+#include "status.h"
+#include "supervisor.h"
 
 // TODO: Implement configuration files:
 //
@@ -17,7 +29,6 @@
 //      Add command-line options:
 //
 //        - Start a series of exercises, programs
-//        - Randomize? (program-wise, not exercise-wise)
 //
 //     Improve error messages!
 
@@ -36,8 +47,37 @@ static char usage[] =
 	"      --version      Show this program's version.\n"
 	"\n"
 	"      --check-config Read config file and exit.\n"
+	"      --check-programs [DIR]\n"
+	"                     Check every program file (and the references\n"
+	"                     between them) and exit.\n"
+	"      --builtins     List built-in programs and exit.\n"
+	"      --import FILE [--library]\n"
+	"                     Turn the workouts of a CSV or JSON export ('-': stdin),\n"
+	"                     one exercise a row, into program files (or exercises\n"
+	"                     of the library) and exit.\n"
 	"\n"
-	"  -p, --program NAME Which program to start.\n"
+	"  -p, --program NAME Which program to start (by the daemon, if one is running).\n"
+	"                     '-' reads it from stdin, each exercise starting as soon\n"
+	"                     as it has been read (e.g: from a generator).\n"
+	"      --resume       Resume the session that was suspended (q).\n"
+	"      --generate --minutes N [--tags LIST]\n"
+	"                     Start a session of random programs (having every\n"
+	"                     tag of LIST, comma-separated) lasting up to N minutes.\n"
+	"      --render-audio OUT.wav [PROGRAM] [--beeps]\n"
+	"                     Write what the session would sound like (its cues,\n"
+	"                     the metronome with --beeps) to OUT.wav ('-': stdout)\n"
+	"                     and exit, without waiting for any of it.\n"
+	"\n"
+	"      --daemon       Stay in the background, waiting for requests.\n"
+	"      --control REQ  Send a request (pause, resume, skip, suspend, status) to the\n"
+	"                     daemon.\n"
+	"      --status       Print what the running session is doing (on one line,\n"
+	"                     e.g: for a status bar) and exit.\n"
+	"      --dashboard [HOST:]PORT\n"
+	"                     Serve a live status page over HTTP (on 127.0.0.1,\n"
+	"                     unless HOST is given).\n"
+	"      --events json  Write what the session does on stdout, one JSON object\n"
+	"                     per line (anything else going to stderr).\n"
 	"\n"
 	"  -V, --voice-off    Do not use text-to-speech.\n"
 	"  -M, --music-off    Do not play music.\n"
@@ -55,223 +95,14 @@ static char version[] =
 	"as published by Sam Hocevar. See http://www.wtfpl.net/ for more details.\n"
 };
 
-enum ChildExecFlag
-{
-	CHILD_EXEC_VERBOSE   = 1 << 0,
-	CHILD_EXEC_NO_STDOUT = 1 << 1,
-	CHILD_EXEC_NO_STDERR = 1 << 2,
-};
-
-internal void child_exec(Command *command, int flags = CHILD_EXEC_VERBOSE)
-{
-	if (!command->argc)
-	{
-		return;
-	}
-	
-	pid_t child_pid;
-
-	switch(child_pid = fork())
-	{
-		case -1:
-		{
-			perror(command->argv[0]);
-			return;
-		}
-
-		case 0:
-		{
-			if (!(flags & CHILD_EXEC_VERBOSE))
-			{
-				int fd;
-
-				if ((fd = open("/dev/null", O_WRONLY)) == -1)
-				{
-					perror("/dev/null");
-					return;
-				}
-
-				(flags & CHILD_EXEC_NO_STDOUT) ? dup2(fd, STDOUT_FILENO) : 0;
-				(flags & CHILD_EXEC_NO_STDERR) ? dup2(fd, STDERR_FILENO) : 0;
-
-				close(fd);
-			}
-
-			execvp(command->argv[0], command->argv);
-
-			char buffer[255];
-			int num_written = snprintf(buffer, sizeof(buffer) - 1, "%s: command '%s'", PROGRAM, command->argv[0]);
-			buffer[num_written] = '\0';
-			
-			perror(buffer);
-			
-			exit(1);
-		}
-
-		default:
-		{
-			waitpid(child_pid, NULL, 0);
-		}
-	}
-}
-
-internal void set_music(Config *config, b32 on)
-{
-	Command *music_command = (on) ? &config->music_on : &config->music_off;
-
-	child_exec(music_command, CHILD_EXEC_NO_STDOUT);
-}
-
-// TODO: Use tts' config Command instead of festival.
-//       Check if tts is stdin or not (if not, add text to command's
-//       arguments).
-//       (Config file parsing is already done)
-internal int tts_say(Config *config, char *text, int wait_finish = true)
-{
-	if (!config->voice_on)
-	{
-		printf("%s\n", text);
-
-		return 0;
-	}
-
-	int pipe_fd[2];
-
-	if (pipe(pipe_fd) == -1)
-	{
-		perror("pipe");
-		return -1;
-	}
-
-	set_music(config, 0);
-
-	pid_t child_pid;
-
-	switch (child_pid = fork())
-	{
-		case -1:
-		{
-			perror("fork");
-			return -2;
-		}
-
-		case 0:
-		{
-			close(pipe_fd[1]);
-
-			dup2(pipe_fd[0], STDIN_FILENO);
-			close(pipe_fd[0]);
-
-			// If the main thread does not wait for the speech to
-			// finish, playing the music is this child's job now.
-			// So the speech must be done by another child.
-			if (wait_finish)
-			{
-				// FIXME: Use config->tts
-				execlp("festival", "festival", "--tts", NULL);
-
-				perror("festival");
-			}
-			else
-			{
-				child_exec(&config->tts, CHILD_EXEC_VERBOSE);
-				set_music(config, 1);
-			}
-
-			exit(1);
-		}
-
-		default:
-		{
-			close(pipe_fd[0]);
-
-			char buffer[255];
-			int num_written = snprintf(buffer, sizeof(buffer) - 1, "%s\n", text);
-			buffer[num_written] = '\0';
-
-			write(pipe_fd[1], buffer, num_written + 1);
-			close(pipe_fd[1]);
-
-			printf("%s", buffer);
-
-			// If we do not wait until the speech is done, the music
-			// is set by another child (which knows when the speech
-			// has finished).
-			if (wait_finish)
-			{
-				waitpid(child_pid, NULL, 0);
-
-				set_music(config, 1);
-			}
-		}
-	}
-
-	return 0;
-}
-
-internal void wait_and_print_chrono(int seconds)
-{
-	int time_in_cs = seconds * 100;
-
-	for (int i = time_in_cs; i > 0; --i)
-	{
-		printf("%.02fs\r", 0.01f * i);
-		fflush(stdout);
-		usleep(10000);
-	}
-
-	printf("\r\033[K");
-}
-
-internal void wait_and_print_chrono(Config* config, int seconds, int milestone_delta)
-{
-	if (!milestone_delta)
-	{
-		wait_and_print_chrono(seconds);
-		return;
-	}
-	
-	int time_in_cs = seconds * 100;
-	int milestone = milestone_delta;
-	
-	for (int i = time_in_cs; i > 0; --i)
-	{
-		printf("%.02fs\r", 0.01f * i);
-		fflush(stdout);
-		usleep(10000);
-
-		if (i == (time_in_cs -  milestone * 100))
-		{
-			char buffer[255];
-			
-			int num_written = snprintf(buffer, sizeof(buffer) - 1, "%d seconds", milestone);
-			buffer[num_written] = '\0';
-
-			tts_say(config, buffer, false);
-
-			milestone += milestone_delta;
-		}
-	}
-
-	printf("\r\033[K");
-}
-
-internal void wait_for_input()
-{
-	int c;
-	while (((c = getchar()) != '\n') && (c != EOF));
-}
-
 internal void add_exercise(Program *program, char *name, u8 series_count, i32 duration, i32 pause_duration)
 {
 	ASSERT(program->exercise_count < ARRAY_SIZE(program->all_exercises));
 
 	Exercise *exercise = program->all_exercises + program->exercise_count++;
 
-	size_t actual_len = MIN(ARRAY_SIZE(exercise->name) - 1, strlen(name));
-	strncpy(exercise->name, name, actual_len);
-	exercise->name[actual_len] = '\0';
-	
+	exercise->name = intern_string(name);
+
 	exercise->series_count = series_count;
 	exercise->duration = duration;
 	exercise->pause_duration = pause_duration;
@@ -283,7 +114,30 @@ int main(int argc, char* argv[])
 		show_version	= false,
 		check_config    = false,
 		voice_off       = false,
-		music_off       = false;
+		music_off       = false,
+		run_as_daemon   = false,
+		show_builtins   = false,
+		check_program_files = false,
+		show_status     = false,
+		resume          = false,
+		beeps           = false,
+		import_to_library = false,
+		generate		= false;
+
+	char *check_programs_dir = NULL;
+
+	char *control_request = NULL;
+
+	char *dashboard_address = NULL;
+
+	b32 write_events = false;
+
+	char *render_audio = NULL;
+
+	char *import_file = NULL;
+
+	long generate_minutes = 0;
+	char *generate_tags = NULL;
 
 	// TODO: Allow multiple programs.
 	char program_name[256];
@@ -294,7 +148,22 @@ int main(int argc, char* argv[])
 			{"help"			, no_argument,       &show_help, 1},
 			{"version"		, no_argument,       &show_version, 1},
 			{"check-config"	, no_argument,       &check_config, 1},
+			{"check-programs", optional_argument, 0, 'P'},
+			{"builtins"		, no_argument,       &show_builtins, 1},
+			{"daemon"		, no_argument,       &run_as_daemon, 1},
+			{"control"		, required_argument, 0, 'c'},
+			{"status"		, no_argument,       &show_status, 1},
+			{"dashboard"	, required_argument, 0, 'D'},
+			{"events"		, required_argument, 0, 'E'},
 			{"program"		, required_argument, 0, 'p'},
+			{"resume"		, no_argument,       &resume, 1},
+			{"generate"		, no_argument,       &generate, 1},
+			{"minutes"		, required_argument, 0, 'm'},
+			{"tags"			, required_argument, 0, 't'},
+			{"render-audio"	, required_argument, 0, 'R'},
+			{"beeps"		, no_argument,       &beeps, 1},
+			{"import"		, required_argument, 0, 'I'},
+			{"library"		, no_argument,       &import_to_library, 1},
 			{"music-off"	, no_argument,       0, 'M'},
 			{"voice-off"	, no_argument,       0, 'V'},
 			{0				, 0,                 0, 0}
@@ -307,7 +176,7 @@ int main(int argc, char* argv[])
 		int option_index = 0;
 
 		// Totaly not on purpose.
-		c = getopt_long(argc, argv, "MVp:", longOptions, &option_index);
+		c = getopt_long(argc, argv, "MVp:c:", longOptions, &option_index);
 
 		if (c == -1)
 		{
@@ -340,6 +209,60 @@ int main(int argc, char* argv[])
 				break;
 			}
 
+			case 'P':
+			{
+				check_program_files = true;
+
+				// The directory is optional, but still allowed in
+				// the next argument.
+				if (optarg)
+				{
+					check_programs_dir = optarg;
+				}
+				else if ((optind < argc) && (argv[optind][0] != '-'))
+				{
+					check_programs_dir = argv[optind++];
+				}
+
+				break;
+			}
+
+			case 'm':
+			{
+				char *end;
+				generate_minutes = strtol(optarg, &end, 10);
+
+				if ((end == optarg) || (*end != '\0') ||
+					(generate_minutes <= 0) || (generate_minutes > 24 * 60))
+				{
+					fprintf(stderr, "%s: --minutes: must be a number of minutes (at most a day).\n",
+							PROGRAM);
+
+					return -1;
+				}
+
+				break;
+			}
+
+			case 'E':
+			{
+				if (strcmp(optarg, "json") != 0)
+				{
+					fprintf(stderr, "%s: --events: unknown format '%s' (only json is).\n",
+							PROGRAM, optarg);
+
+					return -1;
+				}
+
+				write_events = true;
+				break;
+			}
+
+			case 't': { generate_tags = optarg; } break;
+			case 'c': { control_request = optarg; } break;
+			case 'D': { dashboard_address = optarg; } break;
+			case 'R': { render_audio = optarg; } break;
+			case 'I': { import_file = optarg; } break;
 			case 'V': { voice_off = true; } break;
 			case 'M': { music_off = true; } break;
 			
@@ -358,6 +281,85 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
+	if (show_builtins)
+	{
+		list_builtin_programs(stdout);
+
+		return 0;
+	}
+
+	if (show_status)
+	{
+		return print_status();
+	}
+
+	if (generate && !generate_minutes)
+	{
+		fprintf(stderr, "%s: --generate: how long? (--minutes N)\n", PROGRAM);
+
+		return -1;
+	}
+
+	if (render_audio && (program_name[0] == '\0') && (optind < argc))
+	{
+		snprintf(program_name, sizeof(program_name), "%s", argv[optind++]);
+	}
+
+	// NOTE: The daemon cannot read our stdin.
+	b32 from_stdin = (strcmp(program_name, "-") == 0);
+
+	if (render_audio && (from_stdin || resume))
+	{
+		fprintf(stderr, "%s: --render-audio: needs the whole session (not %s).\n",
+				PROGRAM, resume ? "--resume" : "stdin");
+
+		return -1;
+	}
+
+	if (import_to_library && !import_file)
+	{
+		fprintf(stderr, "%s: --library: what to import? (--import FILE)\n", PROGRAM);
+
+		return -1;
+	}
+
+	// A session is rendered (or its events written) right here,
+	// whether a daemon runs or not.
+	if (control_request ||
+		((program_name[0] != '\0') && !run_as_daemon && !generate && !from_stdin && !render_audio &&
+		 !write_events && !import_file))
+	{
+		char request[300],
+			 reply[512];
+
+		if (control_request)
+		{
+			snprintf(request, sizeof(request), "%s", control_request);
+		}
+		else
+		{
+			snprintf(request, sizeof(request), "start %s", program_name);
+		}
+
+		int result = daemon_request(request, reply, sizeof(reply));
+
+		if (result >= 0)
+		{
+			printf("%s", reply);
+
+			return result;
+		}
+
+		if (control_request)
+		{
+			fprintf(stderr, "%s: --control: no daemon is running.\n", PROGRAM);
+
+			return 1;
+		}
+
+		// No daemon, the session is run right here.
+	}
+
 	Config config = {};
 
 	char config_file[256],
@@ -416,102 +418,244 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
-	
-	parse_config_file(config_file, &config);
+	// Before any program is parsed.
+	int library_errors = 0;
 
-	if (voice_off)
+	if (home_dir)
 	{
-		config.voice_on = false;
+		char library_file[512];
+		snprintf(library_file, sizeof(library_file), "%s/exercises", program_dir);
+
+		// NOTE: No library file is not an error.
+		if ((library_errors = parse_exercise_library(library_file)) < 0)
+		{
+			library_errors = 0;
+		}
 	}
 
-	if (music_off)
+	if (check_program_files)
 	{
-		config.music_init.argc = 0;
-		config.music_on.argc   = 0;
-		config.music_off.argc  = 0;
+		char default_dir[512];
+
+		if (!check_programs_dir)
+		{
+			if (!home_dir)
+			{
+				fprintf(stderr, "No config directory found.\n"
+						"Please, define either XDG_CONFIG_HOME or HOME.\n");
+
+				return 1;
+			}
+
+			snprintf(default_dir, sizeof(default_dir), "%s/programs", program_dir);
+			check_programs_dir = default_dir;
+		}
+
+		return ((check_programs(check_programs_dir) != 0) || (library_errors != 0));
 	}
 
-	if (!config.setup_time)
+	if (import_file)
 	{
-		config.setup_time = DEFAULT_SETUP_TIME;
+		if (!home_dir)
+		{
+			fprintf(stderr, "No config directory found.\n"
+					"Please, define either XDG_CONFIG_HOME or HOME.\n");
+
+			return 1;
+		}
+
+		// NOTE: The library has been read: exercises imported into it
+		//       cannot take ids it has already.
+		return (import_workouts(import_file, program_dir, import_to_library) != 0);
 	}
 
-	Program all_programs[10] = {};
-	int program_count = 0;
-	
-	char full_program_path[256];
+	load_config_file(config_file, &config, voice_off, music_off);
+
+	EventStream *events = NULL;
 
-	if (program_name[0] != '\0')
+	if (write_events && !render_audio)
 	{
-		sprintf(full_program_path, "%s/programs/%s", program_dir, program_name);
+		events = (EventStream *) calloc(1, sizeof(EventStream));
+
+		if (!event_stream_open(events))
+		{
+			return 1;
+		}
 	}
-	else
+
+	Dashboard dashboard = {};
+
+	if (run_as_daemon)
+	{
+		if (dashboard_address && !dashboard_start(&dashboard, dashboard_address))
+		{
+			return 1;
+		}
+
+		int result = run_daemon(&config, program_dir, voice_off, music_off,
+								dashboard_address ? &dashboard : NULL, events);
+
+		dashboard_stop(&dashboard);
+
+		if (events)
+		{
+			event_stream_close(events);
+		}
+
+		return result;
+	}
+
+	Session *session = (Session *) calloc(1, sizeof(Session));
+	session->config = &config;
+	session->events = events;
+
+	char *name = (program_name[0] != '\0') ? program_name : config.default_program;
+
+	SuspendedSession suspended;
+
+	if (resume)
 	{
-		sprintf(full_program_path, "%s/programs/%s", program_dir, config.default_program);
+		if (!read_suspended_session(&suspended))
+		{
+			fprintf(stderr, "%s: --resume: no session was suspended.\n", PROGRAM);
+
+			return 1;
+		}
+
+		name = suspended.program_name;
+
+		// Whatever else was asked for.
+		generate   = false;
+		from_stdin = false;
 	}
 
-	if (parse_program_file(full_program_path, all_programs, &program_count, ARRAY_SIZE(all_programs)) != 0)
+	ProgramStream stream = {};
+
+	if (generate)
 	{
-		return 1;
+		char generate_dir[512];
+		snprintf(generate_dir, sizeof(generate_dir), "%s/programs", program_dir);
+
+		session->program_count = generate_session(generate_dir, generate_tags,
+												  generate_minutes * 60 * 1000, config.setup_time,
+												  session->all_programs, ARRAY_SIZE(session->all_programs));
+
+		if (!session->program_count)
+		{
+			fprintf(stderr, "%s: --generate: no program fits in %ld minutes.\n", PROGRAM, generate_minutes);
+
+			return 1;
+		}
 	}
+	else if (from_stdin)
+	{
+		char stream_dir[512];
+		snprintf(stream_dir, sizeof(stream_dir), "%s/programs", program_dir);
 
-	signal(SIGCHLD, SIG_IGN); 	// Avoids turning child processes into zombies
+		if (!program_stream_start(&stream, stdin, stream_dir))
+		{
+			return 1;
+		}
 
-	child_exec(&config.music_init, CHILD_EXEC_NO_STDOUT);
+		session->stream = &stream;
+	}
+	else if (load_builtin_program(name, session->all_programs))
+	{
+		session->program_count = 1;
+	}
+	else
+	{
+		char full_program_path[512];
+
+		if (snprintf(full_program_path, sizeof(full_program_path), "%s/programs/%s",
+					 program_dir, name) >= (int) sizeof(full_program_path))
+		{
+			fprintf(stderr, "%s: %s/programs/%s: path is too long (> %zu characters).\n",
+					PROGRAM, program_dir, name, sizeof(full_program_path) - 1);
+
+			return 1;
+		}
+
+		if (parse_program_file(full_program_path, session->all_programs, &session->program_count,
+							   ARRAY_SIZE(session->all_programs)) != 0)
+		{
+			return 1;
+		}
+	}
 
-	// There is no use in muting, is there?
-	if (!config.voice_on)
+	if (render_audio)
 	{
-		set_music(&config, 1);
+		signal(SIGPIPE, SIG_IGN);	// Noticed by fwrite() ('-' read by a player that quits)
+
+		b32 rendered = render_session_audio(&config, session->all_programs, session->program_count,
+											render_audio, beeps);
+		stop_all_children();
+
+		return !rendered;
 	}
 
-	for (int i = 0; i < program_count; ++i)
+	if (resume && !restore_session(session, &suspended))
 	{
-		Program *program = all_programs + i;
+		return 1;
+	}
 
-		while (program->current_exercise < program->exercise_count)
+	snprintf(session->program_name, sizeof(session->program_name), "%s",
+			 generate ? "generated" : (from_stdin ? "stdin" : name));
+
+	session->resumable = (!generate && !from_stdin);
+
+	if (dashboard_address)
+	{
+		if (!dashboard_start(&dashboard, dashboard_address))
 		{
-			Exercise *current_exercise = program->all_exercises + program->current_exercise++;
+			return 1;
+		}
 
-			tts_say(&config, current_exercise->name);
-			while (current_exercise->current_series++ < current_exercise->series_count)
-			{
-				tts_say(&config, "Ready");
-				
-				wait_and_print_chrono(config.setup_time);
-				
-				tts_say(&config, "Go");
+		session->dashboard = &dashboard;
+	}
 
-				if (current_exercise->duration)
-				{
-					wait_and_print_chrono(&config, current_exercise->duration,
-										  current_exercise->milestone);
+	// NOTE: SIGCHLD is not ignored: children are reaped by the
+	//       supervisor, which reports how they exited.
+	signal(SIGPIPE, SIG_IGN);	// A player or festival that quits is noticed by write()
 
-					tts_say(&config, "Stop");
-				}
-				else
-				{
-					printf("Press ENTER once you are done...\n");
+	Speech speech = {};
+	tts_warm_up(&config, &speech);
 
-					wait_for_input();
-				}
+	session->speech = &speech;
 
-				int very_last_series = ((i == (program_count - 1)) &&
-										(program->current_exercise == program->exercise_count) &&
-										(current_exercise->current_series == current_exercise->series_count));
-				
-				if (!very_last_series)
-				{
-					tts_say(&config, "Pause");
+	Keyboard keyboard;
 
-					wait_and_print_chrono(current_exercise->pause_duration);
-				}
-			}
-		}
-	}	
+	// stdin is the program: keys are read from the terminal, if any.
+	int keyboard_fd = from_stdin ? open("/dev/tty", O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+
+	if ((keyboard_fd != -1) && keyboard_open(&keyboard, keyboard_fd))
+	{
+		session->keyboard = &keyboard;
+	}
+
+	run_session(session);
 
-	tts_say(&config, "Finished! Congratulations!");
-	tts_say(&config, "Now, go take a shower.");
+	if (session->keyboard)
+	{
+		keyboard_close(&keyboard);
+	}
+
+	if (from_stdin && (keyboard_fd != -1))
+	{
+		close(keyboard_fd);
+	}
+
+	program_stream_stop(&stream);
+
+	tts_shutdown(&speech);
+	stop_all_children();
+
+	dashboard_stop(&dashboard);
+
+	if (events)
+	{
+		event_stream_close(events);
+	}
 
 	return 0;
 }
@@ -0,0 +1,325 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+
+#include "metronome.h"
+
+#define SAMPLES_PER_MS (METRONOME_SAMPLE_RATE / 1000)
+
+// How far ahead of time the player is fed, and how often.
+#define METRONOME_LEAD_NS	30000000ULL
+#define METRONOME_PERIOD_NS 10000000ULL
+
+// In milliseconds: how long the player has to play what it was given
+// and quit once stopped (its own buffers included).
+#define METRONOME_DRAIN_TIMEOUT 2000
+
+#define ACCENT_SAMPLE_COUNT (30 * SAMPLES_PER_MS)
+#define CLICK_SAMPLE_COUNT	(20 * SAMPLES_PER_MS)
+
+internal i16 global_accent[ACCENT_SAMPLE_COUNT];
+internal i16 global_click[CLICK_SAMPLE_COUNT];
+
+internal b32 global_sounds_rendered = false;
+
+internal char *global_phase_names[TEMPO_PHASE_COUNT] =
+{
+	"eccentric", "pause", "concentric", "pause"
+};
+
+// Short sine bursts, fading out quickly so they sound like clicks.
+internal void render_sound(i16 *samples, int sample_count, r32 frequency)
+{
+	for (int i = 0; i < sample_count; ++i)
+	{
+		r32 t = (r32) i / METRONOME_SAMPLE_RATE;
+		r32 envelope = expf(-t / 0.006f);
+
+		samples[i] = (i16) (0.6f * INT16_MAX * envelope * sinf(2.0f * (r32) M_PI * frequency * t));
+	}
+}
+
+internal void render_sounds()
+{
+	if (!global_sounds_rendered)
+	{
+		render_sound(global_accent, ACCENT_SAMPLE_COUNT, 1760.0f);
+		render_sound(global_click, CLICK_SAMPLE_COUNT, 880.0f);
+
+		global_sounds_rendered = true;
+	}
+}
+
+void metronome_open(Metronome *metronome, Command *player)
+{
+	if (metronome->player_pid || !player->argc)
+	{
+		return;
+	}
+
+	metronome->player_fd = -1;
+
+	render_sounds();
+
+	int pipe_fd[2];
+
+	// Other children (e.g: the music commands) must not keep the pipe
+	// open, or the player would never see its end.
+	if (pipe2(pipe_fd, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return;
+	}
+
+	pid_t child_pid = spawn_child(player->argv, CHILD_EXEC_VERBOSE, pipe_fd[0], -1);
+
+	close(pipe_fd[0]);
+
+	if (child_pid == -1)
+	{
+		close(pipe_fd[1]);
+		return;
+	}
+
+	// Feeding must never block the session.
+	fcntl(pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+	metronome->player_pid = child_pid;
+	metronome->player_fd  = pipe_fd[1];
+}
+
+internal void mix_sound(i16 *samples, u64 first_sample, u64 sample_count,
+						i16 *sound, u64 sound_sample_count, u64 sound_start)
+{
+	u64 begin = MAX(sound_start, first_sample);
+	u64 end	  = MIN(sound_start + sound_sample_count, first_sample + sample_count);
+
+	for (u64 i = begin; i < end; ++i)
+	{
+		i32 mixed = samples[i - first_sample] + sound[i - sound_start];
+
+		samples[i - first_sample] = CLAMP(mixed, INT16_MIN, INT16_MAX);
+	}
+}
+
+// Every click that overlaps [FIRST_SAMPLE, FIRST_SAMPLE + SAMPLE_COUNT).
+internal void mix_clicks(u16 *tempo, u32 *phase_offsets, u32 rep_duration,
+						 i16 *samples, u64 first_sample, u64 sample_count)
+{
+	u64 rep_sample_count = (u64) rep_duration * SAMPLES_PER_MS;
+	u64 first_rep = (first_sample > ACCENT_SAMPLE_COUNT) ? (first_sample - ACCENT_SAMPLE_COUNT) / rep_sample_count : 0;
+
+	for (u64 rep = first_rep; rep * rep_sample_count < first_sample + sample_count; ++rep)
+	{
+		for (int phase = 0; phase < TEMPO_PHASE_COUNT; ++phase)
+		{
+			if (!tempo[phase])
+			{
+				continue;
+			}
+
+			u64 sound_start = rep * rep_sample_count + (u64) phase_offsets[phase] * SAMPLES_PER_MS;
+
+			if (phase == 0)
+			{
+				mix_sound(samples, first_sample, sample_count,
+						  global_accent, ACCENT_SAMPLE_COUNT, sound_start);
+			}
+			else
+			{
+				mix_sound(samples, first_sample, sample_count,
+						  global_click, CLICK_SAMPLE_COUNT, sound_start);
+			}
+		}
+	}
+}
+
+internal void render_samples(Metronome *metronome, i16 *samples, u64 first_sample, u64 sample_count)
+{
+	memset(samples, 0, sample_count * sizeof(i16));
+
+	mix_clicks(metronome->tempo, metronome->phase_offsets, metronome->rep_duration,
+			   samples, first_sample, sample_count);
+}
+
+void metronome_mix(u16 *tempo, i16 *samples, u64 first_sample, u64 sample_count)
+{
+	u32 phase_offsets[TEMPO_PHASE_COUNT];
+	u32 rep_duration = 0;
+
+	for (int i = 0; i < TEMPO_PHASE_COUNT; ++i)
+	{
+		phase_offsets[i] = rep_duration;
+		rep_duration += tempo[i];
+	}
+
+	if (!rep_duration)
+	{
+		return;
+	}
+
+	render_sounds();
+
+	mix_clicks(tempo, phase_offsets, rep_duration, samples, first_sample, sample_count);
+}
+
+void metronome_mix_accent(i16 *samples, u64 first_sample, u64 sample_count, u64 at)
+{
+	render_sounds();
+
+	mix_sound(samples, first_sample, sample_count, global_accent, ACCENT_SAMPLE_COUNT, at);
+}
+
+internal void feed_player(Timer *timer, void *data)
+{
+	Metronome *metronome = (Metronome *) data;
+
+	u64 elapsed = timer_wheel_now(metronome->wheel) - metronome->start;
+
+	u64 played = (elapsed * METRONOME_SAMPLE_RATE) / 1000000000ULL;
+	u64 target = ((elapsed + METRONOME_LEAD_NS) * METRONOME_SAMPLE_RATE) / 1000000000ULL;
+
+	// Late (e.g: the session was busy speaking): what should already
+	// have been played is dropped, so the next clicks are still on time.
+	if (metronome->written_sample_count < played)
+	{
+		metronome->written_sample_count = played;
+	}
+
+	// No more than that, so a write is all or nothing.
+	i16 samples[PIPE_BUF / sizeof(i16)];
+
+	while (metronome->written_sample_count < target)
+	{
+		u64 sample_count = MIN(target - metronome->written_sample_count, ARRAY_SIZE(samples));
+
+		render_samples(metronome, samples, metronome->written_sample_count, sample_count);
+
+		ssize_t size = sample_count * sizeof(i16);
+
+		if (write(metronome->player_fd, samples, size) != size)
+		{
+			// Either the player is lagging behind (it is given the
+			// rest next time), or it is gone.
+			if (errno != EAGAIN)
+			{
+				close(metronome->player_fd);
+				metronome->player_fd = -1;
+
+				return;
+			}
+
+			break;
+		}
+
+		metronome->written_sample_count += sample_count;
+	}
+
+	timer_add(metronome->wheel, timer, timer->deadline + METRONOME_PERIOD_NS, feed_player, data);
+}
+
+internal void show_phase(Timer *timer, void *data)
+{
+	Metronome *metronome = (Metronome *) data;
+
+	char text[64];
+	snprintf(text, sizeof(text), "Rep %u: %s", metronome->rep, global_phase_names[metronome->phase]);
+
+	render_status(metronome->renderer, text);
+
+	// Next phase that takes any time.
+	do
+	{
+		if (++metronome->phase == TEMPO_PHASE_COUNT)
+		{
+			metronome->phase = 0;
+			++metronome->rep;
+		}
+	}
+	while (!metronome->tempo[metronome->phase]);
+
+	u64 next_deadline = metronome->start +
+		((u64) (metronome->rep - 1) * metronome->rep_duration + metronome->phase_offsets[metronome->phase]) * 1000000ULL;
+
+	timer_add(metronome->wheel, timer, next_deadline, show_phase, data);
+}
+
+void metronome_start(Metronome *metronome, TimerWheel *wheel, u16 *tempo, Renderer *renderer)
+{
+	metronome->wheel = wheel;
+	metronome->rep_duration = 0;
+
+	for (int i = 0; i < TEMPO_PHASE_COUNT; ++i)
+	{
+		metronome->tempo[i]			= tempo[i];
+		metronome->phase_offsets[i] = metronome->rep_duration;
+
+		metronome->rep_duration += tempo[i];
+	}
+
+	if (!metronome->rep_duration)
+	{
+		return;
+	}
+
+	metronome->start = timer_wheel_now(wheel);
+	metronome->written_sample_count = 0;
+
+	metronome->running = true;
+
+	if (metronome->player_pid && (metronome->player_fd != -1))
+	{
+		timer_add(wheel, &metronome->feed_timer, metronome->start, feed_player, metronome);
+	}
+
+	if (renderer)
+	{
+		metronome->renderer = renderer;
+		metronome->rep	 = 1;
+		metronome->phase = 0;
+
+		while (!metronome->tempo[metronome->phase])
+		{
+			++metronome->phase;
+		}
+
+		timer_add(wheel, &metronome->phase_timer,
+				  metronome->start + metronome->phase_offsets[metronome->phase] * 1000000ULL,
+				  show_phase, metronome);
+	}
+}
+
+void metronome_stop(Metronome *metronome)
+{
+	if (metronome->running)
+	{
+		timer_cancel(metronome->wheel, &metronome->feed_timer);
+		timer_cancel(metronome->wheel, &metronome->phase_timer);
+
+		if (metronome->renderer)
+		{
+			render_clear(metronome->renderer);
+		}
+
+		metronome->renderer = NULL;
+		metronome->running	= false;
+	}
+
+	// NOTE: The player is not waited for, it has at most
+	//       METRONOME_LEAD_NS left to play (it is reaped later on, see
+	//       release_child).
+	if (metronome->player_pid)
+	{
+		if (metronome->player_fd != -1)
+		{
+			close(metronome->player_fd);
+		}
+
+		release_child(metronome->player_pid, METRONOME_DRAIN_TIMEOUT);
+
+		metronome->player_pid = 0;
+		metronome->player_fd  = -1;
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef METRONOME_H
+#define METRONOME_H
+
+#include "common.h"
+#include "render.h"
+#include "supervisor.h"
+#include "timer.h"
+
+// Raw audio fed to the metronome command's stdin (signed 16 bit,
+// little-endian, mono).
+#define METRONOME_SAMPLE_RATE 48000
+
+// Plays a click at the start of each tempo phase (an accented one for
+// the eccentric phase, so reps can be told apart) through a single
+// player process, and shows the current phase if asked to.
+// Clicks are pre-rendered, and put at their exact sample offset in the
+// stream, which is fed a few milliseconds ahead by a wheel timer: how
+// late a timer runs never moves a click.
+struct Metronome
+{
+	TimerWheel *wheel;
+
+	// In milliseconds.
+	u16 tempo[TEMPO_PHASE_COUNT];
+	u32 phase_offsets[TEMPO_PHASE_COUNT];
+	u32 rep_duration;
+
+	// Wheel time of the very first click.
+	u64 start;
+	u64 written_sample_count;
+
+	int player_pid;
+	int player_fd;
+
+	// Where the phases are shown, NULL if they are not.
+	Renderer *renderer;
+	u32 rep;
+	int phase;
+
+	b32 running;
+
+	Timer feed_timer,
+		  phase_timer;
+};
+
+inline b32 has_tempo(Exercise *exercise)
+{
+	for (int i = 0; i < TEMPO_PHASE_COUNT; ++i)
+	{
+		if (exercise->tempo[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Starts the player ahead of time, so its own start-up does not delay
+// the first clicks. Does nothing if there is no metronome command.
+void metronome_open(Metronome *metronome, Command *player);
+
+// Phases are shown on RENDERER (if not NULL).
+void metronome_start(Metronome *metronome, TimerWheel *wheel, u16 *tempo, Renderer *renderer);
+
+// Lets the player finish what it has been given, and quit.
+void metronome_stop(Metronome *metronome);
+
+// Without a player (e.g: to render a session offline), samples being
+// counted from the first click of the first rep.
+// Mixes the clicks of TEMPO overlapping [FIRST_SAMPLE, FIRST_SAMPLE +
+// SAMPLE_COUNT) into SAMPLES.
+void metronome_mix(u16 *tempo, i16 *samples, u64 first_sample, u64 sample_count);
+
+// Same, for a single accented click at sample AT.
+void metronome_mix_accent(i16 *samples, u64 first_sample, u64 sample_count, u64 at);
+
+#endif
@@ -0,0 +1,409 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "metronome.h"
+#include "mixer.h"
+#include "supervisor.h"
+#include "timer.h"
+
+#define MIXER_BLOCK_NS ((MIXER_BLOCK_SAMPLE_COUNT * 1000000000ULL) / METRONOME_SAMPLE_RATE)
+
+#define FULL_GAIN INT16_MAX
+
+internal b32 write_to_player(MixerSink *sink, i16 *samples, u32 sample_count)
+{
+	ssize_t size = sample_count * sizeof(i16);
+
+	// NOTE: A block is smaller than PIPE_BUF, so it is written whole
+	//       or not at all.
+	if (write(sink->fd, samples, size) != size)
+	{
+		// The player is lagging behind, it misses this block (or it
+		// is gone).
+		return (errno == EAGAIN);
+	}
+
+	return true;
+}
+
+// NOTE: The player is not waited for, it has at most MIXER_LEAD_NS
+//       left to play (it is reaped later on, see release_child).
+internal void close_player(MixerSink *sink)
+{
+	close(sink->fd);
+	release_child(sink->pid, MIXER_DRAIN_TIMEOUT);
+}
+
+internal b32 write_to_file(MixerSink *sink, i16 *samples, u32 sample_count)
+{
+	ssize_t size = sample_count * sizeof(i16);
+
+	return (write(sink->fd, samples, size) == size);
+}
+
+internal void close_file(MixerSink *sink)
+{
+	close(sink->fd);
+}
+
+b32 mixer_open_player_sink(MixerSink *sink, Command *player)
+{
+	int pipe_fd[2];
+
+	// Other children must not keep the pipe open, or the player would
+	// never see its end.
+	if (pipe2(pipe_fd, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return false;
+	}
+
+	pid_t child_pid = spawn_child(player->argv, CHILD_EXEC_VERBOSE, pipe_fd[0], -1);
+
+	close(pipe_fd[0]);
+
+	if (child_pid == -1)
+	{
+		close(pipe_fd[1]);
+		return false;
+	}
+
+	// Writing must never hold the mixer back.
+	fcntl(pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+	sink->write = write_to_player;
+	sink->close = close_player;
+	sink->fd	= pipe_fd[1];
+	sink->pid	= child_pid;
+
+	return true;
+}
+
+b32 mixer_open_file_sink(MixerSink *sink, const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd == -1)
+	{
+		perror(path);
+		return false;
+	}
+
+	sink->write = write_to_file;
+	sink->close = close_file;
+	sink->fd	= fd;
+	sink->pid	= 0;
+
+	return true;
+}
+
+// OUTPUT gets SPEECH + MUSIC * gain (saturated), the gain (Q15) going
+// from GAIN by GAIN_STEP every 8 samples. COUNT is a multiple of 8,
+// every buffer is 16-byte aligned.
+internal void mix_block(i16 *output, i16 *speech, i16 *music, u32 count, i32 gain, i32 gain_step)
+{
+	for (u32 i = 0; i < count; i += 8, gain += gain_step)
+	{
+		i16 g = (i16) (CLAMP(gain, 0, FULL_GAIN));
+
+#if defined(__SSE2__)
+		// (MUSIC * g) >> 16, doubled.
+		__m128i scaled = _mm_mulhi_epi16(_mm_load_si128((__m128i *) (music + i)), _mm_set1_epi16(g));
+		scaled = _mm_adds_epi16(scaled, scaled);
+
+		_mm_store_si128((__m128i *) (output + i),
+						_mm_adds_epi16(_mm_load_si128((__m128i *) (speech + i)), scaled));
+#elif defined(__ARM_NEON)
+		int16x8_t scaled = vqdmulhq_n_s16(vld1q_s16(music + i), g);
+
+		vst1q_s16(output + i, vqaddq_s16(vld1q_s16(speech + i), scaled));
+#else
+		for (u32 j = i; j < i + 8; ++j)
+		{
+			i32 mixed = speech[j] + ((music[j] * g) >> 15);
+
+			output[j] = CLAMP(mixed, INT16_MIN, INT16_MAX);
+		}
+#endif
+	}
+}
+
+// Whatever the decoder has written (never waiting for it).
+internal void read_music(Mixer *mixer)
+{
+	while (mixer->music_fd != -1)
+	{
+		u32 room = sizeof(mixer->music_buffer) - mixer->music_size;
+
+		if (!room)
+		{
+			break;
+		}
+
+		ssize_t num_read = read(mixer->music_fd, mixer->music_buffer + mixer->music_size, room);
+
+		if (num_read > 0)
+		{
+			mixer->music_size += num_read;
+			continue;
+		}
+
+		if ((num_read == -1) && ((errno == EAGAIN) || (errno == EINTR)))
+		{
+			break;
+		}
+
+		// The music is over.
+		close(mixer->music_fd);
+		mixer->music_fd = -1;
+	}
+}
+
+// Fills the speech block from the clips given, one after the other.
+// Returns true if anything is being said.
+internal b32 take_speech(Mixer *mixer)
+{
+	i16 *block = mixer->speech_block;
+	u32 filled = 0;
+
+	while (filled < MIXER_BLOCK_SAMPLE_COUNT)
+	{
+		if (!mixer->has_clip)
+		{
+			if (!ring_pop(&mixer->clips, &mixer->clip))
+			{
+				break;
+			}
+
+			mixer->has_clip = true;
+			mixer->clip_position = 0;
+		}
+
+		MixerClip *clip = &mixer->clip;
+
+		u32 count = MIN(MIXER_BLOCK_SAMPLE_COUNT - filled, clip->sample_count - mixer->clip_position);
+
+		memcpy(block + filled, clip->samples + mixer->clip_position, count * sizeof(i16));
+
+		filled += count;
+		mixer->clip_position += count;
+
+		if (mixer->clip_position == clip->sample_count)
+		{
+			// When its last sample is played.
+			u64 end = mixer->start + mixer->block_count * MIXER_BLOCK_NS +
+				(filled * 1000000000ULL) / METRONOME_SAMPLE_RATE;
+
+			MixerDone done = { clip->text, (end > clip->sent_at) ? end - clip->sent_at : 0 };
+
+			// NOTE: There is always room, there are never more clips
+			//       done than given.
+			ring_push(&mixer->done, &done);
+			eventfd_write(mixer->done_fd, 1);
+
+			mixer->has_clip = false;
+		}
+	}
+
+	memset(block + filled, 0, (MIXER_BLOCK_SAMPLE_COUNT - filled) * sizeof(i16));
+
+	return (filled > 0) || mixer->has_clip;
+}
+
+internal void take_music(Mixer *mixer)
+{
+	read_music(mixer);
+
+	u32 sample_count = MIN(mixer->music_size / (u32) sizeof(i16), (u32) MIXER_BLOCK_SAMPLE_COUNT);
+	u32 size = sample_count * sizeof(i16);
+
+	memcpy(mixer->music_block, mixer->music_buffer, size);
+
+	// Not decoded in time: silence, rather than waiting for it.
+	memset(mixer->music_block + sample_count, 0, (MIXER_BLOCK_SAMPLE_COUNT - sample_count) * sizeof(i16));
+
+	mixer->music_size -= size;
+	memmove(mixer->music_buffer, mixer->music_buffer + size, mixer->music_size);
+}
+
+internal void render_block(Mixer *mixer)
+{
+	b32 speaking = take_speech(mixer);
+	take_music(mixer);
+
+	// Turned down (and back up) over a few blocks, so it does not click.
+	i32 target = speaking ? MIXER_DUCK_GAIN : FULL_GAIN;
+	i32 step = (FULL_GAIN - MIXER_DUCK_GAIN) / (speaking ? MIXER_DUCK_ATTACK : MIXER_DUCK_RELEASE);
+
+	i32 gain = mixer->music_gain;
+	i32 next_gain = (gain > target) ? MAX(gain - step, target) : MIN(gain + step, target);
+
+	mix_block(mixer->output_block, mixer->speech_block, mixer->music_block, MIXER_BLOCK_SAMPLE_COUNT,
+			  gain, (next_gain - gain) / (MIXER_BLOCK_SAMPLE_COUNT / 8));
+
+	mixer->music_gain = next_gain;
+}
+
+internal void *mixer_thread(void *data)
+{
+	Mixer *mixer = (Mixer *) data;
+
+	b32 sink_open = true;
+
+	while (!ATOMIC_LOAD(&mixer->quitting))
+	{
+		u64 block_start = mixer->start + mixer->block_count * MIXER_BLOCK_NS;
+
+		sleep_until_ns((block_start > MIXER_LEAD_NS) ? block_start - MIXER_LEAD_NS : 0);
+
+		// Late (e.g: the machine was asleep): blocks that should have
+		// been played already are not, the next ones are on time.
+		u64 now = get_monotonic_ns();
+
+		if (now > block_start + MIXER_BLOCK_NS)
+		{
+			mixer->block_count = (now - mixer->start) / MIXER_BLOCK_NS;
+		}
+
+		render_block(mixer);
+
+		if (sink_open && !mixer->sink.write(&mixer->sink, mixer->output_block, MIXER_BLOCK_SAMPLE_COUNT))
+		{
+			fprintf(stderr, "%s: the mixer's output is gone, nothing is heard anymore.\n", PROGRAM);
+
+			// Clips are still said (unheard), so they are done with.
+			sink_open = false;
+		}
+
+		++mixer->block_count;
+	}
+
+	return NULL;
+}
+
+b32 mixer_start(Mixer *mixer, Config *config)
+{
+	mixer->running = false;
+
+	if (config->mixer_file[0] != '\0')
+	{
+		if (!mixer_open_file_sink(&mixer->sink, config->mixer_file))
+		{
+			return false;
+		}
+	}
+	else if (!config->mixer.argc || !mixer_open_player_sink(&mixer->sink, &config->mixer))
+	{
+		return false;
+	}
+
+	mixer->music_pid = 0;
+	mixer->music_fd	 = -1;
+
+	int pipe_fd[2];
+
+	if (config->music_source.argc && (pipe2(pipe_fd, O_CLOEXEC) == 0))
+	{
+		pid_t child_pid = spawn_child(config->music_source.argv, CHILD_EXEC_VERBOSE, -1, pipe_fd[1]);
+
+		close(pipe_fd[1]);
+
+		if (child_pid != -1)
+		{
+			fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK);
+
+			mixer->music_pid = child_pid;
+			mixer->music_fd	 = pipe_fd[0];
+		}
+		else
+		{
+			close(pipe_fd[0]);
+		}
+	}
+
+	if ((mixer->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+	{
+		perror("eventfd");
+
+		mixer_stop(mixer);
+		return false;
+	}
+
+	ring_init(&mixer->clips, sizeof(MixerClip), MAX_MIXER_CLIP_COUNT);
+	ring_init(&mixer->done, sizeof(MixerDone), MAX_MIXER_CLIP_COUNT);
+
+	mixer->has_clip	   = false;
+	mixer->music_gain  = FULL_GAIN;
+	mixer->music_size  = 0;
+	mixer->start	   = get_monotonic_ns() + MIXER_LEAD_NS;
+	mixer->block_count = 0;
+	mixer->quitting	   = false;
+
+	if (pthread_create(&mixer->thread, NULL, mixer_thread, mixer) != 0)
+	{
+		fprintf(stderr, "%s: could not start the mixer thread.\n", PROGRAM);
+
+		mixer_stop(mixer);
+		return false;
+	}
+
+	mixer->running = true;
+
+	return true;
+}
+
+// Also undoes a mixer_start that failed halfway.
+void mixer_stop(Mixer *mixer)
+{
+	if (mixer->running)
+	{
+		ATOMIC_STORE(&mixer->quitting, true);
+		pthread_join(mixer->thread, NULL);
+
+		mixer->running = false;
+	}
+
+	mixer->sink.close(&mixer->sink);
+
+	if (mixer->music_pid)
+	{
+		if (mixer->music_fd != -1)
+		{
+			close(mixer->music_fd);
+		}
+
+		stop_child(mixer->music_pid);
+
+		mixer->music_pid = 0;
+		mixer->music_fd	 = -1;
+	}
+
+	if (mixer->done_fd != -1)
+	{
+		close(mixer->done_fd);
+		mixer->done_fd = -1;
+	}
+
+	ring_free(&mixer->clips);
+	ring_free(&mixer->done);
+}
+
+b32 mixer_say(Mixer *mixer, i16 *samples, u32 sample_count, u32 text)
+{
+	MixerClip clip = { samples, sample_count, text, get_monotonic_ns() };
+
+	return ring_push(&mixer->clips, &clip);
+}
+
+b32 mixer_next_done(Mixer *mixer, MixerDone *done)
+{
+	return ring_pop(&mixer->done, done);
+}
@@ -0,0 +1,145 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "ring.h"
+
+// 10ms (see METRONOME_SAMPLE_RATE), a multiple of 8 (see mix_block).
+#define MIXER_BLOCK_SAMPLE_COUNT 480
+
+// How far ahead of time blocks are written.
+#define MIXER_LEAD_NS 40000000ULL
+
+// Of the music decoded ahead of time, in samples (200ms).
+#define MIXER_MUSIC_BUFFER_SAMPLE_COUNT 9600
+
+// Clips given to the mixer, not said yet, at most.
+#define MAX_MIXER_CLIP_COUNT 16
+
+// Music volume while something is said (Q15, 25%), and how long it
+// takes to get there (and back) in blocks.
+#define MIXER_DUCK_GAIN	   8192
+#define MIXER_DUCK_ATTACK  5
+#define MIXER_DUCK_RELEASE 30
+
+// In milliseconds: how long the player has to play what it was given
+// and quit once the mixer stops.
+#define MIXER_DRAIN_TIMEOUT 2000
+
+struct MixerSink;
+
+// Returns false once the sink is gone (nothing is written to it
+// anymore).
+typedef b32 MixerSinkWrite(MixerSink *sink, i16 *samples, u32 sample_count);
+typedef void MixerSinkClose(MixerSink *sink);
+
+// Where the mixed audio goes: a player's stdin (see
+// mixer_open_player_sink), or a file (see mixer_open_file_sink, e.g:
+// to check what was mixed).
+struct MixerSink
+{
+	MixerSinkWrite *write;
+	MixerSinkClose *close;
+
+	int fd;
+
+	// Of the player, 0 for a file.
+	int pid;
+};
+
+// Audio to say (see render_speech), the mixer's until it is done
+// with it (see MixerDone).
+struct MixerClip
+{
+	i16 *samples;
+	u32 sample_count;
+
+	// Interned.
+	u32 text;
+
+	// CLOCK_MONOTONIC, when it was given to the mixer.
+	u64 sent_at;
+};
+
+// A clip has been said.
+struct MixerDone
+{
+	// Interned.
+	u32 text;
+
+	// In nanoseconds, from when it was given to the mixer until it
+	// was heard whole.
+	u64 duration;
+};
+
+// Music (decoded by the music_source command) and speech clips, mixed
+// by their own thread a block at a time, the music being turned down
+// while anything is said: no command is run per cue, and the music
+// never stops.
+// NOTE: The mixing thread never allocates, nor waits for anything but
+//       the next block's time: clips are rendered (and freed) by
+//       whoever gives them, the music is read without blocking, and a
+//       sink that falls behind misses blocks rather than delaying the
+//       next ones.
+// Clips come from a single thread, which is the only one getting them
+// back (see mixer_next_done).
+struct Mixer
+{
+	MixerSink sink;
+
+	// Decoder of the music (raw audio on its stdout), 0 if none.
+	int music_pid;
+	int music_fd;
+
+	SpscRing clips;
+	SpscRing done;
+
+	// Written to after each clip done with (see MixerDone).
+	int done_fd;
+
+	pthread_t thread;
+	b32 running;
+	b32 quitting;
+
+	// Only the mixer's thread touches those.
+	MixerClip clip;
+	b32 has_clip;
+	u32 clip_position;
+
+	// Q15.
+	i32 music_gain;
+
+	u8 music_buffer[MIXER_MUSIC_BUFFER_SAMPLE_COUNT * sizeof(i16)];
+	u32 music_size;
+
+	// CLOCK_MONOTONIC, of the first block.
+	u64 start;
+	u64 block_count;
+
+	alignas(16) i16 speech_block[MIXER_BLOCK_SAMPLE_COUNT];
+	alignas(16) i16 music_block[MIXER_BLOCK_SAMPLE_COUNT];
+	alignas(16) i16 output_block[MIXER_BLOCK_SAMPLE_COUNT];
+};
+
+b32 mixer_open_player_sink(MixerSink *sink, Command *player);
+b32 mixer_open_file_sink(MixerSink *sink, const char *path);
+
+// Writes to CONFIG's mixer_file if set, to its mixer command
+// otherwise, music coming from its music_source (if any).
+// Returns false if there is neither, or if it could not start.
+b32 mixer_start(Mixer *mixer, Config *config);
+
+// What was given to it and not said yet is dropped (see
+// mixer_next_done to wait for it first).
+void mixer_stop(Mixer *mixer);
+
+// Said after whatever was given before it.
+// Returns false if there is no room for it (it is not the mixer's
+// then).
+b32 mixer_say(Mixer *mixer, i16 *samples, u32 sample_count, u32 text);
+
+b32 mixer_next_done(Mixer *mixer, MixerDone *done);
+
+#endif
@@ -0,0 +1,693 @@
+#include <unistd.h>
+#include <pthread.h>
+
+#include "intern.h"
+#include "metronome.h"
+#include "offline.h"
+#include "session.h"
+#include "supervisor.h"
+#include "timer.h"
+
+#define SAMPLES_PER_MS (METRONOME_SAMPLE_RATE / 1000)
+
+// Different cues in a session, at most (the others are left silent).
+#define MAX_CLIP_COUNT 1024
+
+// Said at the same time (each by its own command), at most.
+#define MAX_RENDER_WORKER_COUNT 16
+
+// Waiting to be written, at most (see schedule_sound).
+#define MAX_SCHEDULED_SOUND_COUNT 64
+
+#define RENDER_CHUNK_SAMPLE_COUNT 4096
+
+// Longer than the metronome's accent, which is what is heard.
+#define BEEP_SAMPLE_COUNT (50 * SAMPLES_PER_MS)
+
+// After the last sound, so players do not cut it short.
+#define RENDER_TAIL_SAMPLE_COUNT (500 * SAMPLES_PER_MS)
+
+struct Clip
+{
+	// Interned.
+	u32 text;
+
+	i16 *samples;
+	u64 sample_count;
+};
+
+// Every cue of a session, said once each (whatever the number of times
+// it is said in the session), by as many workers as there are cores.
+struct ClipSet
+{
+	Command *command;
+
+	Clip all_clips[MAX_CLIP_COUNT];
+	int clip_count;
+
+	int next_clip;
+	int failed_count;
+};
+
+enum CueFlag
+{
+	// Said so it ends at AT (from AT otherwise).
+	CUE_ENDS_AT	 = 1 << 0,
+
+	// Not said over another cue (milestones, count-ins).
+	CUE_OPTIONAL = 1 << 1,
+};
+
+struct PlannedCue
+{
+	// Interned.
+	u32 text;
+
+	// In samples, since the start of the session.
+	u64 at;
+	u32 flags;
+
+	// When it is said, once its length is known (see emit_period).
+	u64 start;
+};
+
+// A countdown of the session (setup, set or rest) and the cues said
+// over it, in samples since the start of the session.
+struct Period
+{
+	u64 start;
+	u64 end;
+
+	// Clicked over it (if beeps are asked for), NULL if it has none.
+	u16 *tempo;
+
+	// It ends with a beep (if asked for).
+	b32 beep;
+
+	PlannedCue *all_cues;
+	int cue_count;
+	int cue_capacity;
+};
+
+typedef void PeriodCallback(Period *period, void *data);
+
+// Goes through a session as run_session would, one period at a time,
+// without waiting for any of it.
+struct Planner
+{
+	Config *config;
+
+	Period period;
+	u64 time;
+
+	// Cues said as one (see queue_cue).
+	char pending[1024];
+
+	PeriodCallback *callback;
+	void *data;
+};
+
+struct ScheduledSound
+{
+	// NULL for a beep.
+	i16 *samples;
+	u64 sample_count;
+
+	u64 start;
+};
+
+// Writes the session's samples as the planner goes, a chunk at a time.
+struct Emitter
+{
+	FILE *file;
+	ClipSet *clips;
+	b32 beeps;
+
+	u64 written_sample_count;
+
+	// When what is being said ends: as in a session, a cue waits for
+	// the one before it to be said.
+	u64 speech_end;
+
+	// Of the period being written.
+	u16 *tempo;
+	u64 tempo_start;
+	u64 tempo_end;
+
+	ScheduledSound all_sounds[MAX_SCHEDULED_SOUND_COUNT];
+	int sound_count;
+
+	b32 failed;
+
+	i16 chunk[RENDER_CHUNK_SAMPLE_COUNT];
+};
+
+internal void queue_cue(Planner *planner, const char *text)
+{
+	size_t len = strlen(planner->pending);
+
+	if (len)
+	{
+		snprintf(planner->pending + len, sizeof(planner->pending) - len, "%s%s",
+				 cue_separator(planner->pending, len), text);
+	}
+	else
+	{
+		snprintf(planner->pending, sizeof(planner->pending), "%s", text);
+	}
+}
+
+internal void add_cue(Planner *planner, const char *text, u64 at, u32 flags)
+{
+	Period *period = &planner->period;
+
+	if (!planner->config->voice_on)
+	{
+		return;
+	}
+
+	if (period->cue_count == period->cue_capacity)
+	{
+		period->cue_capacity = MAX(16, period->cue_capacity * 2);
+		period->all_cues = (PlannedCue *) realloc(period->all_cues, period->cue_capacity * sizeof(PlannedCue));
+	}
+
+	PlannedCue *cue = period->all_cues + period->cue_count++;
+
+	cue->text  = intern_string(text);
+	cue->at	   = at;
+	cue->flags = flags;
+	cue->start = 0;
+}
+
+// What was queued is said so it ends at AT (CUE_ENDS_AT) or from AT.
+internal void say_cues(Planner *planner, u64 at, u32 flags)
+{
+	if (planner->pending[0] != '\0')
+	{
+		add_cue(planner, planner->pending, at, flags);
+		planner->pending[0] = '\0';
+	}
+}
+
+// DURATION in milliseconds.
+internal void begin_period(Planner *planner, u32 duration, u16 *tempo, b32 beep)
+{
+	Period *period = &planner->period;
+
+	period->start	  = planner->time;
+	period->end		  = planner->time + (u64) duration * SAMPLES_PER_MS;
+	period->tempo	  = tempo;
+	period->beep	  = beep;
+	period->cue_count = 0;
+}
+
+internal void end_period(Planner *planner)
+{
+	planner->callback(&planner->period, planner->data);
+	planner->time = planner->period.end;
+}
+
+// Same cues, at the same times, as run_step.
+internal void plan_session(Config *config, Program *all_programs, int program_count,
+						   PeriodCallback *callback, void *data)
+{
+	Planner planner = {};
+	planner.config	 = config;
+	planner.callback = callback;
+	planner.data	 = data;
+
+	ProgramWalk walk;
+	init_program_walk(&walk, all_programs, program_count);
+
+	int index = next_program(&walk);
+
+	while (index != -1)
+	{
+		Program *program = all_programs + index;
+		index = next_program(&walk);
+
+		for (int i = 0; i < program->exercise_count; ++i)
+		{
+			Exercise *exercise = program->all_exercises + i;
+
+			b32 last = ((index == -1) && (i == program->exercise_count - 1));
+			u16 *tempo = has_tempo(exercise) ? exercise->tempo : NULL;
+
+			u32 spoken_name = exercise->spoken_name ? exercise->spoken_name : exercise->name;
+			queue_cue(&planner, get_string(spoken_name));
+
+			for (int series = 1; series <= exercise->series_count; ++series)
+			{
+				b32 very_last_series = (last && (series == exercise->series_count));
+
+				// "Ready" as it starts, "Go" (and "3, 2, 1") ending
+				// with it.
+				begin_period(&planner, config->setup_time, NULL, true);
+
+				queue_cue(&planner, "Ready");
+				say_cues(&planner, planner.period.start, 0);
+
+				queue_cue(&planner, "Go");
+				say_cues(&planner, planner.period.end, CUE_ENDS_AT);
+
+				u32 count_in = (config->setup_time > 1000) ? (MIN(3, (config->setup_time - 1) / 1000)) : 0;
+
+				for (u32 n = count_in; n > 0; --n)
+				{
+					char text[8];
+					snprintf(text, sizeof(text), "%u", n);
+
+					add_cue(&planner, text, planner.period.end - (u64) n * 1000 * SAMPLES_PER_MS,
+							CUE_ENDS_AT | CUE_OPTIONAL);
+				}
+
+				end_period(&planner);
+
+				if (exercise->duration)
+				{
+					begin_period(&planner, exercise->duration, tempo, true);
+
+					queue_cue(&planner, "Stop");
+
+					if (!very_last_series)
+					{
+						queue_cue(&planner, "Pause");
+					}
+
+					say_cues(&planner, planner.period.end, CUE_ENDS_AT);
+
+					u32 delta = exercise->milestone;
+
+					for (u32 milestone = delta; delta && (milestone < exercise->duration); milestone += delta)
+					{
+						char text[32];
+						format_milestone(text, sizeof(text), milestone);
+
+						add_cue(&planner, text, planner.period.start + (u64) milestone * SAMPLES_PER_MS,
+								CUE_ENDS_AT | CUE_OPTIONAL);
+					}
+
+					end_period(&planner);
+				}
+				else
+				{
+					// Until ENTER, which is a guess here.
+					begin_period(&planner, REP_SET_DURATION, tempo, false);
+					end_period(&planner);
+
+					if (!very_last_series)
+					{
+						// Said over the pause.
+						queue_cue(&planner, "Pause");
+					}
+				}
+
+				if (!very_last_series)
+				{
+					begin_period(&planner, exercise->pause_duration, NULL, true);
+					say_cues(&planner, planner.period.start, 0);
+					end_period(&planner);
+				}
+			}
+		}
+	}
+
+	begin_period(&planner, 0, NULL, false);
+
+	queue_cue(&planner, "Finished! Congratulations!");
+	queue_cue(&planner, "Now, go take a shower.");
+	say_cues(&planner, planner.period.start, 0);
+
+	end_period(&planner);
+
+	free(planner.period.all_cues);
+}
+
+internal Clip *find_clip(ClipSet *clips, u32 text)
+{
+	for (int i = 0; i < clips->clip_count; ++i)
+	{
+		if (clips->all_clips[i].text == text)
+		{
+			return clips->all_clips + i;
+		}
+	}
+
+	return NULL;
+}
+
+internal void collect_cues(Period *period, void *data)
+{
+	ClipSet *clips = (ClipSet *) data;
+
+	for (int i = 0; i < period->cue_count; ++i)
+	{
+		u32 text = period->all_cues[i].text;
+
+		if (!find_clip(clips, text) && (clips->clip_count < MAX_CLIP_COUNT))
+		{
+			Clip *clip = clips->all_clips + clips->clip_count++;
+
+			clip->text		   = text;
+			clip->samples	   = NULL;
+			clip->sample_count = 0;
+		}
+	}
+}
+
+internal b32 say_clip(Command *command, Clip *clip)
+{
+	return render_speech(command, get_string(clip->text), &clip->samples, &clip->sample_count);
+}
+
+internal void *say_worker(void *data)
+{
+	ClipSet *clips = (ClipSet *) data;
+
+	for (;;)
+	{
+		int index = __atomic_fetch_add(&clips->next_clip, 1, __ATOMIC_RELAXED);
+
+		if (index >= clips->clip_count)
+		{
+			break;
+		}
+
+		if (!say_clip(clips->command, clips->all_clips + index))
+		{
+			__atomic_fetch_add(&clips->failed_count, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+internal void say_clips(ClipSet *clips)
+{
+	long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+	int worker_count = CLAMP(core_count, 1, MAX_RENDER_WORKER_COUNT);
+	worker_count = MIN(worker_count, MAX(clips->clip_count, 1));
+
+	pthread_t all_workers[MAX_RENDER_WORKER_COUNT];
+	int started_count = 0;
+
+	for (int i = 1; i < worker_count; ++i)
+	{
+		if (pthread_create(all_workers + started_count, NULL, say_worker, clips) == 0)
+		{
+			++started_count;
+		}
+	}
+
+	// This thread works too.
+	say_worker(clips);
+
+	for (int i = 0; i < started_count; ++i)
+	{
+		pthread_join(all_workers[i], NULL);
+	}
+}
+
+internal void mix_clip(i16 *samples, u64 first_sample, u64 sample_count, ScheduledSound *sound)
+{
+	u64 begin = MAX(sound->start, first_sample);
+	u64 end	  = MIN(sound->start + sound->sample_count, first_sample + sample_count);
+
+	for (u64 i = begin; i < end; ++i)
+	{
+		i32 mixed = samples[i - first_sample] + sound->samples[i - sound->start];
+
+		samples[i - first_sample] = CLAMP(mixed, INT16_MIN, INT16_MAX);
+	}
+}
+
+// Writes every sample until UNTIL.
+internal void advance(Emitter *emitter, u64 until)
+{
+	while (emitter->written_sample_count < until)
+	{
+		u64 first = emitter->written_sample_count;
+		u64 count = MIN(until - first, (u64) RENDER_CHUNK_SAMPLE_COUNT);
+
+		i16 *chunk = emitter->chunk;
+		memset(chunk, 0, count * sizeof(i16));
+
+		for (int i = 0; i < emitter->sound_count; ++i)
+		{
+			ScheduledSound *sound = emitter->all_sounds + i;
+
+			if (sound->samples)
+			{
+				mix_clip(chunk, first, count, sound);
+			}
+			else
+			{
+				metronome_mix_accent(chunk, first, count, sound->start);
+			}
+		}
+
+		if (emitter->tempo)
+		{
+			u64 begin = MAX(first, emitter->tempo_start);
+			u64 end	  = MIN(first + count, emitter->tempo_end);
+
+			if (begin < end)
+			{
+				metronome_mix(emitter->tempo, chunk + (begin - first), begin - emitter->tempo_start, end - begin);
+			}
+		}
+
+		// NOTE: Samples are written as they are in memory, which WAV
+		//       files and every machine we run on have little-endian.
+		if (fwrite(chunk, sizeof(i16), count, emitter->file) != count)
+		{
+			emitter->failed = true;
+		}
+
+		emitter->written_sample_count += count;
+
+		// Those that are over.
+		int kept_count = 0;
+
+		for (int i = 0; i < emitter->sound_count; ++i)
+		{
+			ScheduledSound *sound = emitter->all_sounds + i;
+
+			if (sound->start + sound->sample_count > emitter->written_sample_count)
+			{
+				emitter->all_sounds[kept_count++] = *sound;
+			}
+		}
+
+		emitter->sound_count = kept_count;
+	}
+}
+
+// SAMPLES NULL for a beep. START is never before what was written.
+internal void schedule_sound(Emitter *emitter, i16 *samples, u64 sample_count, u64 start)
+{
+	if (emitter->sound_count == MAX_SCHEDULED_SOUND_COUNT)
+	{
+		// Cues that far behind (one waiting for the other): anything
+		// scheduled after this one starts after the first one ends.
+		ScheduledSound *first = emitter->all_sounds;
+		advance(emitter, first->start + first->sample_count);
+	}
+
+	ScheduledSound *sound = emitter->all_sounds + emitter->sound_count++;
+
+	sound->samples		= samples;
+	sound->sample_count = sample_count;
+	sound->start		= start;
+}
+
+internal void emit_period(Period *period, void *data)
+{
+	Emitter *emitter = (Emitter *) data;
+
+	emitter->tempo		 = emitter->beeps ? period->tempo : NULL;
+	emitter->tempo_start = period->start;
+	emitter->tempo_end	 = period->end;
+
+	// Cues ending at a given time start as long before it as they take
+	// (but not before the period), as in schedule_cue.
+	for (int i = 0; i < period->cue_count; ++i)
+	{
+		PlannedCue *cue = period->all_cues + i;
+		Clip *clip = find_clip(emitter->clips, cue->text);
+
+		u64 length = clip ? clip->sample_count : 0;
+
+		cue->start = cue->at;
+
+		if (cue->flags & CUE_ENDS_AT)
+		{
+			cue->start = (cue->at > length) ? cue->at - length : 0;
+		}
+
+		cue->start = MAX(cue->start, period->start);
+
+		// In the order they start (the order they were planned in, if
+		// they start together).
+		for (int j = i; (j > 0) && (period->all_cues[j - 1].start > period->all_cues[j].start); --j)
+		{
+			SWAP(PlannedCue, period->all_cues[j - 1], period->all_cues[j]);
+		}
+	}
+
+	for (int i = 0; i < period->cue_count; ++i)
+	{
+		PlannedCue *cue = period->all_cues + i;
+		Clip *clip = find_clip(emitter->clips, cue->text);
+
+		advance(emitter, cue->start);
+
+		if (!clip || !clip->sample_count)
+		{
+			continue;
+		}
+
+		// Not worth saying late, or over another cue.
+		if ((cue->flags & CUE_OPTIONAL) && (emitter->speech_end > cue->start))
+		{
+			continue;
+		}
+
+		u64 start = MAX(cue->start, emitter->speech_end);
+
+		schedule_sound(emitter, clip->samples, clip->sample_count, start);
+		emitter->speech_end = start + clip->sample_count;
+	}
+
+	advance(emitter, period->end);
+
+	if (emitter->beeps && period->beep)
+	{
+		schedule_sound(emitter, NULL, BEEP_SAMPLE_COUNT, period->end);
+	}
+}
+
+internal void put_u16(u8 *at, u16 value)
+{
+	at[0] = value & 0xFF;
+	at[1] = (value >> 8) & 0xFF;
+}
+
+internal void put_u32(u8 *at, u32 value)
+{
+	put_u16(at, value & 0xFFFF);
+	put_u16(at + 2, value >> 16);
+}
+
+// SAMPLE_COUNT unknown (UINT64_MAX) while it is being written: most
+// players then read until the end of the file.
+internal void write_wav_header(FILE *file, u64 sample_count)
+{
+	u8 header[44];
+
+	u64 data_size = sample_count * sizeof(i16);
+	u32 size = (data_size > UINT32_MAX - 36) ? UINT32_MAX - 36 : (u32) data_size;
+
+	memcpy(header, "RIFF", 4);
+	put_u32(header + 4, size + 36);
+	memcpy(header + 8, "WAVEfmt ", 8);
+
+	put_u32(header + 16, 16);
+	put_u16(header + 20, 1);			// PCM
+	put_u16(header + 22, 1);			// Mono
+	put_u32(header + 24, METRONOME_SAMPLE_RATE);
+	put_u32(header + 28, METRONOME_SAMPLE_RATE * sizeof(i16));
+	put_u16(header + 32, sizeof(i16));
+	put_u16(header + 34, 16);
+
+	memcpy(header + 36, "data", 4);
+	put_u32(header + 40, size);
+
+	fwrite(header, 1, sizeof(header), file);
+}
+
+b32 render_session_audio(Config *config, Program *all_programs, int program_count,
+						 char *path, b32 beeps)
+{
+	b32 to_stdout = (strcmp(path, "-") == 0);
+	FILE *file = to_stdout ? stdout : fopen(path, "wb");
+
+	if (!file)
+	{
+		perror(path);
+		return false;
+	}
+
+	u64 start_time = get_monotonic_ns();
+
+	ClipSet *clips = (ClipSet *) calloc(1, sizeof(ClipSet));
+
+	clips->command = &config->render_tts;
+
+	// Every cue is said before anything is written, each once.
+	plan_session(config, all_programs, program_count, collect_cues, clips);
+	say_clips(clips);
+
+	if (clips->failed_count)
+	{
+		fprintf(stderr, "%s: %d cue%s could not be said (see render_tts), left silent.\n",
+				PROGRAM, clips->failed_count, (clips->failed_count > 1) ? "s" : "");
+	}
+
+	Emitter *emitter = (Emitter *) calloc(1, sizeof(Emitter));
+	emitter->file  = file;
+	emitter->clips = clips;
+	emitter->beeps = beeps;
+
+	write_wav_header(file, UINT64_MAX);
+
+	plan_session(config, all_programs, program_count, emit_period, emitter);
+
+	u64 end = emitter->speech_end;
+
+	for (int i = 0; i < emitter->sound_count; ++i)
+	{
+		end = MAX(end, emitter->all_sounds[i].start + emitter->all_sounds[i].sample_count);
+	}
+
+	advance(emitter, end + RENDER_TAIL_SAMPLE_COUNT);
+
+	u64 sample_count = emitter->written_sample_count;
+	b32 result = !emitter->failed;
+
+	// NOTE: Not possible on a pipe, the sizes are left unknown then.
+	if (!to_stdout && (fseek(file, 0, SEEK_SET) == 0))
+	{
+		write_wav_header(file, sample_count);
+	}
+
+	if ((fflush(file) != 0) || (!to_stdout && (fclose(file) != 0)))
+	{
+		result = false;
+	}
+
+	if (!result)
+	{
+		perror(path);
+	}
+	else if (!to_stdout)
+	{
+		u64 seconds = sample_count / METRONOME_SAMPLE_RATE;
+		u64 elapsed_ms = (get_monotonic_ns() - start_time) / 1000000ULL;
+
+		printf("%s: %lluh%02llum%02llus of audio (%d different cues), rendered in %.02fs.\n", path,
+			   (unsigned long long) (seconds / 3600), (unsigned long long) ((seconds / 60) % 60),
+			   (unsigned long long) (seconds % 60), clips->clip_count, elapsed_ms / 1000.0);
+	}
+
+	for (int i = 0; i < clips->clip_count; ++i)
+	{
+		free(clips->all_clips[i].samples);
+	}
+
+	free(clips);
+	free(emitter);
+
+	return result;
+}
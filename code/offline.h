@@ -0,0 +1,16 @@
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include "common.h"
+
+// Renders the whole session of ALL_PROGRAMS (see run_session) to a WAV
+// file (16 bit, 48000 Hz, mono), without waiting for it to happen: cues
+// said when they would be, silence in between, and, if BEEPS, the
+// metronome's clicks and a beep at the end of each countdown.
+// Sets without a duration last REP_SET_DURATION.
+// PATH can be "-" (stdout).
+// Returns false if the file could not be written.
+b32 render_session_audio(Config *config, Program *all_programs, int program_count,
+						 char *path, b32 beeps);
+
+#endif
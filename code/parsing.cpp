@@ -1,3 +1,7 @@
+#include <errno.h>
+
+#include "intern.h"
+#include "library.h"
 #include "parsing.h"
 
 internal char *skip_space(char *s)
@@ -219,6 +223,26 @@ int parse_config_file(char *filename, Config *config)
 		{
 			parse_command(&config->music_off, right_side, len_right_side);
 		}
+		else if (same_string("metronome", left_side, len_left_side))
+		{
+			parse_command(&config->metronome, right_side, len_right_side);
+		}
+		else if (same_string("render_tts", left_side, len_left_side))
+		{
+			parse_command(&config->render_tts, right_side, len_right_side);
+		}
+		else if (same_string("mixer", left_side, len_left_side))
+		{
+			parse_command(&config->mixer, right_side, len_right_side);
+		}
+		else if (same_string("mixer_file", left_side, len_left_side))
+		{
+			snprintf(config->mixer_file, sizeof(config->mixer_file), "%s", right_side);
+		}
+		else if (same_string("music_source", left_side, len_left_side))
+		{
+			parse_command(&config->music_source, right_side, len_right_side);
+		}
 		else if (same_string("default_program", left_side, len_left_side))
 		{
 			size_t actual_len = MIN(ARRAY_SIZE(config->default_program) - 1, len_left_side);
@@ -227,9 +251,12 @@ int parse_config_file(char *filename, Config *config)
 		}
 		else if (same_string("setup_time", left_side, len_left_side))
 		{
-			// TODO/FIXME: Use strtol instead of atoi (check for convertion success).
-			//             Check bounds for each value (< 0 and overflow).
-			config->setup_time = atoi(right_side);
+			if (!parse_duration(right_side, right_side + strlen(right_side), &config->setup_time))
+			{
+				fprintf(stderr, "%s: config (line %d): invalid setup_time '%s' (e.g: 3, 1.5s, 500ms).\n",
+						PROGRAM, line_count, right_side);
+				++num_errors;
+			}
 		}
 		else if (same_string("tts", left_side, len_left_side))
 		{
@@ -263,303 +290,841 @@ int parse_config_file(char *filename, Config *config)
 	return num_errors;
 }
 
-int parse_program_file(char *filename, Program *all_programs,
-					   int *program_count, int max_program_count)
+int load_config_file(char *filename, Config *config, b32 voice_off, b32 music_off)
 {
-	FILE *file;
-	char *base_filename = basename(filename);
+	int result = parse_config_file(filename, config);
 
-	if (!(file = fopen(filename, "r")))
+	if (voice_off)
 	{
-		fprintf(stderr, "%s: %s: no such program.\n", PROGRAM, base_filename);
-		return 1;
+		config->voice_on = false;
 	}
 
-	 
-#define PARSING_NAME       0
-#define PARSING_PROPERTIES 1
-#define PARSING_END        2
+	if (music_off)
+	{
+		config->music_init.argc	  = 0;
+		config->music_on.argc	  = 0;
+		config->music_off.argc	  = 0;
+		config->music_source.argc = 0;
+	}
 
-#define PROGRAM_TYPE_UNKNOWN   0
-#define PROGRAM_TYPE_SELF      1
-#define PROGRAM_TYPE_REFERENCE 2
+	if (!config->setup_time)
+	{
+		config->setup_time = DEFAULT_SETUP_TIME;
+	}
 
-	if ((*program_count) == max_program_count)
+	if (!config->render_tts.argc)
 	{
-		fprintf(stderr, "%s: %s: exceeding maximum program count.\n", PROGRAM, base_filename);
-		return 1;
+		char *all_arguments[] = { DEFAULT_RENDER_TTS };
+
+		init_command(&config->render_tts, all_arguments[0], strlen(all_arguments[0]));
+
+		for (size_t i = 1; i < ARRAY_SIZE(all_arguments); ++i)
+		{
+			add_argument(&config->render_tts, all_arguments[i], strlen(all_arguments[i]));
+		}
 	}
 
-	// In case a reference to a program is in there.
-	char dir_filename[256];
-	size_t actual_dir_len = MIN(ARRAY_SIZE(dir_filename) - 1, strlen(filename));
-	
-	strncpy(dir_filename, filename, actual_dir_len);
-	dir_filename[actual_dir_len] = '\0';
-	dirname(dir_filename);
-	
-	char padded_buffer[256],
-		 *buffer;
-	int parsing_type = PARSING_NAME;
+	return result;
+}
+
+// Returns false if S is not a whole number between MIN and MAX.
+internal b32 parse_number(char *s, long min, long max, long *value)
+{
+	char *end;
 
-	int error_count = 0; 
+	errno = 0;
+	*value = strtol(s, &end, 10);
 
-	Program *program = all_programs + (*program_count)++;
-	Exercise *new_exercise = program->all_exercises + program->current_exercise;
+	return ((end != s) && (*end == '\0') && (errno == 0) &&
+			(*value >= min) && (*value <= max));
+}
 
-	int program_file_type = PROGRAM_TYPE_UNKNOWN;
+// Syntax: KEY=VALUE, KEY being one of 'series', 'tempo', 'duration',
+// 'milestone' or 'pause' (values written as on a properties line).
+// Returns NULL if it was set, or why it was not.
+internal const char *set_exercise_property(Exercise *exercise, char *key, size_t len_key, char *value)
+{
+	u32 *duration = NULL;
 
-	// Syntax:
-    //  EXERCISE_NAME
-    //  SERIES PAUSE_DURATION or SERIES DURATION PAUSE_DURATION
-    //
-    //  EXERCISE_NAME
-    //  ...
-	//
-	// OR
-	// 
-	// @PROGRAM_NAME
-	// ...
-	while (fgets(padded_buffer, sizeof(padded_buffer), file))
+	if (same_string("series", key, len_key))
 	{
-		buffer = skip_space(padded_buffer);
+		long series_count;
 
-		char *comment_start_pos = strchr(buffer, '#');
+		if (!parse_number(value, 1, UINT8_MAX, &series_count))
+		{
+			return "must be between 1 and 255";
+		}
+
+		exercise->series_count = series_count;
+	}
+	else if (same_string("tempo", key, len_key))
+	{
+		u16 tempo[TEMPO_PHASE_COUNT];
+
+		if (!parse_tempo(value, value + strlen(value), tempo))
+		{
+			return "e.g: 3-1-2-0, at most 60s a phase";
+		}
+
+		memcpy(exercise->tempo, tempo, sizeof(tempo));
+	}
+	else if (same_string("duration", key, len_key))
+	{
+		duration = &exercise->duration;
+	}
+	else if (same_string("milestone", key, len_key))
+	{
+		duration = &exercise->milestone;
+	}
+	else if (same_string("pause", key, len_key))
+	{
+		duration = &exercise->pause_duration;
+	}
+	else
+	{
+		return "unknown property";
+	}
+
+	if (duration && !parse_duration(value, value + strlen(value), duration))
+	{
+		return "e.g: 90, 1.5s, 500ms, 2m";
+	}
+
+	return NULL;
+}
+
+internal int add_parsed_library_exercise(char *filename, int line_count, u32 id, Exercise *exercise)
+{
+	if (!exercise->name)
+	{
+		exercise->name = id;
+	}
+
+	if (add_library_exercise(id, exercise))
+	{
+		return 0;
+	}
+
+	if (find_library_exercise(id))
+	{
+		fprintf(stderr, "%s: %s (line %d): exercise '%s' is already defined.\n",
+				PROGRAM, filename, line_count, get_string(id));
+	}
+	else
+	{
+		fprintf(stderr, "%s: %s (line %d): too many exercises (max %d).\n",
+				PROGRAM, filename, line_count, MAX_LIBRARY_EXERCISE_COUNT);
+	}
+
+	return 1;
+}
+
+// Syntax:
+//  [ID]
+//  name=DISPLAYED_NAME   (ID by default)
+//  say=SPOKEN_NAME       (the displayed name by default)
+//  series=SERIES_COUNT   (1 by default)
+//  tempo=TEMPO
+//  duration=DURATION
+//  milestone=DURATION
+//  pause=DURATION
+//
+//  [ID]
+//  ...
+int parse_exercise_library(char *filename)
+{
+	FILE *file;
+
+	if (!(file = fopen(filename, "r")))
+	{
+		return -1;
+	}
+
+	char *base_filename = basename(filename);
+
+	char buffer[1024];
+	int line_count = 0;
+	int num_errors = 0;
+
+	// EMPTY_STRING_ID before the first "[ID]", or after an invalid one.
+	u32 id = EMPTY_STRING_ID;
+	int id_line = 0;
+	b32 has_id_line = false;
+	Exercise exercise = {};
+
+	while (fgets(buffer, sizeof(buffer), file))
+	{
+		++line_count;
+
+		char *line = skip_space(buffer);
+		char *comment_start_pos = strchr(line, '#');
 
 		if (comment_start_pos)
 		{
-			if (comment_start_pos == buffer)
-			{
-				continue;
-			}			
-			
 			*comment_start_pos = '\0';
 		}
-	
-		if (*buffer == '\n')
+
+		size_t len_line = strlen(line);
+
+		while (len_line && ((line[len_line - 1] == '\n') || (line[len_line - 1] == ' ') ||
+							(line[len_line - 1] == '\t')))
+		{
+			line[--len_line] = '\0';
+		}
+
+		if (!len_line)
+		{
+			continue;
+		}
+
+		if (line[0] == '[')
 		{
-			if (parsing_type == PARSING_PROPERTIES)
+			if (id != EMPTY_STRING_ID)
 			{
-				fprintf(stderr, "%s: %s: no properties given for exercise '%s'.\n",
-						PROGRAM, base_filename, new_exercise->name);
-				
-				parsing_type = PARSING_NAME;
+				num_errors += add_parsed_library_exercise(base_filename, id_line, id, &exercise);
+			}
+
+			id = EMPTY_STRING_ID;
+			has_id_line = true;
+			memset(&exercise, 0, sizeof(exercise));
+			exercise.series_count = 1;
+
+			// NOTE: Programs give ids as single words, followed by
+			//       overrides.
+			if ((line[len_line - 1] != ']') || (len_line < 3) || strpbrk(line, " \t="))
+			{
+				fprintf(stderr, "%s: %s (line %d): invalid exercise id '%s' (e.g: [plank], without spaces).\n",
+						PROGRAM, base_filename, line_count, line);
+				++num_errors;
 
-				++error_count;
-				
 				continue;
 			}
-			else if (parsing_type == PARSING_END)
+
+			id = intern_string(line + 1, len_line - 2);
+			id_line = line_count;
+
+			continue;
+		}
+
+		char *equal_sign_pos = strchr(line, '=');
+
+		if (!equal_sign_pos)
+		{
+			fprintf(stderr, "%s: %s (line %d): missing '='.\n", PROGRAM, base_filename, line_count);
+			++num_errors;
+
+			continue;
+		}
+
+		// After an invalid id, already reported.
+		if (id == EMPTY_STRING_ID)
+		{
+			if (!has_id_line)
 			{
-				++new_exercise;
-				++program->exercise_count;
-				parsing_type = PARSING_NAME;
+				fprintf(stderr, "%s: %s (line %d): property given before any exercise id (e.g: [plank]).\n",
+						PROGRAM, base_filename, line_count);
+				++num_errors;
 			}
-			else
+
+			continue;
+		}
+
+		char *key = line;
+		char *end_key = skip_space_b(equal_sign_pos - 1, line);
+		size_t len_key = end_key + 1 - key;
+
+		char *value = skip_space(equal_sign_pos + 1);
+
+		if (same_string("name", key, len_key) || same_string("say", key, len_key))
+		{
+			if (!*value)
 			{
-				// Skipping newlines in between exercises.
+				fprintf(stderr, "%s: %s (line %d): empty %.*s for exercise '%s'.\n",
+						PROGRAM, base_filename, line_count, (int) len_key, key, get_string(id));
+				++num_errors;
+
+				continue;
 			}
-			
+
+			u32 *name = (key[0] == 'n') ? &exercise.name : &exercise.spoken_name;
+			*name = intern_string(value);
+
 			continue;
 		}
 
-		switch (parsing_type)
+		const char *error = set_exercise_property(&exercise, key, len_key, value);
+
+		if (error)
 		{
-			case PARSING_NAME:
-			{
-				if (program->current_exercise == ARRAY_SIZE(program->all_exercises))
-				{
-					fprintf(stderr, "%s: %s: number of exercises per program excedeed.\n",
-							PROGRAM, base_filename);
+			fprintf(stderr, "%s: %s (line %d): invalid %.*s '%s' for exercise '%s' (%s).\n",
+					PROGRAM, base_filename, line_count, (int) len_key, key, value, get_string(id), error);
+			++num_errors;
+		}
+	}
+
+	if (id != EMPTY_STRING_ID)
+	{
+		num_errors += add_parsed_library_exercise(base_filename, id_line, id, &exercise);
+	}
+
+	fclose(file);
+
+	return num_errors;
+}
+
+void init_program_parser(ProgramParser *parser, char *filename, Program *program, FILE *errors)
+{
+	parser->filename = filename;
+	parser->errors	 = errors;
+	parser->program	 = program;
+
+	parser->line_count	  = 0;
+	parser->error_count	  = 0;
+	parser->warning_count = 0;
+
+	parser->state = PROGRAM_PARSING_NAME;
+	parser->type  = PROGRAM_TYPE_UNKNOWN;
+
+	parser->reference_count = 0;
+	parser->repeat_count	= 1;
+}
+
+#define PARSER_ERROR(parser, format, ...) do							\
+	{																	\
+		fprintf((parser)->errors, "%s: %s (line %d): " format "\n",		\
+				PROGRAM, (parser)->filename, (parser)->line_count, ##__VA_ARGS__); \
+		++(parser)->error_count;										\
+	} while (0)
+
+internal void commit_exercise(ProgramParser *parser)
+{
+	++parser->program->exercise_count;
+	parser->state = PROGRAM_PARSING_NAME;
+}
+
+internal b32 set_program_type(ProgramParser *parser, int type)
+{
+	if (parser->type == PROGRAM_TYPE_UNKNOWN)
+	{
+		parser->type = type;
+	}
+	else if (parser->type != type)
+	{
+		PARSER_ERROR(parser, "mixing references and non references is not allowed.");
+
+		parser->state = PROGRAM_PARSING_STOPPED;
+		return false;
+	}
+
+	return true;
+}
+
+// Syntax:
+//  EXERCISE_NAME
+//  SERIES [DURATION] [MILESTONE] PAUSE_DURATION
+//
+//  $EXERCISE_ID [PROPERTY=VALUE]...
+//
+//  EXERCISE_NAME
+//  ...
+//
+// OR
+//
+// @PROGRAM_NAME [xREPEAT_COUNT]
+// ...
+int parse_program_line(ProgramParser *parser, char *line, char **reference)
+{
+	if (parser->state == PROGRAM_PARSING_STOPPED)
+	{
+		return PROGRAM_LINE_STOP;
+	}
+
+	++parser->line_count;
+
+	Program *program = parser->program;
+	Exercise *new_exercise = program->all_exercises + program->exercise_count;
+
+	char *buffer = skip_space(line);
+
+	char *comment_start_pos = strchr(buffer, '#');
+
+	if (comment_start_pos)
+	{
+		if (comment_start_pos == buffer)
+		{
+			return PROGRAM_LINE_OK;
+		}
 
-					++error_count;
+		*comment_start_pos = '\0';
+	}
 
-					return error_count;
+	size_t len_buffer = strlen(buffer);
+
+	if ((len_buffer > 0) && (buffer[len_buffer - 1] == '\n'))
+	{
+		buffer[--len_buffer] = '\0';
+	}
 
+	if (len_buffer)
+	{
+		char *end_buffer = skip_space_b(buffer + len_buffer - 1, buffer);
+		*(++end_buffer) = '\0';
+
+		len_buffer = end_buffer - buffer;
+	}
+
+	if (!len_buffer)
+	{
+		if (parser->state == PROGRAM_PARSING_PROPERTIES)
+		{
+			PARSER_ERROR(parser, "no properties given for exercise '%s'.", get_string(new_exercise->name));
+
+			parser->state = PROGRAM_PARSING_NAME;
+		}
+		else if (parser->state == PROGRAM_PARSING_END)
+		{
+			commit_exercise(parser);
+		}
+		else
+		{
+			// Skipping newlines in between exercises.
+		}
+
+		return PROGRAM_LINE_OK;
+	}
+
+	switch (parser->state)
+	{
+		// A name right after some properties (the empty line in
+		// between is missing).
+		case PROGRAM_PARSING_END:
+		{
+			PARSER_ERROR(parser, "missing empty line after exercise '%s'.", get_string(new_exercise->name));
+
+			commit_exercise(parser);
+			++new_exercise;
+		}
+		// Fall through
+
+		case PROGRAM_PARSING_NAME:
+		{
+			// Reference to another program file.
+			if (buffer[0] == '@')
+			{
+				if (!set_program_type(parser, PROGRAM_TYPE_REFERENCE))
+				{
+					return PROGRAM_LINE_STOP;
 				}
-				
-				size_t len_buffer = strlen(buffer);
 
-				if (buffer[len_buffer - 1] == '\n')
+				if (parser->reference_count == MAX_PROGRAM_REFERENCE_COUNT)
 				{
-					buffer[len_buffer - 1] = '\0';
-					--len_buffer;
+					PARSER_ERROR(parser, "number of references per program exceeded (max %d).",
+								 MAX_PROGRAM_REFERENCE_COUNT);
+
+					parser->state = PROGRAM_PARSING_STOPPED;
+					return PROGRAM_LINE_STOP;
 				}
-				
-				char *end_buffer = buffer + len_buffer - 1;
 
-				end_buffer = skip_space_b(end_buffer, buffer);
-				*(++end_buffer) = '\0';
+				char *name = skip_space(buffer + 1);
+				char *end_name = buffer + len_buffer;
+
+				parser->repeat_count = 1;
 
-				len_buffer = end_buffer - buffer;
+				// "xN" after the name.
+				char *last_word = end_name;
 
-				if (len_buffer >= ARRAY_SIZE(new_exercise->name))
+				while ((last_word > name) && (last_word[-1] != ' ') && (last_word[-1] != '\t'))
 				{
-					fprintf(stderr, "%s: %s: %.*s... is too long (max %zu characters), truncated...\n",
-							PROGRAM, base_filename, (int) (ARRAY_SIZE(new_exercise->name) - 3),
-							buffer, ARRAY_SIZE(new_exercise->name) - 1);
+					--last_word;
 				}
 
-				// Reference to another program file.
-				if (buffer[0] == '@')
+				if ((last_word > name) && (last_word[0] == 'x') &&
+					(last_word[1] >= '0') && (last_word[1] <= '9'))
 				{
-					switch (program_file_type)
-					{
-						case PROGRAM_TYPE_UNKNOWN: { program_file_type = PROGRAM_TYPE_REFERENCE; } break;
-						case PROGRAM_TYPE_SELF:
-						{
-							fprintf(stderr, "%s: %s: mixing references and non references is not allowed.\n",
-									PROGRAM, base_filename);
-
-							++error_count;
-
-							return error_count;
-						}
-						default:
-						{
-							break;
-						}
-					}
-					
-					++buffer;
-					--len_buffer;
-
-					char program_file_name[256];
-					snprintf(program_file_name, sizeof(program_file_name) - 1,
-							 "%s/%.*s", dir_filename, (int) len_buffer, buffer);
-					
-					int program_error_count = parse_program_file(program_file_name, all_programs,
-																 program_count, max_program_count);
-
-					if (program_error_count)
+					long repeat_count;
+
+					if (!parse_number(last_word + 1, 1, MAX_REFERENCE_REPEAT, &repeat_count))
 					{
-						--program_count;
+						PARSER_ERROR(parser, "invalid repeat count '%s' for program '%.*s' (must be between 1 and %d).",
+									 last_word, (int) (skip_space_b(last_word - 1, name) + 1 - name), name,
+									 MAX_REFERENCE_REPEAT);
+
+						return PROGRAM_LINE_OK;
 					}
-					
-					error_count += program_error_count;
 
-					parsing_type = PARSING_NAME;
-					continue;
+					parser->repeat_count = repeat_count;
+
+					end_name = skip_space_b(last_word - 1, name);
+					*(++end_name) = '\0';
 				}
 
-				// Self contained description of exercises.
-				switch (program_file_type)
+				++parser->reference_count;
+				*reference = name;
+
+				return PROGRAM_LINE_REFERENCE;
+			}
+
+			// Self contained description of exercises.
+			if (!set_program_type(parser, PROGRAM_TYPE_SELF))
+			{
+				return PROGRAM_LINE_STOP;
+			}
+
+			if (program->exercise_count == ARRAY_SIZE(program->all_exercises))
+			{
+				PARSER_ERROR(parser, "number of exercises per program exceeded (max %zu).",
+							 ARRAY_SIZE(program->all_exercises));
+
+				parser->state = PROGRAM_PARSING_STOPPED;
+				return PROGRAM_LINE_STOP;
+			}
+
+			// Exercise of the library, its properties (if any)
+			// following its id, on the same line.
+			if (buffer[0] == LIBRARY_EXERCISE_PREFIX)
+			{
+				char *save;
+				char *id = strtok_r(buffer + 1, " \t", &save);
+				Exercise *exercise = id ? find_library_exercise(intern_string(id)) : NULL;
+
+				if (!exercise)
 				{
-					case PROGRAM_TYPE_UNKNOWN: { program_file_type = PROGRAM_TYPE_SELF; } break;
-					case PROGRAM_TYPE_REFERENCE:
-					{
-						fprintf(stderr, "%s: %s: mixing references and non references is not allowed.\n",
-								PROGRAM, base_filename);
+					PARSER_ERROR(parser, "no exercise '%s' in the exercise library.", id ? id : "");
+					return PROGRAM_LINE_OK;
+				}
+
+				*new_exercise = *exercise;
 
-						++error_count;
+				b32 valid = true;
 
-						return error_count;
+				for (char *property = strtok_r(NULL, " \t", &save);
+					 property;
+					 property = strtok_r(NULL, " \t", &save))
+				{
+					char *equal_sign_pos = strchr(property, '=');
+					const char *error = "e.g: pause=60";
+
+					if (equal_sign_pos)
+					{
+						error = set_exercise_property(new_exercise, property, equal_sign_pos - property,
+													  equal_sign_pos + 1);
 					}
-					default:
+
+					if (error)
 					{
-						break;
+						PARSER_ERROR(parser, "invalid property '%s' for exercise '%s' (%s).",
+									 property, id, error);
+
+						valid = false;
 					}
 				}
-				
-				size_t actual_len = MIN(ARRAY_SIZE(new_exercise->name) - 1, len_buffer);
-				strncpy(new_exercise->name, buffer, actual_len);
-				new_exercise->name[actual_len] = '\0';
 
-				parsing_type = PARSING_PROPERTIES;
-		
+				if (valid)
+				{
+					parser->state = PROGRAM_PARSING_END;
+				}
+
 				break;
 			}
 
-			case PARSING_PROPERTIES:
-			{
-				char *start_number = buffer;
-				char *space_pos = strchr(start_number, ' ');
+			memset(new_exercise, 0, sizeof(*new_exercise));
+			new_exercise->name = intern_string(buffer, len_buffer);
 
-				if (!space_pos)
-				{
-					fprintf(stderr, "%s: %s: missing pause duration for exercise '%s'.\n",
-							PROGRAM, base_filename, new_exercise->name);
+			parser->state = PROGRAM_PARSING_PROPERTIES;
+
+			break;
+		}
+
+		case PROGRAM_PARSING_PROPERTIES:
+		{
+			// One more for the tempo.
+			char *all_properties[5];
+			int property_count = 0;
 
-					parsing_type = PARSING_NAME;
+			char *save;
 
-					++error_count;
-					
-					continue;
+			for (char *property = strtok_r(buffer, " \t", &save);
+				 property;
+				 property = strtok_r(NULL, " \t", &save))
+			{
+				if (property_count == ARRAY_SIZE(all_properties))
+				{
+					PARSER_ERROR(parser, "too many properties for exercise '%s'.", get_string(new_exercise->name));
+
+					parser->state = PROGRAM_PARSING_NAME;
+					return PROGRAM_LINE_OK;
 				}
 
-				// TODO/FIXME: Use strtol instead of atoi (check for convertion success).
-				//             Check bounds for each value (< 0 and overflow).
+				all_properties[property_count++] = property;
+			}
 
-				// FIXME: There seem to be too much code
-				// duplication. It may be done a better way.
-				
-				// Because atoi only takes null-terminated strings...
-				*space_pos = '\0';
-				new_exercise->series_count = atoi(start_number);
+			// The tempo is told apart by its dashes.
+			char *tempo = NULL;
 
-				start_number = skip_space(space_pos + 1);
+			if ((property_count > 2) && strchr(all_properties[1], '-'))
+			{
+				tempo = all_properties[1];
 
-				space_pos = strchr(start_number, ' ');
-				
-				// A duration for the exercise is given.
-				if (space_pos)
+				for (int i = 1; i < property_count - 1; ++i)
 				{
-					*space_pos = '\0';
-					new_exercise->duration = atoi(start_number);
-					
-					start_number = skip_space(space_pos + 1);
-
-					space_pos = strchr(start_number, ' ');
+					all_properties[i] = all_properties[i + 1];
 				}
 
-				if (space_pos)
-				{
-					*space_pos = '\0';
-					new_exercise->milestone = atoi(start_number);
-					
-					start_number = skip_space(space_pos + 1);
+				--property_count;
+			}
+			else if (property_count == ARRAY_SIZE(all_properties))
+			{
+				PARSER_ERROR(parser, "too many properties for exercise '%s'.", get_string(new_exercise->name));
 
-					space_pos = strchr(start_number, ' ');
-				}
+				parser->state = PROGRAM_PARSING_NAME;
+				return PROGRAM_LINE_OK;
+			}
 
-				if (space_pos)
-				{
-					fprintf(stderr, "%s: %s: too many properties for exercise '%s'.\n",
-							PROGRAM, base_filename, new_exercise->name);
+			if (property_count < 2)
+			{
+				PARSER_ERROR(parser, "missing pause duration for exercise '%s'.", get_string(new_exercise->name));
+
+				parser->state = PROGRAM_PARSING_NAME;
+				return PROGRAM_LINE_OK;
+			}
+
+			// SERIES [TEMPO] [DURATION] [MILESTONE] PAUSE_DURATION
+			char *all_property_names[4] = { "series count", "pause duration", 0, 0 };
+			u32 all_durations[4] = {};
+
+			if (property_count > 2)
+			{
+				all_property_names[1] = "duration";
+				all_property_names[property_count - 1] = "pause duration";
+			}
+
+			if (property_count > 3)
+			{
+				all_property_names[2] = "milestone";
+			}
+
+			b32 valid = true;
+			long series_count;
+
+			if (!parse_number(all_properties[0], 1, UINT8_MAX, &series_count))
+			{
+				PARSER_ERROR(parser, "invalid series count '%s' for exercise '%s' (must be between 1 and %d).",
+							 all_properties[0], get_string(new_exercise->name), UINT8_MAX);
+
+				valid = false;
+			}
 
-					parsing_type = PARSING_NAME;
+			if (tempo && !parse_tempo(tempo, tempo + strlen(tempo), new_exercise->tempo))
+			{
+				PARSER_ERROR(parser, "invalid tempo '%s' for exercise '%s' (e.g: 3-1-2-0, at most %ds a phase).",
+							 tempo, get_string(new_exercise->name), MAX_TEMPO_PHASE / 1000);
+
+				valid = false;
+			}
 
-					++error_count;
-						
-					continue;
+			for (int i = 1; i < property_count; ++i)
+			{
+				char *property = all_properties[i];
+
+				if (!parse_duration(property, property + strlen(property), all_durations + i))
+				{
+					PARSER_ERROR(parser, "invalid %s '%s' for exercise '%s' (e.g: 90, 1.5s, 500ms, 2m).",
+								 all_property_names[i], property, get_string(new_exercise->name));
+
+					valid = false;
 				}
+			}
 
-				new_exercise->pause_duration = atoi(start_number);
-				
-				parsing_type = PARSING_END;
-				break;
+			if (!valid)
+			{
+				parser->state = PROGRAM_PARSING_NAME;
+				return PROGRAM_LINE_OK;
 			}
 
-			default:
+			new_exercise->series_count	 = series_count;
+			new_exercise->pause_duration = all_durations[property_count - 1];
+
+			if (property_count > 2)
 			{
-				break;
+				new_exercise->duration = all_durations[1];
+			}
+
+			if (property_count > 3)
+			{
+				new_exercise->milestone = all_durations[2];
 			}
+
+			parser->state = PROGRAM_PARSING_END;
+			break;
+		}
+
+		default:
+		{
+			break;
 		}
 	}
 
+	return PROGRAM_LINE_OK;
+}
+
+int end_program_parsing(ProgramParser *parser)
+{
 	// File may not end with a '\n'.
-	if (parsing_type == PARSING_END)
+	if (parser->state == PROGRAM_PARSING_END)
 	{
-		++program->exercise_count;
+		commit_exercise(parser);
 	}
+	else if (parser->state == PROGRAM_PARSING_PROPERTIES)
+	{
+		Program *program = parser->program;
 
-#undef PROGRAM_TYPE_UNKNOWN
-#undef PROGRAM_TYPE_SELF
-#undef PROGRAM_TYPE_REFERENCE
-	
-#undef PARSING_NAME
-#undef PARSING_PROPERTIES
-#undef PARSING_END
+		PARSER_ERROR(parser, "no properties given for exercise '%s'.",
+					 get_string(program->all_exercises[program->exercise_count].name));
+	}
+
+	parser->state = PROGRAM_PARSING_STOPPED;
+
+	return parser->error_count;
+}
+
+#undef PARSER_ERROR
+
+// Files parsed by a single parse_program_file, so each is parsed once.
+struct ProgramFiles
+{
+	// Index of the first program they were parsed into.
+	int first_program;
+
+	char all_paths[MAX_PROGRAM_COUNT][512];
+
+	// Still being parsed: a reference to it is a cycle.
+	b32 all_open[MAX_PROGRAM_COUNT];
+
+	// See parse_program_file, NULL if not asked for.
+	u32 *all_file_names;
+};
+
+// *INDEX is set to FILENAME's program (parsed already or not).
+internal int parse_program_file(ProgramFiles *files, char *filename, Program *all_programs,
+								int *program_count, int max_program_count, int *index)
+{
+	FILE *file;
+	char *base_filename = basename(filename);
+
+	// The same file, however it is referenced.
+	char path[512];
+	char *resolved_path = realpath(filename, NULL);
+
+	snprintf(path, sizeof(path), "%s", resolved_path ? resolved_path : filename);
+	free(resolved_path);
+
+	for (int i = files->first_program; i < *program_count; ++i)
+	{
+		if (strcmp(files->all_paths[i - files->first_program], path) == 0)
+		{
+			if (files->all_open[i - files->first_program])
+			{
+				fprintf(stderr, "%s: %s: reference cycle.\n", PROGRAM, base_filename);
+				return 1;
+			}
+
+			*index = i;
+			return 0;
+		}
+	}
+
+	if (!(file = fopen(filename, "r")))
+	{
+		fprintf(stderr, "%s: %s: no such program.\n", PROGRAM, base_filename);
+		return 1;
+	}
+
+	if ((*program_count) == max_program_count)
+	{
+		fprintf(stderr, "%s: %s: exceeding maximum program count.\n", PROGRAM, base_filename);
+
+		fclose(file);
+		return 1;
+	}
+
+	// In case a reference to a program is in there.
+	char dir_filename[256];
+	size_t actual_dir_len = MIN(ARRAY_SIZE(dir_filename) - 1, strlen(filename));
+
+	strncpy(dir_filename, filename, actual_dir_len);
+	dir_filename[actual_dir_len] = '\0';
+	dirname(dir_filename);
+
+	*index = (*program_count)++;
+
+	Program *program = all_programs + *index;
+	int file_index = *index - files->first_program;
+
+	memcpy(files->all_paths[file_index], path, sizeof(path));
+	files->all_open[file_index] = true;
+
+	if (files->all_file_names)
+	{
+		files->all_file_names[*index] = intern_string(base_filename);
+	}
+
+	ProgramParser parser;
+	init_program_parser(&parser, base_filename, program, stderr);
+
+	// Lines, so exercise names, can be of any length.
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+
+	while (getline(&buffer, &buffer_size, file) != -1)
+	{
+		char *reference;
+		int result = parse_program_line(&parser, buffer, &reference);
+
+		if (result == PROGRAM_LINE_STOP)
+		{
+			break;
+		}
+
+		if (result == PROGRAM_LINE_REFERENCE)
+		{
+			char program_file_name[512];
+			snprintf(program_file_name, sizeof(program_file_name), "%s/%s", dir_filename, reference);
+
+			int target;
+			int error_count = parse_program_file(files, program_file_name, all_programs,
+												 program_count, max_program_count, &target);
+
+			parser.error_count += error_count;
+
+			// Nothing to run in there: not worth walking through (see
+			// next_program), let alone N times.
+			if (!error_count &&
+				(all_programs[target].exercise_count || all_programs[target].reference_count))
+			{
+				int i = program->reference_count++;
+
+				program->all_reference_targets[i] = target;
+				program->all_reference_repeats[i] = parser.repeat_count;
+			}
+		}
+	}
+
+	free(buffer);
+	fclose(file);
+
+	files->all_open[file_index] = false;
+
+	return end_program_parsing(&parser);
+}
+
+int parse_program_file(char *filename, Program *all_programs,
+					   int *program_count, int max_program_count, u32 *all_file_names)
+{
+	ProgramFiles files;
+	files.first_program	 = *program_count;
+	files.all_file_names = all_file_names;
+
+	int index;
 
-	return error_count;
+	return parse_program_file(&files, filename, all_programs, program_count, max_program_count, &index);
 }
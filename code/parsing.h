@@ -3,8 +3,207 @@
 
 #include "common.h"
 
+enum ProgramParsingState
+{
+	PROGRAM_PARSING_NAME,
+	PROGRAM_PARSING_PROPERTIES,
+	PROGRAM_PARSING_END,
+	PROGRAM_PARSING_STOPPED,
+};
+
+enum ProgramType
+{
+	PROGRAM_TYPE_UNKNOWN,
+	PROGRAM_TYPE_SELF,
+	PROGRAM_TYPE_REFERENCE,
+};
+
+enum ProgramLineResult
+{
+	PROGRAM_LINE_OK,
+	PROGRAM_LINE_REFERENCE,		// The line is a reference to another program.
+	PROGRAM_LINE_STOP,			// Nothing else can be parsed.
+};
+
+// Parses a program one line at a time, without following references
+// to other programs (that is up to the caller).
+struct ProgramParser
+{
+	// For messages only.
+	char *filename;
+	FILE *errors;
+
+	Program *program;
+
+	int line_count;
+	int error_count;
+	int warning_count;
+
+	int state;
+	int type;
+
+	int reference_count;
+
+	// How many times in a row the last reference is run ("@NAME xN").
+	u32 repeat_count;
+};
+
+// A comment starting with it lists the program's tags (e.g:
+// "# tags: upper, push"), see generate_session.
+#define PROGRAM_TAGS_PREFIX "# tags:"
+
+// Syntax: NUMBER[UNIT]
+//   NUMBER being a decimal number (e.g: 90, 1.5),
+//   UNIT one of 'ms', 's' (the default) or 'm'.
+// Returns false if [START, END) is not a duration, is more precise than
+// a millisecond, or does not fit in 32 bits.
+internal constexpr b32 parse_duration(const char *start, const char *end, u32 *duration)
+{
+	u64 number = 0;
+	u64 divisor = 1;
+
+	b32 has_digit = false,
+		has_dot = false;
+
+	const char *c = start;
+
+	for (; c < end; ++c)
+	{
+		if ((*c >= '0') && (*c <= '9'))
+		{
+			// Leaves room for the multiplication by the unit.
+			if (number > 100000000000ULL)
+			{
+				return false;
+			}
+
+			number = number * 10 + (*c - '0');
+			has_digit = true;
+
+			if (has_dot)
+			{
+				// Past that, it cannot be a whole number of milliseconds.
+				if (divisor > 1000000ULL)
+				{
+					return false;
+				}
+
+				divisor *= 10;
+			}
+		}
+		else if ((*c == '.') && !has_dot)
+		{
+			has_dot = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (!has_digit)
+	{
+		return false;
+	}
+
+	u64 unit = 1000;
+	size_t unit_len = end - c;
+
+	if ((unit_len == 2) && (c[0] == 'm') && (c[1] == 's'))
+	{
+		unit = 1;
+	}
+	else if ((unit_len == 1) && (c[0] == 'm'))
+	{
+		unit = 60000;
+	}
+	else if (!((unit_len == 0) || ((unit_len == 1) && (c[0] == 's'))))
+	{
+		return false;
+	}
+
+	u64 milliseconds = number * unit;
+
+	if ((milliseconds % divisor) ||
+		((milliseconds / divisor) > UINT32_MAX))
+	{
+		return false;
+	}
+
+	*duration = milliseconds / divisor;
+
+	return true;
+}
+
+// Syntax: ECCENTRIC-PAUSE-CONCENTRIC-PAUSE
+//   each phase being a duration (see parse_duration, e.g: 3-1-2-0).
+// Returns false if [START, END) is not a tempo, has a phase longer
+// than MAX_TEMPO_PHASE, or takes no time at all.
+internal constexpr b32 parse_tempo(const char *start, const char *end, u16 *tempo)
+{
+	u32 total = 0;
+
+	for (int i = 0; i < TEMPO_PHASE_COUNT; ++i)
+	{
+		const char *phase_end = start;
+
+		while ((phase_end < end) && (*phase_end != '-'))
+		{
+			++phase_end;
+		}
+
+		b32 is_last = (i == TEMPO_PHASE_COUNT - 1);
+		u32 phase = 0;
+
+		if ((is_last && (phase_end != end)) ||
+			(!is_last && (phase_end == end)) ||
+			!parse_duration(start, phase_end, &phase) ||
+			(phase > MAX_TEMPO_PHASE))
+		{
+			return false;
+		}
+
+		tempo[i] = phase;
+		total += phase;
+		start = phase_end + 1;
+	}
+
+	return (total > 0);
+}
+
 int parse_config_file(char *filename, Config *config);
+
+// Same as parse_config_file, voice and music being then turned off if
+// asked to (e.g: by -V and -M), and what was not given set to its
+// default.
+int load_config_file(char *filename, Config *config, b32 voice_off, b32 music_off);
+
+// Starts a program line naming an exercise of the library (e.g:
+// "$plank pause=60").
+#define LIBRARY_EXERCISE_PREFIX '$'
+
+// Adds the exercises of FILENAME to the exercise library (see
+// library.h).
+// Returns the number of errors, -1 if there is no such file.
+int parse_exercise_library(char *filename);
+
+void init_program_parser(ProgramParser *parser, char *filename, Program *program, FILE *errors);
+
+// NOTE: Modifies LINE. On PROGRAM_LINE_REFERENCE, *REFERENCE is set to
+//       the referenced program's name (pointing into LINE), and
+//       PARSER->repeat_count to how many times it is run.
+int  parse_program_line(ProgramParser *parser, char *line, char **reference);
+
+// Returns the number of errors.
+int  end_program_parsing(ProgramParser *parser);
+
+// Referenced programs are parsed once each, however many times they
+// are referenced, into ALL_PROGRAMS after FILENAME's own.
+// If ALL_FILE_NAMES is not NULL, it is given the name (interned, without
+// its directory) of the file each program was parsed from.
+// Returns the number of errors.
 int parse_program_file(char *filename, Program *all_programs,
-					   int *program_count, int max_program_count);
+					   int *program_count, int max_program_count,
+					   u32 *all_file_names = NULL);
 
 #endif
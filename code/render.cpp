@@ -0,0 +1,182 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "intern.h"
+#include "render.h"
+
+internal void write_message(RenderMessage *message)
+{
+	switch (message->type)
+	{
+		case RENDER_LINE:
+		{
+			printf("%s\n", get_string(message->value));
+			break;
+		}
+
+		case RENDER_STATUS:
+		{
+			printf("\r\033[K%s", get_string(message->value));
+			break;
+		}
+
+		case RENDER_TIME_LEFT:
+		{
+			printf("%.02fs\r", 0.01f * message->value);
+			break;
+		}
+
+		case RENDER_CLEAR:
+		{
+			printf("\r\033[K");
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+}
+
+internal void *render_thread(void *data)
+{
+	Renderer *renderer = (Renderer *) data;
+
+	for (;;)
+	{
+		RenderMessage message;
+
+		// Only the latest time left is worth showing.
+		RenderMessage time_left;
+		b32 has_time_left = false;
+
+		while (ring_pop(&renderer->messages, &message))
+		{
+			if (message.type == RENDER_TIME_LEFT)
+			{
+				time_left = message;
+				has_time_left = true;
+
+				continue;
+			}
+
+			if (has_time_left)
+			{
+				write_message(&time_left);
+				has_time_left = false;
+			}
+
+			if (message.type == RENDER_QUIT)
+			{
+				fflush(stdout);
+				return NULL;
+			}
+
+			write_message(&message);
+		}
+
+		if (has_time_left)
+		{
+			write_message(&time_left);
+		}
+
+		fflush(stdout);
+
+		u64 count;
+		read(renderer->wake_fd, &count, sizeof(count));
+	}
+}
+
+b32 renderer_start(Renderer *renderer)
+{
+	renderer->running = false;
+
+	if ((renderer->wake_fd = eventfd(0, EFD_CLOEXEC)) == -1)
+	{
+		perror("eventfd");
+		return false;
+	}
+
+	ring_init(&renderer->messages, sizeof(RenderMessage), 1024);
+
+	if (pthread_create(&renderer->thread, NULL, render_thread, renderer) != 0)
+	{
+		fprintf(stderr, "%s: could not start the render thread.\n", PROGRAM);
+
+		ring_free(&renderer->messages);
+		close(renderer->wake_fd);
+		return false;
+	}
+
+	renderer->running = true;
+
+	return true;
+}
+
+// Without a thread, written right away.
+internal void send_message(Renderer *renderer, u32 type, u32 value)
+{
+	RenderMessage message = { type, value };
+
+	if (!renderer->running)
+	{
+		write_message(&message);
+		fflush(stdout);
+
+		return;
+	}
+
+	// Full: the terminal is that far behind, it misses this one.
+	if (ring_push(&renderer->messages, &message))
+	{
+		u64 one = 1;
+		write(renderer->wake_fd, &one, sizeof(one));
+	}
+}
+
+void renderer_stop(Renderer *renderer)
+{
+	if (!renderer->running)
+	{
+		return;
+	}
+
+	RenderMessage message = { RENDER_QUIT, 0 };
+
+	// Waits for room, the thread is not going anywhere else.
+	while (!ring_push(&renderer->messages, &message))
+	{
+		usleep(1000);
+	}
+
+	u64 one = 1;
+	write(renderer->wake_fd, &one, sizeof(one));
+
+	pthread_join(renderer->thread, NULL);
+
+	renderer->running = false;
+
+	close(renderer->wake_fd);
+	ring_free(&renderer->messages);
+}
+
+void render_line(Renderer *renderer, const char *text)
+{
+	send_message(renderer, RENDER_LINE, intern_string(text));
+}
+
+void render_status(Renderer *renderer, const char *text)
+{
+	send_message(renderer, RENDER_STATUS, intern_string(text));
+}
+
+void render_time_left(Renderer *renderer, u32 centiseconds)
+{
+	send_message(renderer, RENDER_TIME_LEFT, centiseconds);
+}
+
+void render_clear(Renderer *renderer)
+{
+	send_message(renderer, RENDER_CLEAR, 0);
+}
@@ -0,0 +1,56 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "ring.h"
+
+enum RenderType
+{
+	// TEXT, on a line of its own.
+	RENDER_LINE,
+
+	// TEXT, over the current line (e.g: the tempo phase).
+	RENDER_STATUS,
+
+	// VALUE is the time left, in centiseconds.
+	RENDER_TIME_LEFT,
+
+	RENDER_CLEAR,
+	RENDER_QUIT,
+};
+
+struct RenderMessage
+{
+	u32 type;
+
+	// Interned text, or a number (see RenderType).
+	u32 value;
+};
+
+// Terminal output, written by its own thread: a terminal that is slow
+// to scroll (or a stopped pager) never holds a countdown back.
+// Messages come from a single thread (the session's).
+struct Renderer
+{
+	SpscRing messages;
+
+	// Written to after each message, so the thread wakes up.
+	int wake_fd;
+
+	pthread_t thread;
+	b32 running;
+};
+
+b32 renderer_start(Renderer *renderer);
+
+// Once everything it was given has been written.
+void renderer_stop(Renderer *renderer);
+
+void render_line(Renderer *renderer, const char *text);
+void render_status(Renderer *renderer, const char *text);
+void render_time_left(Renderer *renderer, u32 centiseconds);
+void render_clear(Renderer *renderer);
+
+#endif
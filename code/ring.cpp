@@ -0,0 +1,59 @@
+#include "ring.h"
+
+void ring_init(SpscRing *ring, u32 element_size, u32 capacity)
+{
+	ring->capacity = 1;
+
+	while (ring->capacity < capacity)
+	{
+		ring->capacity *= 2;
+	}
+
+	ring->element_size = element_size;
+	ring->all_elements = (u8 *) malloc((size_t) ring->capacity * element_size);
+
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+void ring_free(SpscRing *ring)
+{
+	free(ring->all_elements);
+	ring->all_elements = NULL;
+}
+
+// NOTE: HEAD and TAIL only ever grow (wrapping around), the element
+//       being at their value modulo the capacity.
+b32 ring_push(SpscRing *ring, const void *element)
+{
+	u32 tail = ring->tail;
+
+	if (tail - ATOMIC_LOAD(&ring->head) == ring->capacity)
+	{
+		return false;
+	}
+
+	memcpy(ring->all_elements + (size_t) (tail & (ring->capacity - 1)) * ring->element_size,
+		   element, ring->element_size);
+
+	ATOMIC_STORE(&ring->tail, tail + 1);
+
+	return true;
+}
+
+b32 ring_pop(SpscRing *ring, void *element)
+{
+	u32 head = ring->head;
+
+	if (head == ATOMIC_LOAD(&ring->tail))
+	{
+		return false;
+	}
+
+	memcpy(element, ring->all_elements + (size_t) (head & (ring->capacity - 1)) * ring->element_size,
+		   ring->element_size);
+
+	ATOMIC_STORE(&ring->head, head + 1);
+
+	return true;
+}
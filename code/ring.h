@@ -0,0 +1,32 @@
+#ifndef RING_H
+#define RING_H
+
+#include "common.h"
+
+// Single producer, single consumer queue of fixed size elements,
+// without locks: neither side ever waits for the other (pushing to a
+// full ring fails, popping from an empty one too).
+struct SpscRing
+{
+	u8 *all_elements;
+	u32 element_size;
+
+	// A power of 2.
+	u32 capacity;
+
+	// Written by the consumer (next element to pop) and by the
+	// producer (next free one), on separate cache lines.
+	u32 head;
+	u8 head_padding[60];
+	u32 tail;
+	u8 tail_padding[60];
+};
+
+// CAPACITY is rounded up to a power of 2.
+void ring_init(SpscRing *ring, u32 element_size, u32 capacity);
+void ring_free(SpscRing *ring);
+
+b32 ring_push(SpscRing *ring, const void *element);
+b32 ring_pop(SpscRing *ring, void *element);
+
+#endif
@@ -0,0 +1,1642 @@
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "intern.h"
+#include "session.h"
+
+internal void publish_state(Session *session)
+{
+	status_page_write(&session->status_page, &session->dashboard_state);
+	dashboard_publish(session->dashboard, &session->dashboard_state);
+}
+
+internal SpeechLength *find_speech_length(Speech *speech, u32 text)
+{
+	for (int i = 0; i < speech->length_count; ++i)
+	{
+		if (speech->all_lengths[i].text == text)
+		{
+			return speech->all_lengths + i;
+		}
+	}
+
+	return NULL;
+}
+
+// DURATION in milliseconds.
+internal void record_speech_length(Speech *speech, u32 text, u32 duration)
+{
+	SpeechLength *length = find_speech_length(speech, text);
+
+	if (length)
+	{
+		// Smoothed, so a single slow run does not throw it off.
+		length->duration = (length->duration + duration) / 2;
+		return;
+	}
+
+	if (speech->length_count < MAX_SPEECH_LENGTH_COUNT)
+	{
+		length = speech->all_lengths + speech->length_count++;
+	}
+	else
+	{
+		length = speech->all_lengths + speech->next_replaced_length;
+		speech->next_replaced_length = (speech->next_replaced_length + 1) % MAX_SPEECH_LENGTH_COUNT;
+	}
+
+	length->text	 = text;
+	length->duration = duration;
+}
+
+// How long TEXT takes to say, in milliseconds: what it took last
+// time, or a guess if it was never said.
+internal u32 estimate_speech(Session *session, const char *text)
+{
+	if (!session->config->voice_on)
+	{
+		return 0;
+	}
+
+	SpeechLength *length;
+
+	if (session->speech && (length = find_speech_length(session->speech, intern_string(text))))
+	{
+		return length->duration;
+	}
+
+	// Roughly festival's default voice.
+	return 200 + 65 * strlen(text);
+}
+
+#define SPEECH_POLL_PERIOD_NS 10000000ULL
+
+// Takes note of how long every text the audio thread is done with
+// took to say.
+internal void collect_speech(Session *session)
+{
+	AudioEvent event;
+
+	while (audio_next_event(&session->audio, &event))
+	{
+		if (session->speech)
+		{
+			record_speech_length(session->speech, event.text, event.duration);
+		}
+	}
+}
+
+internal void poll_speech(Timer *timer, void *data)
+{
+	Session *session = (Session *) data;
+
+	collect_speech(session);
+
+	if (audio_is_busy(&session->audio))
+	{
+		timer_add(&session->wheel, timer, timer->deadline + SPEECH_POLL_PERIOD_NS, poll_speech, data);
+	}
+}
+
+internal b32 speech_is_busy(Session *session)
+{
+	return audio_is_busy(&session->audio);
+}
+
+// NOTE: Said by the audio thread, in the background (see audio_send).
+internal void speak(Session *session, const char *text)
+{
+	if (!session->config->voice_on)
+	{
+		return;
+	}
+
+	if (!audio_send(&session->audio, AUDIO_SAY, intern_string(text)))
+	{
+		// That far behind: this one is only shown.
+		return;
+	}
+
+	if (!timer_is_pending(&session->speech_timer))
+	{
+		timer_add(&session->wheel, &session->speech_timer,
+				  timer_wheel_now(&session->wheel) + SPEECH_POLL_PERIOD_NS,
+				  poll_speech, session);
+	}
+}
+
+void tts_say(Session *session, char *text)
+{
+	render_line(&session->renderer, text);
+	speak(session, text);
+}
+
+internal void say_cues(Session *session)
+{
+	if (session->pending_speech[0] == '\0')
+	{
+		return;
+	}
+
+	render_line(&session->renderer, session->pending_display);
+	speak(session, session->pending_speech);
+
+	session->pending_speech[0]	= '\0';
+	session->pending_display[0] = '\0';
+}
+
+const char *cue_separator(const char *speech, size_t speech_len)
+{
+	char last = speech[speech_len - 1];
+
+	// So it is said as two sentences.
+	return ((last == '.') || (last == '!') || (last == '?')) ? " " : ". ";
+}
+
+// Cues with nothing timed in between are said as one utterance (so
+// one speech process and one music toggle instead of one each) by
+// say_cues.
+// SPOKEN is what is said of TEXT (e.g: an exercise's spoken name).
+internal void queue_cue(Session *session, const char *text, const char *spoken)
+{
+	size_t text_len	   = strlen(text);
+	size_t spoken_len  = strlen(spoken);
+	size_t speech_len  = strlen(session->pending_speech);
+	size_t display_len = strlen(session->pending_display);
+
+	if ((speech_len + spoken_len + 3 > ARRAY_SIZE(session->pending_speech)) ||
+		(display_len + text_len + 2 > ARRAY_SIZE(session->pending_display)))
+	{
+		say_cues(session);
+
+		speech_len	= 0;
+		display_len = 0;
+	}
+
+	// A very long exercise name: said on its own.
+	if ((spoken_len >= ARRAY_SIZE(session->pending_speech)) ||
+		(text_len >= ARRAY_SIZE(session->pending_display)))
+	{
+		render_line(&session->renderer, text);
+		speak(session, spoken);
+
+		return;
+	}
+
+	if (speech_len)
+	{
+		strcat(session->pending_speech, cue_separator(session->pending_speech, speech_len));
+		strcat(session->pending_display, "\n");
+	}
+
+	strcat(session->pending_speech, spoken);
+	strcat(session->pending_display, text);
+}
+
+internal void queue_cue(Session *session, const char *text)
+{
+	queue_cue(session, text, text);
+}
+
+#define CHRONO_RENDER_PERIOD_NS 10000000ULL
+
+enum ChronoFlag
+{
+	// "3, 2, 1" before the end.
+	CHRONO_COUNT_IN	  = 1 << 0,
+
+	// A rest, which +/- lengthen or shorten.
+	CHRONO_ADJUSTABLE = 1 << 1,
+};
+
+// In milliseconds.
+#define REST_ADJUST_STEP 10000
+
+struct Countdown
+{
+	Session *session;
+
+	u64 end;
+
+	// In milliseconds.
+	u32 milestone_delta;
+	u32 milestone;
+
+	// When the milestone is reached (the cue is said before, so it
+	// ends right then).
+	u64 milestone_at;
+	char milestone_text[32];
+
+	// Seconds left of the next count-in cue, 0 if none.
+	int count_in;
+	char count_in_text[8];
+
+	b32 finished;
+
+	Timer render_timer,
+		  milestone_timer,
+		  count_in_timer,
+		  cue_timer,
+		  end_timer;
+};
+
+internal void render_countdown(Timer *timer, void *data)
+{
+	Countdown *countdown = (Countdown *) data;
+	TimerWheel *wheel = &countdown->session->wheel;
+
+	u64 now = timer_wheel_now(wheel);
+
+	// Rounded up, so it never shows 0 before the end.
+	u64 remaining_cs = (countdown->end > now) ? (countdown->end - now + 9999999) / 10000000 : 0;
+
+	render_time_left(&countdown->session->renderer, (u32) remaining_cs);
+
+	timer_add(wheel, timer, timer->deadline + CHRONO_RENDER_PERIOD_NS,
+			  render_countdown, data);
+}
+
+// Adds a timer for TEXT to start being said so it ends at AT (or
+// right away if that is too late already).
+internal void schedule_cue(Session *session, Timer *timer, char *text, u64 at,
+						   TimerCallback *callback, void *data)
+{
+	TimerWheel *wheel = &session->wheel;
+
+	u64 duration = estimate_speech(session, text) * 1000000ULL;
+	u64 now = timer_wheel_now(wheel);
+
+	u64 deadline = (at > duration) ? (at - duration) : 0;
+
+	timer_add(wheel, timer, MAX(deadline, now), callback, data);
+}
+
+internal void say_milestone(Timer *, void *);
+
+void format_milestone(char *text, size_t size, u32 milestone)
+{
+	if (milestone % 1000)
+	{
+		// Trailing zeros are not said (e.g: "1.5 seconds").
+		int decimals = (milestone % 100) ? ((milestone % 10) ? 3 : 2) : 1;
+		u32 fraction = milestone % 1000;
+
+		for (int i = decimals; i < 3; ++i)
+		{
+			fraction /= 10;
+		}
+
+		snprintf(text, size, "%u.%0*u seconds", milestone / 1000, decimals, fraction);
+	}
+	else
+	{
+		snprintf(text, size, "%u seconds", milestone / 1000);
+	}
+}
+
+internal void schedule_milestone(Countdown *countdown)
+{
+	char *text = countdown->milestone_text;
+
+	format_milestone(text, sizeof(countdown->milestone_text), countdown->milestone);
+
+	schedule_cue(countdown->session, &countdown->milestone_timer, text, countdown->milestone_at,
+				 say_milestone, countdown);
+}
+
+internal void say_milestone(Timer *, void *data)
+{
+	Countdown *countdown = (Countdown *) data;
+
+	// Not worth saying late, or over another cue.
+	if (!speech_is_busy(countdown->session))
+	{
+		tts_say(countdown->session, countdown->milestone_text);
+	}
+
+	// NOTE: The cue is said so it ends at the milestone: its timer
+	//       runs before it.
+	emit_event(countdown->session->events, "milestone", ",\"elapsed\":%u,\"at\":%llu", countdown->milestone,
+			   (unsigned long long) (countdown->session->wheel.epoch_ns + countdown->milestone_at));
+
+	countdown->milestone	+= countdown->milestone_delta;
+	countdown->milestone_at += countdown->milestone_delta * 1000000ULL;
+
+	if (countdown->milestone_at < countdown->end)
+	{
+		schedule_milestone(countdown);
+	}
+}
+
+internal void say_count_in(Timer *, void *);
+
+internal void schedule_count_in(Countdown *countdown)
+{
+	snprintf(countdown->count_in_text, sizeof(countdown->count_in_text), "%d", countdown->count_in);
+
+	schedule_cue(countdown->session, &countdown->count_in_timer, countdown->count_in_text,
+				 countdown->end - countdown->count_in * 1000000000ULL, say_count_in, countdown);
+}
+
+internal void say_count_in(Timer *, void *data)
+{
+	Countdown *countdown = (Countdown *) data;
+
+	if (!speech_is_busy(countdown->session))
+	{
+		tts_say(countdown->session, countdown->count_in_text);
+	}
+
+	if (--countdown->count_in > 0)
+	{
+		schedule_count_in(countdown);
+	}
+}
+
+internal void say_end_cues(Timer *, void *data)
+{
+	Countdown *countdown = (Countdown *) data;
+
+	say_cues(countdown->session);
+}
+
+internal void end_countdown(Timer *, void *data)
+{
+	Countdown *countdown = (Countdown *) data;
+
+	countdown->finished = true;
+}
+
+// +/-: the end (and the cues said so they end with it) moves, but
+// never before now.
+internal void adjust_rest(Session *session, i32 delta)
+{
+	Countdown *countdown = session->rest;
+
+	if (!countdown)
+	{
+		return;
+	}
+
+	TimerWheel *wheel = &session->wheel;
+
+	u64 now = timer_wheel_now(wheel);
+	i64 end = (i64) countdown->end + (i64) delta * 1000000LL;
+
+	countdown->end = (end > (i64) now) ? (u64) end : now;
+
+	timer_add(wheel, &countdown->end_timer, countdown->end, end_countdown, countdown);
+
+	session->dashboard_state.end = wheel->epoch_ns + countdown->end;
+	publish_state(session);
+
+	emit_event(session->events, "rest_adjusted", ",\"end\":%llu",
+			   (unsigned long long) session->dashboard_state.end);
+
+	if (timer_is_pending(&countdown->cue_timer))
+	{
+		schedule_cue(session, &countdown->cue_timer, session->pending_speech, countdown->end,
+					 say_end_cues, countdown);
+	}
+}
+
+// SPACE or ENTER: the set is done (if one is waited for).
+// p: pauses or resumes.
+// s: skips the exercise.
+// q: suspends the session (if it can be resumed).
+// +/-: lengthens or shortens the rest.
+// Returns true if the set is done, *DONE_AT (wheel time) being when
+// the key was pressed.
+internal b32 handle_keys(Session *session, u64 *done_at)
+{
+	KeyPress all_presses[16];
+	int press_count = keyboard_read(session->keyboard, all_presses, ARRAY_SIZE(all_presses));
+
+	b32 done = false;
+
+	for (int i = 0; i < press_count; ++i)
+	{
+		KeyPress *press = all_presses + i;
+
+		switch (press->key)
+		{
+			case ' ':
+			case '\n':
+			{
+				if (done_at && !done)
+				{
+					u64 epoch = session->wheel.epoch_ns;
+
+					*done_at = (press->time > epoch) ? press->time - epoch : 0;
+					done = true;
+				}
+
+				break;
+			}
+
+			case 'p':
+			{
+				ATOMIC_STORE(&session->paused, !ATOMIC_LOAD(&session->paused));
+				break;
+			}
+
+			case 's':
+			{
+				ATOMIC_STORE(&session->skip_requested, true);
+				break;
+			}
+
+			case 'q':
+			{
+				if (session->resumable)
+				{
+					ATOMIC_STORE(&session->suspend_requested, true);
+				}
+
+				break;
+			}
+
+			case '+':
+			{
+				adjust_rest(session, REST_ADJUST_STEP);
+				break;
+			}
+
+			case '-':
+			{
+				adjust_rest(session, -REST_ADJUST_STEP);
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	return done;
+}
+
+// For wait_for_keys: until a key is pressed (or session_wake).
+#define NO_DEADLINE UINT64_MAX
+
+// Sleeps until DEADLINE (wheel time), until a key is pressed, or until
+// the session is woken up (see session_wake).
+// Returns true if the set is done (see handle_keys).
+internal b32 wait_for_keys(Session *session, u64 deadline, u64 *done_at = NULL)
+{
+	TimerWheel *wheel = &session->wheel;
+	Keyboard *keyboard = session->keyboard;
+
+	struct pollfd all_poll_fds[3];
+	int poll_fd_count = 0;
+
+	int keyboard_index = -1;
+	int wake_index = -1;
+	int events_index = -1;
+
+	if (keyboard && !keyboard->closed)
+	{
+		keyboard_index = poll_fd_count++;
+		all_poll_fds[keyboard_index] = { keyboard->fd, POLLIN, 0 };
+	}
+
+	if (session->wake_open)
+	{
+		wake_index = poll_fd_count++;
+		all_poll_fds[wake_index] = { session->wake_fd, POLLIN, 0 };
+	}
+
+	// Events a slow reader had no room for are written as soon as it
+	// has, rather than with the next one.
+	if (event_stream_pending(session->events))
+	{
+		events_index = poll_fd_count++;
+		all_poll_fds[events_index] = { session->events->fd, POLLOUT, 0 };
+	}
+
+	if (!poll_fd_count)
+	{
+		// Nothing can wake us up: looked at again every 10ms.
+		if (deadline == NO_DEADLINE)
+		{
+			deadline = timer_wheel_now(wheel) + 10000000ULL;
+		}
+
+		sleep_until_ns(wheel->epoch_ns + deadline);
+		return false;
+	}
+
+	struct timespec poll_timeout;
+	struct timespec *timeout = NULL;
+
+	if (deadline != NO_DEADLINE)
+	{
+		u64 now = timer_wheel_now(wheel);
+		u64 left = (deadline > now) ? deadline - now : 0;
+
+		poll_timeout = { (time_t) (left / 1000000000ULL), (long) (left % 1000000000ULL) };
+		timeout = &poll_timeout;
+	}
+
+	if (ppoll(all_poll_fds, poll_fd_count, timeout, NULL) <= 0)
+	{
+		return false;
+	}
+
+	if ((wake_index != -1) && all_poll_fds[wake_index].revents)
+	{
+		eventfd_t value;
+		eventfd_read(session->wake_fd, &value);
+	}
+
+	if ((events_index != -1) && all_poll_fds[events_index].revents)
+	{
+		event_stream_flush(session->events);
+	}
+
+	if ((keyboard_index == -1) || !all_poll_fds[keyboard_index].revents)
+	{
+		return false;
+	}
+
+	return handle_keys(session, done_at);
+}
+
+// The session stops what it is doing (skipped, or suspended).
+internal b32 is_interrupted(Session *session)
+{
+	return (ATOMIC_LOAD(&session->skip_requested) || ATOMIC_LOAD(&session->suspend_requested));
+}
+
+// Sleeps until the next timer is due (or a key is pressed), runs it,
+// and so on until *done is set.
+// Returns false if interrupted (see is_interrupted).
+internal b32 run_timers(Session *session, b32 *done)
+{
+	TimerWheel *wheel = &session->wheel;
+
+	while (!*done)
+	{
+		if (is_interrupted(session))
+		{
+			return false;
+		}
+
+		if (ATOMIC_LOAD(&session->paused))
+		{
+			u64 pause_start = get_monotonic_ns();
+
+			DashboardState *state = &session->dashboard_state;
+
+			// How long the countdown has left, while it is stopped.
+			if (state->end)
+			{
+				state->end = (state->end > pause_start) ? state->end - pause_start : 0;
+			}
+
+			state->paused = true;
+			publish_state(session);
+
+			emit_event(session->events, "pause", ",\"left\":%llu", (unsigned long long) state->end);
+
+			render_status(&session->renderer, "Paused...");
+
+			// Nothing runs meanwhile (the wheel is pushed back below):
+			// the session sleeps until a key (p resumes) or a request.
+			while (ATOMIC_LOAD(&session->paused) && !is_interrupted(session))
+			{
+				wait_for_keys(session, NO_DEADLINE);
+			}
+
+			render_clear(&session->renderer);
+
+			u64 pause_end = get_monotonic_ns();
+
+			// Every pending timer is pushed back by the pause's length.
+			timer_wheel_shift(wheel, pause_end - pause_start);
+
+			if (state->end)
+			{
+				state->end += pause_end;
+			}
+
+			state->paused = false;
+			publish_state(session);
+
+			emit_event(session->events, "resume", ",\"end\":%llu", (unsigned long long) state->end);
+			continue;
+		}
+
+		u64 deadline;
+
+		if (!timer_wheel_next_deadline(wheel, &deadline))
+		{
+			break;
+		}
+
+		wait_for_keys(session, deadline);
+		timer_wheel_advance(wheel, timer_wheel_now(wheel));
+	}
+
+	return true;
+}
+
+// Of the event starting a period of PHASE.
+internal const char *period_event(u32 phase)
+{
+	switch (phase)
+	{
+		case DASHBOARD_SETUP: return "setup";
+		case DASHBOARD_WORK:  return "series_start";
+		default:			  return "rest";
+	}
+}
+
+// Runs from where the previous period was planned to end, so any time
+// spent in between (e.g: saying a cue) is taken from this one.
+// Cues queued when it is called are said so they end with it.
+// The dashboard is told when it ends (the phase is the caller's).
+// If the session was suspended during this period, only what was left
+// of it is run (the cues that were said already are not said again),
+// and if it is suspended now, what is left is kept (see
+// SessionCursor::remaining).
+// Returns false if the countdown was interrupted (see is_interrupted).
+// DURATION and MILESTONE_DELTA are in milliseconds.
+internal b32 wait_and_print_chrono(Session *session, u32 duration, u32 milestone_delta = 0,
+								   int flags = 0)
+{
+	TimerWheel *wheel = &session->wheel;
+	SessionCursor *cursor = &session->cursor;
+
+	Countdown countdown = {};
+	countdown.session = session;
+
+	u64 length = duration * 1000000ULL;
+
+	// In nanoseconds, of the period, run before it was suspended.
+	u64 elapsed = 0;
+
+	if (cursor->remaining)
+	{
+		elapsed = (cursor->remaining < length) ? (length - cursor->remaining) : 0;
+		cursor->remaining = 0;
+	}
+
+	u64 start = session->timeline;
+	countdown.end = start + length - elapsed;
+
+	timer_add(wheel, &countdown.end_timer, countdown.end, end_countdown, &countdown);
+	timer_add(wheel, &countdown.render_timer, timer_wheel_now(wheel), render_countdown, &countdown);
+
+	if ((milestone_delta > 0) && (milestone_delta < duration))
+	{
+		u64 delta = milestone_delta * 1000000ULL;
+
+		// The first one not reached yet.
+		u64 milestone_count = elapsed / delta + 1;
+
+		countdown.milestone_delta = milestone_delta;
+		countdown.milestone		  = milestone_count * milestone_delta;
+		countdown.milestone_at	  = start + milestone_count * delta - elapsed;
+
+		if (countdown.milestone_at < countdown.end)
+		{
+			schedule_milestone(&countdown);
+		}
+	}
+
+	// "3, 2, 1", only spoken.
+	if ((flags & CHRONO_COUNT_IN) && session->config->voice_on)
+	{
+		u32 left = (u32) ((countdown.end - start) / 1000000ULL);
+
+		countdown.count_in = (left > 1000) ? (MIN(3, (left - 1) / 1000)) : 0;
+
+		if (countdown.count_in > 0)
+		{
+			schedule_count_in(&countdown);
+		}
+	}
+
+	if (session->pending_speech[0] != '\0')
+	{
+		schedule_cue(session, &countdown.cue_timer, session->pending_speech, countdown.end,
+					 say_end_cues, &countdown);
+	}
+
+	session->rest = (flags & CHRONO_ADJUSTABLE) ? &countdown : NULL;
+
+	session->dashboard_state.end = wheel->epoch_ns + countdown.end;
+	publish_state(session);
+
+	emit_event(session->events, period_event(session->dashboard_state.phase), ",\"series\":%u,\"end\":%llu",
+			   session->dashboard_state.series, (unsigned long long) session->dashboard_state.end);
+
+	b32 result = run_timers(session, &countdown.finished);
+
+	session->rest = NULL;
+	session->dashboard_state.end = 0;
+
+	timer_cancel(wheel, &countdown.render_timer);
+	timer_cancel(wheel, &countdown.milestone_timer);
+	timer_cancel(wheel, &countdown.count_in_timer);
+	timer_cancel(wheel, &countdown.cue_timer);
+	timer_cancel(wheel, &countdown.end_timer);
+
+	render_clear(&session->renderer);
+
+	if (result)
+	{
+		session->timeline = countdown.end;
+	}
+	else
+	{
+		// The cues were for this countdown's end.
+		session->pending_speech[0]	= '\0';
+		session->pending_display[0] = '\0';
+
+		session->timeline = timer_wheel_now(wheel);
+
+		if (ATOMIC_LOAD(&session->suspend_requested))
+		{
+			// Never 0, which would run it whole.
+			cursor->remaining = (countdown.end > session->timeline) ? countdown.end - session->timeline : 1;
+		}
+	}
+
+	return result;
+}
+
+// Timers (e.g: the metronome's) keep running meanwhile.
+// Returns false if the wait was interrupted (see is_interrupted).
+internal b32 wait_for_input(Session *session)
+{
+	TimerWheel *wheel = &session->wheel;
+	Keyboard *keyboard = session->keyboard;
+
+	while (!is_interrupted(session))
+	{
+		// Requests wake us up (see session_wake), no need to look
+		// for them meanwhile.
+		u64 deadline;
+
+		if (!timer_wheel_next_deadline(wheel, &deadline))
+		{
+			deadline = NO_DEADLINE;
+		}
+
+		u64 done_at;
+		b32 done = wait_for_keys(session, deadline, &done_at);
+
+		timer_wheel_advance(wheel, timer_wheel_now(wheel));
+
+		if (done)
+		{
+			// When the key was pressed, not when it was read.
+			session->timeline = done_at;
+			return true;
+		}
+
+		// Nothing will ever be pressed (e.g: stdin was a file).
+		if (keyboard && keyboard->closed)
+		{
+			break;
+		}
+	}
+
+	session->timeline = timer_wheel_now(wheel);
+
+	return !is_interrupted(session);
+}
+
+void init_program_walk(ProgramWalk *walk, Program *all_programs, int program_count)
+{
+	walk->all_programs	= all_programs;
+	walk->program_count = program_count;
+
+	walk->all_roots = (1U << program_count) - 1;
+	walk->next_root = 0;
+	walk->depth		= 0;
+
+	for (int i = 0; i < program_count; ++i)
+	{
+		Program *program = all_programs + i;
+
+		for (int j = 0; j < program->reference_count; ++j)
+		{
+			walk->all_roots &= ~(1U << program->all_reference_targets[j]);
+		}
+	}
+}
+
+int next_program(ProgramWalk *walk)
+{
+	for (;;)
+	{
+		int index;
+
+		if (!walk->depth)
+		{
+			while ((walk->next_root < walk->program_count) &&
+				   !(walk->all_roots & (1U << walk->next_root)))
+			{
+				++walk->next_root;
+			}
+
+			if (walk->next_root == walk->program_count)
+			{
+				return -1;
+			}
+
+			index = walk->next_root++;
+		}
+		else
+		{
+			ProgramWalkFrame *frame = walk->all_frames + walk->depth - 1;
+			Program *parent = walk->all_programs + frame->program;
+
+			if (!frame->repeat_left)
+			{
+				if (frame->next_reference == parent->reference_count)
+				{
+					--walk->depth;
+					continue;
+				}
+
+				frame->repeat_left = parent->all_reference_repeats[frame->next_reference++];
+			}
+
+			--frame->repeat_left;
+			index = parent->all_reference_targets[frame->next_reference - 1];
+		}
+
+		Program *program = walk->all_programs + index;
+
+		if (program->exercise_count)
+		{
+			return index;
+		}
+
+		// NOTE: Programs cannot reference each other in a cycle (see
+		//       parse_program_file), so it is never any deeper.
+		if (program->reference_count && (walk->depth < (int) ARRAY_SIZE(walk->all_frames)))
+		{
+			ProgramWalkFrame *frame = walk->all_frames + walk->depth++;
+
+			frame->program		  = index;
+			frame->next_reference = 0;
+			frame->repeat_left	  = 0;
+		}
+	}
+}
+
+// Run again from the start, as if it was the first time.
+internal void rewind_program(Program *program)
+{
+	program->current_exercise = 0;
+
+	for (int i = 0; i < program->exercise_count; ++i)
+	{
+		program->all_exercises[i].current_series = 0;
+	}
+}
+
+// Returns false once the stream has ended, with nothing left to run.
+// Timers (and keys) keep running meanwhile.
+internal b32 wait_for_stream(Session *session, Exercise *exercise)
+{
+	ProgramStream *stream = session->stream;
+	TimerWheel *wheel = &session->wheel;
+
+	b32 waited = false;
+
+	for (;;)
+	{
+		b32 ended = program_stream_ended(stream);
+
+		if (program_stream_next(stream, exercise))
+		{
+			break;
+		}
+
+		if (ended)
+		{
+			return false;
+		}
+
+		if (!waited)
+		{
+			render_line(&session->renderer, "Waiting for the next exercise...");
+
+			session->dashboard_state.phase = DASHBOARD_IDLE;
+			publish_state(session);
+
+			waited = true;
+		}
+
+		wait_for_keys(session, timer_wheel_now(wheel) + 10000000ULL);
+		timer_wheel_advance(wheel, timer_wheel_now(wheel));
+	}
+
+	// The next setup is not cut short by the wait.
+	if (waited)
+	{
+		session->timeline = MAX(session->timeline, timer_wheel_now(wheel));
+	}
+
+	return true;
+}
+
+// The exercise being run.
+internal Exercise *current_exercise(Session *session)
+{
+	if (session->stream)
+	{
+		return &session->stream_exercise;
+	}
+
+	Program *program = session->all_programs + session->cursor.program;
+
+	return program->all_exercises + program->current_exercise - 1;
+}
+
+// Returns what comes after the current exercise (interned), in this
+// program or the next one.
+internal u32 find_next_exercise(Session *session)
+{
+	SessionCursor *cursor = &session->cursor;
+	Program *program = session->all_programs + cursor->program;
+
+	cursor->last_exercise = false;
+
+	if (program->current_exercise < program->exercise_count)
+	{
+		return program->all_exercises[program->current_exercise].name;
+	}
+
+	if (cursor->next_program != -1)
+	{
+		return session->all_programs[cursor->next_program].all_exercises[0].name;
+	}
+
+	cursor->last_exercise = true;
+
+	return EMPTY_STRING_ID;
+}
+
+// NEXT_EXERCISE (interned) being what comes after EXERCISE.
+internal void announce_exercise(Session *session, Exercise *exercise, u32 next_exercise)
+{
+	DashboardState *state = &session->dashboard_state;
+
+	u32 spoken_name = exercise->spoken_name ? exercise->spoken_name : exercise->name;
+	queue_cue(session, get_string(exercise->name), get_string(spoken_name));
+
+	state->exercise		 = exercise->name;
+	state->next_exercise = next_exercise;
+	state->series		 = exercise->current_series;
+	state->series_count	 = exercise->series_count;
+
+	if (session->events)
+	{
+		char name[300], next[300];
+
+		escape_json(get_string(exercise->name), name, sizeof(name));
+
+		if (next_exercise != EMPTY_STRING_ID)
+		{
+			escape_json(get_string(next_exercise), next, sizeof(next));
+		}
+		else
+		{
+			snprintf(next, sizeof(next), "null");
+		}
+
+		// In milliseconds, a set without a duration lasting until
+		// SPACE or ENTER.
+		emit_event(session->events, "exercise",
+				   ",\"name\":%s,\"next\":%s,\"series_count\":%u,\"duration\":%u,\"pause\":%u",
+				   name, next, exercise->series_count, exercise->duration, exercise->pause_duration);
+	}
+}
+
+// Returns false once there is nothing left to run.
+internal b32 start_next_exercise(Session *session)
+{
+	SessionCursor *cursor = &session->cursor;
+
+	Exercise *exercise;
+	u32 next_exercise;
+
+	if (session->stream)
+	{
+		// Exercises are run as they are read: the session only waits
+		// for the stream once it has run everything it was given.
+		ProgramStream *stream = session->stream;
+
+		if (!session->has_stream_next && !wait_for_stream(session, &session->stream_next))
+		{
+			return false;
+		}
+
+		session->stream_exercise = session->stream_next;
+
+		b32 ended = program_stream_ended(stream);
+		session->has_stream_next = program_stream_next(stream, &session->stream_next);
+
+		// NOTE: If the next one is not there yet, but is still to
+		//       come, this one is run as any other (pause included).
+		cursor->last_exercise = (ended && !session->has_stream_next);
+
+		exercise	  = &session->stream_exercise;
+		next_exercise = session->has_stream_next ? session->stream_next.name : EMPTY_STRING_ID;
+	}
+	else
+	{
+		Program *program = (cursor->program != -1) ? session->all_programs + cursor->program : NULL;
+
+		if (!program || (program->current_exercise == program->exercise_count))
+		{
+			if (cursor->next_program == -1)
+			{
+				return false;
+			}
+
+			cursor->program		 = cursor->next_program;
+			cursor->next_program = next_program(&cursor->walk);
+
+			program = session->all_programs + cursor->program;
+			rewind_program(program);
+
+			ATOMIC_STORE(&session->current_program, cursor->program);
+		}
+
+		exercise = program->all_exercises + program->current_exercise++;
+		next_exercise = find_next_exercise(session);
+	}
+
+	// Skipping applies to the exercise that was running when it was
+	// asked for.
+	ATOMIC_STORE(&session->skip_requested, false);
+
+	announce_exercise(session, exercise, next_exercise);
+
+	return true;
+}
+
+internal void start_series(Session *session, Exercise *exercise)
+{
+	SessionCursor *cursor = &session->cursor;
+
+	if (exercise->current_series < exercise->series_count)
+	{
+		++exercise->current_series;
+		cursor->step = SESSION_STEP_SETUP;
+	}
+	else
+	{
+		cursor->step = SESSION_STEP_NEXT_EXERCISE;
+	}
+}
+
+// There is no pause after the very last series of the session.
+internal void end_series(Session *session, Exercise *exercise)
+{
+	SessionCursor *cursor = &session->cursor;
+
+	if (cursor->last_exercise && (exercise->current_series == exercise->series_count))
+	{
+		cursor->step = SESSION_STEP_NEXT_EXERCISE;
+	}
+	else
+	{
+		cursor->step = SESSION_STEP_REST;
+	}
+}
+
+// Runs the cursor's step, and moves it to the next one. A step
+// interrupted by a suspension is left as it is, to be run again (see
+// SessionCursor::remaining).
+internal void run_step(Session *session)
+{
+	Config *config = session->config;
+	SessionCursor *cursor = &session->cursor;
+	DashboardState *state = &session->dashboard_state;
+
+	if (cursor->step == SESSION_STEP_NEXT_EXERCISE)
+	{
+		if (start_next_exercise(session))
+		{
+			start_series(session, current_exercise(session));
+		}
+		else
+		{
+			cursor->step = SESSION_STEP_FINISHED;
+		}
+
+		return;
+	}
+
+	Exercise *exercise = current_exercise(session);
+
+	b32 tempo = has_tempo(exercise);
+	b32 very_last_series = (cursor->last_exercise && (exercise->current_series == exercise->series_count));
+
+	switch (cursor->step)
+	{
+		case SESSION_STEP_SETUP:
+		{
+			state->series = exercise->current_series;
+			state->phase  = DASHBOARD_SETUP;
+
+			if (tempo)
+			{
+				metronome_open(&session->metronome, &config->metronome);
+			}
+
+			// Said over the setup time, "Go" ending right with it.
+			queue_cue(session, "Ready");
+			say_cues(session);
+
+			queue_cue(session, "Go");
+
+			if (!wait_and_print_chrono(session, config->setup_time, 0, CHRONO_COUNT_IN))
+			{
+				break;
+			}
+
+			cursor->step = exercise->duration ? SESSION_STEP_WORK : SESSION_STEP_WAIT;
+			return;
+		}
+
+		case SESSION_STEP_WORK:
+		{
+			if (tempo)
+			{
+				// The countdown has the line to itself.
+				metronome_start(&session->metronome, &session->wheel, exercise->tempo, NULL);
+			}
+
+			queue_cue(session, "Stop");
+
+			if (!very_last_series)
+			{
+				queue_cue(session, "Pause");
+			}
+
+			state->phase = DASHBOARD_WORK;
+
+			if (!wait_and_print_chrono(session, exercise->duration, exercise->milestone))
+			{
+				break;
+			}
+
+			metronome_stop(&session->metronome);
+
+			emit_event(session->events, "series_end", ",\"series\":%u", exercise->current_series);
+
+			end_series(session, exercise);
+			return;
+		}
+
+		case SESSION_STEP_WAIT:
+		{
+			if (tempo)
+			{
+				metronome_start(&session->metronome, &session->wheel, exercise->tempo, &session->renderer);
+			}
+
+			render_line(&session->renderer, "Press SPACE or ENTER once you are done...");
+
+			state->phase = DASHBOARD_WAITING;
+			publish_state(session);
+
+			emit_event(session->events, "series_start", ",\"series\":%u,\"end\":null", exercise->current_series);
+
+			if (!wait_for_input(session))
+			{
+				break;
+			}
+
+			metronome_stop(&session->metronome);
+
+			emit_event(session->events, "series_end", ",\"series\":%u", exercise->current_series);
+
+			if (!very_last_series)
+			{
+				// Said over the pause.
+				queue_cue(session, "Pause");
+				say_cues(session);
+			}
+
+			end_series(session, exercise);
+			return;
+		}
+
+		case SESSION_STEP_REST:
+		{
+			state->phase = DASHBOARD_REST;
+
+			if (!wait_and_print_chrono(session, exercise->pause_duration, 0, CHRONO_ADJUSTABLE))
+			{
+				break;
+			}
+
+			start_series(session, exercise);
+			return;
+		}
+
+		default:
+		{
+			return;
+		}
+	}
+
+	// Interrupted: the exercise was skipped, or the session suspended
+	// (this step is then run again when it is resumed).
+	metronome_stop(&session->metronome);
+
+	if (!ATOMIC_LOAD(&session->suspend_requested))
+	{
+		cursor->step = SESSION_STEP_NEXT_EXERCISE;
+
+		emit_event(session->events, "skip", "");
+	}
+}
+
+internal u32 hash_bytes(u32 hash, const void *data, size_t size)
+{
+	const u8 *bytes = (const u8 *) data;
+
+	// FNV-1a.
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+// Of what is run, not of how far it is (names by their text, as ids
+// are only good for this run).
+internal u32 hash_programs(Program *all_programs, int program_count)
+{
+	u32 hash = 2166136261U;
+
+	hash = hash_bytes(hash, &program_count, sizeof(program_count));
+
+	for (int i = 0; i < program_count; ++i)
+	{
+		Program *program = all_programs + i;
+
+		hash = hash_bytes(hash, &program->exercise_count, sizeof(program->exercise_count));
+
+		for (int j = 0; j < program->exercise_count; ++j)
+		{
+			Exercise *exercise = program->all_exercises + j;
+
+			const char *name = get_string(exercise->name);
+			const char *spoken_name = get_string(exercise->spoken_name);
+
+			hash = hash_bytes(hash, name, strlen(name) + 1);
+			hash = hash_bytes(hash, spoken_name, strlen(spoken_name) + 1);
+
+			hash = hash_bytes(hash, &exercise->duration, sizeof(exercise->duration));
+			hash = hash_bytes(hash, &exercise->pause_duration, sizeof(exercise->pause_duration));
+			hash = hash_bytes(hash, &exercise->milestone, sizeof(exercise->milestone));
+			hash = hash_bytes(hash, exercise->tempo, sizeof(exercise->tempo));
+			hash = hash_bytes(hash, &exercise->series_count, sizeof(exercise->series_count));
+		}
+
+		hash = hash_bytes(hash, &program->reference_count, sizeof(program->reference_count));
+		hash = hash_bytes(hash, program->all_reference_targets, program->reference_count);
+		hash = hash_bytes(hash, program->all_reference_repeats,
+						  program->reference_count * sizeof(program->all_reference_repeats[0]));
+	}
+
+	return hash;
+}
+
+// Where the session is, for read_suspended_session.
+internal void save_session(Session *session)
+{
+	SessionCursor *cursor = &session->cursor;
+	ProgramWalk *walk = &cursor->walk;
+
+	char path[512];
+	FILE *file;
+
+	if (!cache_file_path(path, sizeof(path), "suspended_session", true) ||
+		!(file = fopen(path, "w")))
+	{
+		render_line(&session->renderer, "Could not save the session, it cannot be resumed.");
+		return;
+	}
+
+	Program *program = session->all_programs + cursor->program;
+	Exercise *exercise = current_exercise(session);
+
+	// One field (or group of fields) per line, in that order.
+	fprintf(file, "program %s\n", session->program_name);
+	fprintf(file, "hash %u\n", hash_programs(session->all_programs, session->program_count));
+	fprintf(file, "step %u %llu\n", cursor->step, (unsigned long long) cursor->remaining);
+	fprintf(file, "position %d %d %u %u %d\n", cursor->program, cursor->next_program,
+			program->current_exercise, exercise->current_series, cursor->last_exercise);
+	fprintf(file, "walk %u %d %d\n", walk->all_roots, walk->next_root, walk->depth);
+
+	for (int i = 0; i < walk->depth; ++i)
+	{
+		ProgramWalkFrame *frame = walk->all_frames + i;
+
+		fprintf(file, "frame %u %u %u\n", frame->program, frame->next_reference, frame->repeat_left);
+	}
+
+	fclose(file);
+}
+
+b32 read_suspended_session(SuspendedSession *suspended)
+{
+	char path[512];
+	FILE *file;
+
+	if (!cache_file_path(path, sizeof(path), "suspended_session", false) ||
+		!(file = fopen(path, "r")))
+	{
+		return false;
+	}
+
+	memset(suspended, 0, sizeof(*suspended));
+
+	SessionCursor *cursor = &suspended->cursor;
+	ProgramWalk *walk = &cursor->walk;
+
+	char line[300];
+	b32 valid = false;
+
+	unsigned long long remaining;
+	unsigned int current_exercise, current_series;
+
+	if (fgets(line, sizeof(line), file) && (strncmp(line, "program ", 8) == 0))
+	{
+		line[strcspn(line, "\n")] = '\0';
+		snprintf(suspended->program_name, sizeof(suspended->program_name), "%s", line + 8);
+
+		valid = ((fscanf(file, "hash %u\n", &suspended->programs_hash) == 1) &&
+				 (fscanf(file, "step %u %llu\n", &cursor->step, &remaining) == 2) &&
+				 (fscanf(file, "position %d %d %u %u %d\n", &cursor->program, &cursor->next_program,
+						 &current_exercise, &current_series, &cursor->last_exercise) == 5) &&
+				 (fscanf(file, "walk %u %d %d\n", &walk->all_roots, &walk->next_root, &walk->depth) == 3) &&
+				 (walk->depth >= 0) && (walk->depth <= (int) ARRAY_SIZE(walk->all_frames)));
+	}
+
+	for (int i = 0; valid && (i < walk->depth); ++i)
+	{
+		ProgramWalkFrame *frame = walk->all_frames + i;
+		unsigned int program, next_reference, repeat_left;
+
+		valid = (fscanf(file, "frame %u %u %u\n", &program, &next_reference, &repeat_left) == 3);
+
+		frame->program		  = (u8) program;
+		frame->next_reference = (u8) next_reference;
+		frame->repeat_left	  = (u16) repeat_left;
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		fprintf(stderr, "%s: '%s': invalid suspended session.\n", PROGRAM, path);
+		return false;
+	}
+
+	cursor->remaining		   = remaining;
+	suspended->current_exercise = (u8) current_exercise;
+	suspended->current_series   = (u8) current_series;
+
+	return true;
+}
+
+b32 restore_session(Session *session, SuspendedSession *suspended)
+{
+	SessionCursor *cursor = &suspended->cursor;
+	ProgramWalk *walk = &cursor->walk;
+
+	if (hash_programs(session->all_programs, session->program_count) != suspended->programs_hash)
+	{
+		fprintf(stderr, "%s: %s: the program has changed since it was suspended.\n",
+				PROGRAM, suspended->program_name);
+
+		return false;
+	}
+
+	// Same programs: only a corrupted file could be out of bounds.
+	b32 valid = ((cursor->program >= 0) && (cursor->program < session->program_count) &&
+				 (cursor->next_program >= -1) && (cursor->next_program < session->program_count) &&
+				 (cursor->step > SESSION_STEP_NEXT_EXERCISE) && (cursor->step < SESSION_STEP_FINISHED) &&
+				 (walk->next_root <= session->program_count));
+
+	for (int i = 0; valid && (i < walk->depth); ++i)
+	{
+		valid = (walk->all_frames[i].program < session->program_count);
+	}
+
+	Program *program = session->all_programs + cursor->program;
+
+	if (!valid ||
+		(suspended->current_exercise < 1) || (suspended->current_exercise > program->exercise_count) ||
+		(suspended->current_series < 1) ||
+		(suspended->current_series > program->all_exercises[suspended->current_exercise - 1].series_count))
+	{
+		fprintf(stderr, "%s: %s: invalid suspended session.\n", PROGRAM, suspended->program_name);
+		return false;
+	}
+
+	rewind_program(program);
+
+	program->current_exercise = suspended->current_exercise;
+	program->all_exercises[program->current_exercise - 1].current_series = suspended->current_series;
+
+	session->cursor = *cursor;
+	session->cursor.walk.all_programs  = session->all_programs;
+	session->cursor.walk.program_count = session->program_count;
+
+	session->current_program = cursor->program;
+	session->restored = true;
+
+	// Resumed once.
+	char path[512];
+
+	if (cache_file_path(path, sizeof(path), "suspended_session", false))
+	{
+		unlink(path);
+	}
+
+	return true;
+}
+
+void session_wake(Session *session)
+{
+	if (ATOMIC_LOAD(&session->wake_open))
+	{
+		eventfd_write(session->wake_fd, 1);
+	}
+}
+
+// Once everything has been said and shown. Also run if the session's
+// thread is cancelled (e.g: the daemon quitting).
+internal void stop_session_threads(void *data)
+{
+	Session *session = (Session *) data;
+
+	// NOTE: Joining threads are cancellation points: cancelled halfway
+	//       (e.g: the daemon quitting while the last cue is said), this
+	//       would be run again from the start, or abort the process.
+	int cancel_state;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	audio_stop(&session->audio);
+	collect_speech(session);
+	timer_cancel(&session->wheel, &session->speech_timer);
+
+	renderer_stop(&session->renderer);
+
+	status_page_close(&session->status_page);
+
+	pthread_setcancelstate(cancel_state, NULL);
+}
+
+void run_session(Session *session)
+{
+	Config *config = session->config;
+	SessionCursor *cursor = &session->cursor;
+
+	ATOMIC_STORE(&session->running, true);
+	ATOMIC_STORE(&session->suspended, false);
+
+	if (!session->wake_open)
+	{
+		session->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		ATOMIC_STORE(&session->wake_open, (session->wake_fd != -1));
+	}
+
+	session->pending_speech[0]	= '\0';
+	session->pending_display[0] = '\0';
+
+	timer_wheel_init(&session->wheel, get_monotonic_ns());
+	session->timeline = 0;
+
+	// NOTE: If either fails to start, its work is done here (output)
+	//       or not at all (speech and music).
+	renderer_start(&session->renderer);
+	audio_start(&session->audio, config, session->speech);
+
+	// NOTE: Without it, status bars just see no session.
+	status_page_open(&session->status_page);
+
+	pthread_cleanup_push(stop_session_threads, session);
+
+	audio_send(&session->audio, AUDIO_MUSIC_INIT);
+
+	// There is no use in muting, is there?
+	if (!config->voice_on)
+	{
+		audio_send(&session->audio, AUDIO_MUSIC_ON);
+	}
+
+	DashboardState *state = &session->dashboard_state;
+	memset(state, 0, sizeof(*state));
+
+	state->program = intern_string(session->program_name);
+
+	if (session->events)
+	{
+		char program[300];
+		escape_json(session->program_name, program, sizeof(program));
+
+		emit_event(session->events, "start", ",\"program\":%s,\"resumed\":%s", program,
+				   session->restored ? "true" : "false");
+	}
+
+	if (session->restored)
+	{
+		// Where it was, said now rather than with the step's end.
+		announce_exercise(session, current_exercise(session), find_next_exercise(session));
+		say_cues(session);
+
+		session->restored = false;
+	}
+	else
+	{
+		memset(cursor, 0, sizeof(*cursor));
+
+		cursor->step = SESSION_STEP_NEXT_EXERCISE;
+		cursor->program = -1;
+		cursor->next_program = -1;
+
+		if (!session->stream)
+		{
+			init_program_walk(&cursor->walk, session->all_programs, session->program_count);
+			cursor->next_program = next_program(&cursor->walk);
+		}
+
+		session->has_stream_next = false;
+	}
+
+	while (cursor->step != SESSION_STEP_FINISHED)
+	{
+		// NOTE: Not before an exercise has been picked, the next
+		//       countdown then being suspended right away.
+		if ((cursor->step != SESSION_STEP_NEXT_EXERCISE) &&
+			ATOMIC_LOAD(&session->suspend_requested))
+		{
+			ATOMIC_STORE(&session->suspended, true);
+			break;
+		}
+
+		// Between series, never in the middle of one.
+		Config *next_config = ATOMIC_LOAD(&session->next_config);
+
+		if (next_config && (cursor->step == SESSION_STEP_SETUP))
+		{
+			session->config = next_config;
+		}
+
+		run_step(session);
+	}
+
+	state->exercise		 = EMPTY_STRING_ID;
+	state->next_exercise = EMPTY_STRING_ID;
+	state->series		 = 0;
+	state->series_count	 = 0;
+
+	if (ATOMIC_LOAD(&session->suspended))
+	{
+		save_session(session);
+
+		state->phase = DASHBOARD_IDLE;
+		publish_state(session);
+
+		render_line(&session->renderer, "Suspended (" PROGRAM " --resume to resume it).");
+
+		emit_event(session->events, "suspend", "");
+	}
+	else
+	{
+		state->phase = DASHBOARD_FINISHED;
+		publish_state(session);
+
+		emit_event(session->events, "finish", "");
+
+		queue_cue(session, "Finished! Congratulations!");
+		queue_cue(session, "Now, go take a shower.");
+		say_cues(session);
+	}
+
+	pthread_cleanup_pop(true);
+
+	ATOMIC_STORE(&session->running, false);
+}
@@ -0,0 +1,226 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "audio.h"
+#include "common.h"
+#include "dashboard.h"
+#include "events.h"
+#include "keyboard.h"
+#include "metronome.h"
+#include "render.h"
+#include "status.h"
+#include "stream.h"
+#include "timer.h"
+
+struct ProgramWalkFrame
+{
+	u8 program;
+	u8 next_reference;
+
+	// Runs of the current reference left after this one.
+	u16 repeat_left;
+};
+
+// Depth-first walk through the session's programs, following
+// references (and their repeats) as it goes: a program run N times is
+// never copied N times (see next_program).
+struct ProgramWalk
+{
+	Program *all_programs;
+	int program_count;
+
+	// Not referenced by any other, so walked from the top.
+	u32 all_roots;
+	int next_root;
+
+	// Programs made of references being walked through, the
+	// innermost last.
+	ProgramWalkFrame all_frames[MAX_PROGRAM_COUNT];
+	int depth;
+};
+
+// A session goes from one step to the next, each one a single period
+// (setup, set or rest), see run_step.
+enum SessionStep
+{
+	// Picks the exercise to run (or finishes).
+	SESSION_STEP_NEXT_EXERCISE,
+
+	SESSION_STEP_SETUP,
+	SESSION_STEP_WORK,
+
+	// A set without a duration: until SPACE or ENTER.
+	SESSION_STEP_WAIT,
+
+	SESSION_STEP_REST,
+	SESSION_STEP_FINISHED,
+};
+
+// Where a session is, between two steps or in the middle of one (if
+// suspended). Along with the programs' current_exercise and
+// current_series, this is all a session needs to be run again from
+// there, by this process or another one (see save_session).
+struct SessionCursor
+{
+	// Its programs apart (see init_program_walk), it is only indices.
+	ProgramWalk walk;
+
+	// The program being run (its current_exercise - 1 being the
+	// exercise), -1 before the first one, and the one after it, -1 if
+	// none.
+	i32 program;
+	i32 next_program;
+
+	u32 step;
+
+	// In nanoseconds, what was left of the step's period when the
+	// session was suspended, 0 to run it whole.
+	u64 remaining;
+
+	// Nothing comes after the current exercise.
+	b32 last_exercise;
+};
+
+// Written by save_session, when a session is suspended.
+struct SuspendedSession
+{
+	char program_name[256];
+
+	// Of the programs it ran, so a program changed since is not
+	// resumed from a place it does not have anymore.
+	u32 programs_hash;
+
+	SessionCursor cursor;
+	u8 current_exercise;
+	u8 current_series;
+};
+
+struct Countdown;
+
+struct Session
+{
+	Config *config;
+	Speech *speech;
+
+	// A configuration read again meanwhile (e.g: by the daemon), taken
+	// from the next series on (see run_session), NULL if none. Speech
+	// and music keep the one the session started with.
+	Config *next_config;
+
+	// Every timed event of the session (countdown display,
+	// milestones, end of a set or a pause) goes through it.
+	TimerWheel wheel;
+
+	// Wheel time the next period (setup, set or pause) starts at, as
+	// planned: cues are said over periods, not in between, so they
+	// do not stretch the session.
+	u64 timeline;
+
+	// Speech and music, off this thread (see speak).
+	Audio audio;
+
+	// Takes note of what the audio thread is done saying.
+	Timer speech_timer;
+
+	// Everything shown goes through it.
+	Renderer renderer;
+
+	// For exercises with a tempo.
+	Metronome metronome;
+
+	// Single-key controls (see handle_keys), NULL if there are none.
+	Keyboard *keyboard;
+
+	// The rest being counted down, NULL if none (see adjust_rest).
+	Countdown *rest;
+
+	// Told what is going on (see publish_state), NULL if there is none.
+	Dashboard *dashboard;
+	DashboardState dashboard_state;
+
+	// Mapped for as long as the session runs (see print_status).
+	StatusPage status_page;
+
+	// Told every change, as it happens (--events), NULL if there is
+	// none.
+	EventStream *events;
+
+	Program all_programs[MAX_PROGRAM_COUNT];
+	int program_count;
+
+	SessionCursor cursor;
+
+	// If not NULL, exercises are taken from it instead, as they come:
+	// the one being run, and the one after it (if read already).
+	ProgramStream *stream;
+	Exercise stream_exercise;
+	Exercise stream_next;
+	b32 has_stream_next;
+
+	// Its programs can be found again by name (i.e: not generated, nor
+	// streamed), so it can be suspended.
+	b32 resumable;
+
+	// Set by restore_session: run_session starts from the cursor.
+	b32 restored;
+
+	// Written to so the session loop, waiting for a key or its next
+	// timer, wakes up (see session_wake). Kept for as long as the
+	// Session is.
+	int wake_fd;
+	b32 wake_open;
+
+	char program_name[256];
+
+	// Cues waiting to be said together (see queue_cue).
+	char pending_speech[256];
+	char pending_display[256];
+
+	// Written by whoever controls the session (e.g: the daemon),
+	// read by the session loop.
+	b32 paused;
+	b32 skip_requested;
+	b32 suspend_requested;
+
+	// Written by the session loop, read by whoever controls it.
+	b32 running;
+	i32 current_program;
+
+	// The session stopped because it was suspended (see run_session).
+	b32 suspended;
+};
+
+void init_program_walk(ProgramWalk *walk, Program *all_programs, int program_count);
+
+// Returns the index of the next program with exercises, -1 once every
+// one has been walked through.
+int next_program(ProgramWalk *walk);
+
+// Shows TEXT, and says it in the background.
+void tts_say(Session *session, char *text);
+
+// What goes between two cues said as one utterance, SPEECH (of
+// SPEECH_LEN > 0 characters) being the first one.
+const char *cue_separator(const char *speech, size_t speech_len);
+
+// What is said when MILESTONE (in milliseconds) is reached.
+void format_milestone(char *text, size_t size, u32 milestone);
+
+// Runs SESSION from the start, or from where it was suspended if it
+// was restored. Once suspended (q, or the daemon's 'suspend'), where
+// it was is saved for restore_session.
+void run_session(Session *session);
+
+// After changing paused, skip_requested or suspend_requested from
+// another thread, so the session notices right away.
+void session_wake(Session *session);
+
+// Returns false if no session was suspended.
+b32 read_suspended_session(SuspendedSession *suspended);
+
+// SESSION's programs being the ones SUSPENDED ran (loaded by its
+// program name), the next run_session starts where it was suspended.
+// Returns false (after saying why) if they have changed since.
+b32 restore_session(Session *session, SuspendedSession *suspended);
+
+#endif
@@ -0,0 +1,216 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#include "intern.h"
+#include "status.h"
+#include "timer.h"
+
+internal const char *global_phase_texts[] =
+{
+	"idle", "setup", "work", "until done", "rest", "finished",
+};
+
+internal void status_path(char *path, size_t size)
+{
+	snprintf(path, size, "/dev/shm/%s-%d.status", PROGRAM, (int) getuid());
+}
+
+internal void copy_name(char *name, u32 id)
+{
+	strncpy(name, get_string(id), MAX_STATUS_NAME_SIZE - 1);
+	name[MAX_STATUS_NAME_SIZE - 1] = '\0';
+}
+
+b32 status_page_open(StatusPage *page)
+{
+	page->shared = NULL;
+
+	char path[256];
+	status_path(path, sizeof(path));
+
+	int fd;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1)
+	{
+		return false;
+	}
+
+	void *address = MAP_FAILED;
+
+	if (ftruncate(fd, sizeof(SharedStatus)) == 0)
+	{
+		address = mmap(NULL, sizeof(SharedStatus), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	// NOTE: The mapping stays once the file is closed.
+	close(fd);
+
+	if (address == MAP_FAILED)
+	{
+		perror(path);
+		return false;
+	}
+
+	page->shared = (SharedStatus *) address;
+
+	DashboardState idle = {};
+	status_page_write(page, &idle);
+
+	return true;
+}
+
+void status_page_close(StatusPage *page)
+{
+	if (!page->shared)
+	{
+		return;
+	}
+
+	// Another session may have taken it over since.
+	if (page->shared->pid == getpid())
+	{
+		char path[256];
+		status_path(path, sizeof(path));
+
+		unlink(path);
+	}
+
+	munmap(page->shared, sizeof(SharedStatus));
+	page->shared = NULL;
+}
+
+void status_page_write(StatusPage *page, DashboardState *state)
+{
+	SharedStatus *shared = page->shared;
+
+	if (!shared)
+	{
+		return;
+	}
+
+	u32 sequence = shared->sequence;
+
+	// Odd: readers know not to trust what they copy from now on.
+	ATOMIC_STORE(&shared->sequence, sequence + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	shared->version		 = STATUS_VERSION;
+	shared->pid			 = getpid();
+	shared->phase		 = state->phase;
+	shared->series		 = state->series;
+	shared->series_count = state->series_count;
+	shared->paused		 = state->paused ? 1 : 0;
+	shared->end			 = state->end;
+
+	copy_name(shared->program, state->program);
+	copy_name(shared->exercise, state->exercise);
+	copy_name(shared->next_exercise, state->next_exercise);
+
+	ATOMIC_STORE(&shared->sequence, sequence + 2);
+}
+
+// Returns false if it kept changing (the writer never leaves it odd
+// for long, so it is not worth waiting more).
+internal b32 read_status(SharedStatus *shared, SharedStatus *status)
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+		u32 sequence = ATOMIC_LOAD(&shared->sequence);
+
+		if (sequence & 1)
+		{
+			continue;
+		}
+
+		memcpy(status, shared, sizeof(*status));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == sequence)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int print_status()
+{
+	char path[256];
+	status_path(path, sizeof(path));
+
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+	{
+		printf("idle\n");
+		return 0;
+	}
+
+	void *address = mmap(NULL, sizeof(SharedStatus), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED)
+	{
+		perror(path);
+		return 1;
+	}
+
+	SharedStatus status;
+	b32 read = read_status((SharedStatus *) address, &status);
+
+	munmap(address, sizeof(SharedStatus));
+
+	if (!read || (status.version != STATUS_VERSION))
+	{
+		fprintf(stderr, "%s: '%s': unreadable status.\n", PROGRAM, path);
+		return 1;
+	}
+
+	// Left over by a session that did not exit properly.
+	if ((kill(status.pid, 0) == -1) && (errno == ESRCH))
+	{
+		printf("idle\n");
+		return 0;
+	}
+
+	if ((status.phase == DASHBOARD_IDLE) || (status.phase >= ARRAY_SIZE(global_phase_texts)))
+	{
+		printf("idle\n");
+		return 0;
+	}
+
+	if (status.phase == DASHBOARD_FINISHED)
+	{
+		printf("%s: finished\n", status.program);
+		return 0;
+	}
+
+	printf("%s %d/%d %s", status.exercise, status.series, status.series_count,
+		   global_phase_texts[status.phase]);
+
+	if (status.end)
+	{
+		u64 now = get_monotonic_ns();
+		u64 left = status.paused ? status.end : ((status.end > now) ? status.end - now : 0);
+
+		printf(" %.1fs", left / 1e9);
+	}
+
+	if (status.paused)
+	{
+		printf(" (paused)");
+	}
+
+	if (status.next_exercise[0] != '\0')
+	{
+		printf(", next: %s", status.next_exercise);
+	}
+
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "common.h"
+#include "dashboard.h"
+
+// Bumped whenever SharedStatus changes.
+#define STATUS_VERSION 1
+
+#define MAX_STATUS_NAME_SIZE 64
+
+// What the running session is doing, in /dev/shm/go-muscu-<uid>.status
+// (see status_path), for status bars and the like. Fixed layout, so it
+// can be read from anything that maps files:
+//
+//   offset  size
+//        0     4  sequence       (u32, odd while being written)
+//        4     4  version        (u32, STATUS_VERSION)
+//        8     4  pid            (i32, of the writer)
+//       12     4  phase          (u32, see DashboardPhase)
+//       16     1  series         (u8)
+//       17     1  series_count   (u8)
+//       18     1  paused         (u8)
+//       24     8  end            (u64, see DashboardState)
+//       32    64  program        (NUL-terminated)
+//       96    64  exercise
+//      160    64  next_exercise
+//
+// NOTE: A seqlock: the writer never waits for readers (or makes a
+//       syscall), readers retry if the sequence was odd, or changed
+//       while they were copying (see read_status).
+struct SharedStatus
+{
+	u32 sequence;
+	u32 version;
+	i32 pid;
+	u32 phase;
+
+	u8 series;
+	u8 series_count;
+	u8 paused;
+	u8 padding[5];
+
+	u64 end;
+
+	char program[MAX_STATUS_NAME_SIZE];
+	char exercise[MAX_STATUS_NAME_SIZE];
+	char next_exercise[MAX_STATUS_NAME_SIZE];
+};
+
+static_assert(sizeof(SharedStatus) == 224, "SharedStatus's layout is fixed");
+
+struct StatusPage
+{
+	// NULL if it could not be mapped (nothing is published then).
+	SharedStatus *shared;
+};
+
+// Maps the status page for writing, for as long as a session runs.
+b32 status_page_open(StatusPage *page);
+
+// Removes it: no session is running anymore.
+void status_page_close(StatusPage *page);
+
+// Never blocks.
+void status_page_write(StatusPage *page, DashboardState *state);
+
+// --status: prints what the running session (if any) is doing, on a
+// single line.
+int print_status();
+
+#endif
@@ -0,0 +1,169 @@
+#include <unistd.h>
+
+#include "parsing.h"
+#include "session.h"
+#include "stream.h"
+
+// Full: the session is that far behind, reading more can wait (and
+// the writer with it).
+internal void push_exercise(ProgramStream *stream, Exercise *exercise)
+{
+	while (!ring_push(&stream->exercises, exercise))
+	{
+		usleep(PROGRAM_STREAM_RETRY_DELAY);
+	}
+}
+
+// Every exercise PROGRAM has been given since the last call.
+internal void push_parsed_exercises(ProgramStream *stream, Program *program)
+{
+	if (!program->exercise_count)
+	{
+		return;
+	}
+
+	for (int i = 0; i < program->exercise_count; ++i)
+	{
+		push_exercise(stream, program->all_exercises + i);
+	}
+
+	// The one being parsed (if any) is kept.
+	program->all_exercises[0] = program->all_exercises[program->exercise_count];
+	program->exercise_count = 0;
+}
+
+internal void push_reference(ProgramStream *stream, char *name, u32 repeat_count)
+{
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s/%s", stream->program_dir, name);
+
+	Program *all_programs = (Program *) calloc(MAX_PROGRAM_COUNT, sizeof(Program));
+	int program_count = 0;
+
+	pthread_cleanup_push(free, all_programs);
+
+	if (parse_program_file(filename, all_programs, &program_count, MAX_PROGRAM_COUNT) == 0)
+	{
+		for (u32 i = 0; i < repeat_count; ++i)
+		{
+			ProgramWalk walk;
+			init_program_walk(&walk, all_programs, program_count);
+
+			int index;
+
+			while ((index = next_program(&walk)) != -1)
+			{
+				Program *program = all_programs + index;
+
+				for (int j = 0; j < program->exercise_count; ++j)
+				{
+					push_exercise(stream, program->all_exercises + j);
+				}
+			}
+		}
+	}
+
+	pthread_cleanup_pop(true);
+}
+
+internal void *stream_thread(void *data)
+{
+	ProgramStream *stream = (ProgramStream *) data;
+
+	Program program = {};
+
+	ProgramParser parser;
+	init_program_parser(&parser, "stdin", &program, stderr);
+
+	char line[MAX_PROGRAM_STREAM_LINE_SIZE];
+
+	while (fgets(line, sizeof(line), stream->file))
+	{
+		size_t line_len = strlen(line);
+
+		if ((line_len == sizeof(line) - 1) && (line[line_len - 1] != '\n'))
+		{
+			int c;
+
+			while (((c = fgetc(stream->file)) != EOF) && (c != '\n'))
+			{
+			}
+
+			fprintf(stderr, "%s: stdin (line %d): line too long (max %d characters), ignored.\n",
+					PROGRAM, ++parser.line_count, MAX_PROGRAM_STREAM_LINE_SIZE - 2);
+			continue;
+		}
+
+		// NOTE: Unlike a file, a stream can mix exercises and
+		//       references, and have any number of both.
+		parser.type			   = PROGRAM_TYPE_UNKNOWN;
+		parser.reference_count = 0;
+
+		char *reference;
+		int result = parse_program_line(&parser, line, &reference);
+
+		if (result == PROGRAM_LINE_STOP)
+		{
+			break;
+		}
+
+		if (result == PROGRAM_LINE_REFERENCE)
+		{
+			push_reference(stream, reference, parser.repeat_count);
+		}
+
+		push_parsed_exercises(stream, &program);
+	}
+
+	// The last exercise may not be followed by an empty line.
+	end_program_parsing(&parser);
+	push_parsed_exercises(stream, &program);
+
+	ATOMIC_STORE(&stream->ended, true);
+
+	return NULL;
+}
+
+b32 program_stream_start(ProgramStream *stream, FILE *file, char *program_dir)
+{
+	stream->file	= file;
+	stream->running = false;
+	stream->ended	= false;
+
+	snprintf(stream->program_dir, sizeof(stream->program_dir), "%s", program_dir);
+
+	ring_init(&stream->exercises, sizeof(Exercise), PROGRAM_STREAM_CAPACITY);
+
+	if (pthread_create(&stream->thread, NULL, stream_thread, stream) != 0)
+	{
+		fprintf(stderr, "%s: could not start reading the program.\n", PROGRAM);
+
+		ring_free(&stream->exercises);
+		return false;
+	}
+
+	stream->running = true;
+
+	return true;
+}
+
+void program_stream_stop(ProgramStream *stream)
+{
+	if (!stream->running)
+	{
+		return;
+	}
+
+	// Most likely waiting for a line, or for room.
+	pthread_cancel(stream->thread);
+	pthread_join(stream->thread, NULL);
+
+	stream->running = false;
+
+	ring_free(&stream->exercises);
+}
+
+b32 program_stream_next(ProgramStream *stream, Exercise *exercise)
+{
+	return ring_pop(&stream->exercises, exercise);
+}
@@ -0,0 +1,55 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "ring.h"
+
+// Exercises read but not run yet, at most: past that, the stream is
+// not read anymore (so whoever writes to it blocks) until the session
+// catches up.
+#define PROGRAM_STREAM_CAPACITY 16
+
+// Longer lines are ignored.
+#define MAX_PROGRAM_STREAM_LINE_SIZE 1024
+
+// In microseconds, how often a full stream checks for room.
+#define PROGRAM_STREAM_RETRY_DELAY 50000
+
+// Program text read as it is written (e.g: by a generator, through a
+// pipe), by its own thread: each exercise can be run as soon as its
+// block (up to the empty line after it) has been read.
+// References ("@NAME xN") are run in place, looked for in PROGRAM_DIR.
+struct ProgramStream
+{
+	FILE *file;
+	char program_dir[512];
+
+	SpscRing exercises;
+
+	pthread_t thread;
+	b32 running;
+
+	// Set once FILE has been read through, every exercise it had
+	// being in EXERCISES.
+	b32 ended;
+};
+
+b32 program_stream_start(ProgramStream *stream, FILE *file, char *program_dir);
+
+// Stops reading, whatever is left.
+void program_stream_stop(ProgramStream *stream);
+
+// Never blocks: returns false if no exercise has been read yet.
+b32 program_stream_next(ProgramStream *stream, Exercise *exercise);
+
+// NOTE: Checked before program_stream_next: once it returns true,
+//       program_stream_next returning false means there will be no
+//       other exercise.
+inline b32 program_stream_ended(ProgramStream *stream)
+{
+	return ATOMIC_LOAD(&stream->ended);
+}
+
+#endif
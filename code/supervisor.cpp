@@ -0,0 +1,402 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "intern.h"
+#include "supervisor.h"
+#include "timer.h"
+
+struct Child
+{
+	pid_t pid;
+
+	// -1 if the kernel has none (it is polled for then).
+	int pidfd;
+
+	// Interned, for messages.
+	u32 name;
+
+	// For released children only (see release_child), CLOCK_MONOTONIC.
+	b32 released;
+	b32 terminated;
+	u64 deadline;
+};
+
+// NOTE: Through syscall, older C libraries do not wrap it.
+internal int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+internal Child global_all_children[MAX_CHILD_COUNT];
+internal int global_child_count;
+internal pthread_mutex_t global_children_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Returns false if PID is not tracked.
+internal b32 find_child(pid_t pid, Child *child)
+{
+	pthread_mutex_lock(&global_children_lock);
+
+	b32 found = false;
+
+	for (int i = 0; (i < global_child_count) && !found; ++i)
+	{
+		if (global_all_children[i].pid == pid)
+		{
+			*child = global_all_children[i];
+			found = true;
+		}
+	}
+
+	pthread_mutex_unlock(&global_children_lock);
+
+	return found;
+}
+
+internal void forget_child(pid_t pid)
+{
+	pthread_mutex_lock(&global_children_lock);
+
+	for (int i = 0; i < global_child_count; ++i)
+	{
+		if (global_all_children[i].pid == pid)
+		{
+			if (global_all_children[i].pidfd != -1)
+			{
+				close(global_all_children[i].pidfd);
+			}
+
+			global_all_children[i] = global_all_children[--global_child_count];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&global_children_lock);
+}
+
+// Returns true once PID has exited (and is reaped), INFO telling how.
+// NOTE: If SIGCHLD is ignored, children are reaped by the kernel
+//       itself: they are known to be gone, not how they went.
+internal b32 try_reap(pid_t pid, siginfo_t *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	if (waitid(P_PID, pid, info, WEXITED | WNOHANG) == -1)
+	{
+		return true;
+	}
+
+	return (info->si_pid == pid);
+}
+
+// Returns false if PID still runs at DEADLINE (CLOCK_MONOTONIC).
+internal b32 wait_until(pid_t pid, int pidfd, u64 deadline, siginfo_t *info)
+{
+	for (;;)
+	{
+		if (try_reap(pid, info))
+		{
+			return true;
+		}
+
+		u64 now = get_monotonic_ns();
+
+		if (now >= deadline)
+		{
+			return false;
+		}
+
+		int timeout = (int) MIN((deadline - now + 999999) / 1000000, 1000);
+
+		if (pidfd != -1)
+		{
+			struct pollfd poll_fd = { pidfd, POLLIN, 0 };
+			poll(&poll_fd, 1, timeout);
+		}
+		else
+		{
+			usleep(1000);
+		}
+	}
+}
+
+// SIGTERM, then SIGKILL if it is still there after CHILD_KILL_GRACE.
+internal void kill_child(pid_t pid, int pidfd, siginfo_t *info)
+{
+	kill(pid, SIGTERM);
+
+	if (!wait_until(pid, pidfd, get_monotonic_ns() + CHILD_KILL_GRACE * 1000000ULL, info))
+	{
+		kill(pid, SIGKILL);
+
+		memset(info, 0, sizeof(*info));
+		waitid(P_PID, pid, info, WEXITED);
+	}
+}
+
+internal int report_exit(u32 name, siginfo_t *info)
+{
+	if ((info->si_code == CLD_EXITED) && info->si_status)
+	{
+		fprintf(stderr, "%s: command '%s' failed (exit status %d).\n", PROGRAM, get_string(name), info->si_status);
+		return CHILD_FAILED;
+	}
+
+	if ((info->si_code == CLD_KILLED) || (info->si_code == CLD_DUMPED))
+	{
+		fprintf(stderr, "%s: command '%s' was killed (signal %d).\n", PROGRAM, get_string(name), info->si_status);
+		return CHILD_FAILED;
+	}
+
+	return CHILD_OK;
+}
+
+pid_t spawn_child(char **argv, int flags, int in_fd, int out_fd)
+{
+	reap_children();
+
+	pthread_mutex_lock(&global_children_lock);
+
+	if (global_child_count == MAX_CHILD_COUNT)
+	{
+		pthread_mutex_unlock(&global_children_lock);
+
+		fprintf(stderr, "%s: command '%s': too many commands running (max %d).\n",
+				PROGRAM, argv[0], MAX_CHILD_COUNT);
+		return -1;
+	}
+
+	pid_t child_pid;
+
+	switch (child_pid = fork())
+	{
+		case -1:
+		{
+			pthread_mutex_unlock(&global_children_lock);
+
+			perror(argv[0]);
+			return -1;
+		}
+
+		case 0:
+		{
+			(in_fd != -1) ? dup2(in_fd, STDIN_FILENO) : 0;
+			(out_fd != -1) ? dup2(out_fd, STDOUT_FILENO) : 0;
+
+			if (!(flags & CHILD_EXEC_VERBOSE))
+			{
+				int fd;
+
+				if ((fd = open("/dev/null", O_WRONLY)) != -1)
+				{
+					(flags & CHILD_EXEC_NO_STDOUT) ? dup2(fd, STDOUT_FILENO) : 0;
+					(flags & CHILD_EXEC_NO_STDERR) ? dup2(fd, STDERR_FILENO) : 0;
+
+					close(fd);
+				}
+			}
+
+			execvp(argv[0], argv);
+
+			char buffer[255];
+			snprintf(buffer, sizeof(buffer), "%s: command '%s'", PROGRAM, argv[0]);
+
+			perror(buffer);
+
+			// NOTE: Not exit: the stdio buffers are the parent's.
+			_exit(1);
+		}
+
+		default:
+		{
+			Child *child = global_all_children + global_child_count++;
+
+			child->pid		  = child_pid;
+			child->pidfd	  = open_pidfd(child_pid);
+			child->name		  = intern_string(argv[0]);
+			child->released	  = false;
+			child->terminated = false;
+			child->deadline	  = 0;
+
+			pthread_mutex_unlock(&global_children_lock);
+		}
+	}
+
+	return child_pid;
+}
+
+int wait_child(pid_t pid, u32 timeout)
+{
+	Child child;
+
+	if (!find_child(pid, &child))
+	{
+		return CHILD_FAILED;
+	}
+
+	siginfo_t info;
+	int result;
+
+	if (wait_until(pid, child.pidfd, get_monotonic_ns() + timeout * 1000000ULL, &info))
+	{
+		result = report_exit(child.name, &info);
+	}
+	else
+	{
+		kill_child(pid, child.pidfd, &info);
+
+		fprintf(stderr, "%s: command '%s' did not finish within %.1fs, killed.\n",
+				PROGRAM, get_string(child.name), timeout / 1000.0f);
+
+		result = CHILD_TIMED_OUT;
+	}
+
+	forget_child(pid);
+
+	return result;
+}
+
+void release_child(pid_t pid, u32 timeout)
+{
+	pthread_mutex_lock(&global_children_lock);
+
+	for (int i = 0; i < global_child_count; ++i)
+	{
+		Child *child = global_all_children + i;
+
+		if (child->pid == pid)
+		{
+			child->released = true;
+			child->deadline = get_monotonic_ns() + timeout * 1000000ULL;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&global_children_lock);
+}
+
+void stop_child(pid_t pid)
+{
+	Child child;
+
+	if (!find_child(pid, &child))
+	{
+		return;
+	}
+
+	siginfo_t info;
+
+	// Quitting on its own by now is just as good.
+	if (!try_reap(pid, &info))
+	{
+		kill_child(pid, child.pidfd, &info);
+	}
+
+	forget_child(pid);
+}
+
+void reap_children()
+{
+	pthread_mutex_lock(&global_children_lock);
+
+	u64 now = get_monotonic_ns();
+
+	for (int i = 0; i < global_child_count;)
+	{
+		Child *child = global_all_children + i;
+		siginfo_t info;
+
+		if (!child->released)
+		{
+			++i;
+			continue;
+		}
+
+		if (try_reap(child->pid, &info))
+		{
+			if (!child->terminated)
+			{
+				report_exit(child->name, &info);
+			}
+
+			if (child->pidfd != -1)
+			{
+				close(child->pidfd);
+			}
+
+			*child = global_all_children[--global_child_count];
+			continue;
+		}
+
+		if (now >= child->deadline)
+		{
+			if (!child->terminated)
+			{
+				fprintf(stderr, "%s: command '%s' did not quit in time, killed.\n",
+						PROGRAM, get_string(child->name));
+
+				kill(child->pid, SIGTERM);
+
+				child->terminated = true;
+				child->deadline	  = now + CHILD_KILL_GRACE * 1000000ULL;
+			}
+			else
+			{
+				kill(child->pid, SIGKILL);
+			}
+		}
+
+		++i;
+	}
+
+	pthread_mutex_unlock(&global_children_lock);
+}
+
+void stop_all_children()
+{
+	for (;;)
+	{
+		pid_t pid = -1;
+
+		pthread_mutex_lock(&global_children_lock);
+
+		if (global_child_count)
+		{
+			pid = global_all_children[0].pid;
+		}
+
+		pthread_mutex_unlock(&global_children_lock);
+
+		if (pid == -1)
+		{
+			break;
+		}
+
+		stop_child(pid);
+	}
+}
+
+int child_exec(Command *command, int flags, u32 timeout)
+{
+	if (!command->argc)
+	{
+		return CHILD_OK;
+	}
+
+	pid_t child_pid = spawn_child(command->argv, flags);
+
+	if (child_pid == -1)
+	{
+		return CHILD_FAILED;
+	}
+
+	return wait_child(child_pid, timeout);
+}
@@ -0,0 +1,68 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <sys/types.h>
+
+#include "common.h"
+
+enum ChildExecFlag
+{
+	CHILD_EXEC_VERBOSE   = 1 << 0,
+	CHILD_EXEC_NO_STDOUT = 1 << 1,
+	CHILD_EXEC_NO_STDERR = 1 << 2,
+};
+
+enum ChildResult
+{
+	CHILD_OK,
+
+	// Could not be started, or exited with an error.
+	CHILD_FAILED,
+
+	// Still running past its deadline, so it was killed.
+	CHILD_TIMED_OUT,
+};
+
+// Children running at the same time, at most.
+#define MAX_CHILD_COUNT 32
+
+// In milliseconds: how long a child has to quit once sent SIGTERM,
+// before it is sent SIGKILL.
+#define CHILD_KILL_GRACE 100
+
+// In milliseconds, for child_exec.
+#define DEFAULT_CHILD_TIMEOUT 5000
+
+// NOTE: Every child is started through spawn_child, and waited for
+//       through a pidfd (so with a timeout): none can hang the
+//       session, or be left a zombie. Failures are reported on stderr.
+//       Safe to call from any thread.
+
+// Starts ARGV (looked for in the PATH), IN_FD and OUT_FD (if not -1)
+// being its stdin and stdout. Any other fd it should not keep must be
+// close-on-exec.
+// Returns its pid, -1 if it could not be started.
+pid_t spawn_child(char **argv, int flags = CHILD_EXEC_VERBOSE, int in_fd = -1, int out_fd = -1);
+
+// Waits for PID to exit, killing it if it still runs TIMEOUT
+// milliseconds later.
+int wait_child(pid_t pid, u32 timeout);
+
+// PID is left running: it is reaped once it exits, or killed if it
+// still runs TIMEOUT milliseconds later (see reap_children).
+void release_child(pid_t pid, u32 timeout);
+
+// Asks PID to quit (SIGTERM, then SIGKILL), and reaps it.
+void stop_child(pid_t pid);
+
+// Reaps released children that exited, kills those past their
+// deadline. Never blocks.
+void reap_children();
+
+// Before exiting.
+void stop_all_children();
+
+// Starts COMMAND and waits for it (see wait_child).
+int child_exec(Command *command, int flags = CHILD_EXEC_VERBOSE, u32 timeout = DEFAULT_CHILD_TIMEOUT);
+
+#endif
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Suspends a session halfway through a series, resumes it, and checks
+# that what was left of the series is run (see wait_and_print_chrono),
+# its milestones where they would have been.
+# Usage: resume.sh GO_MUSCU
+
+GO_MUSCU=${1:-./go-muscu}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+export XDG_CONFIG_HOME="$DIR/config"
+export XDG_CACHE_HOME="$DIR/cache"
+
+mkdir -p "$XDG_CONFIG_HOME/go-muscu/programs" "$XDG_CACHE_HOME"
+
+echo "setup_time=1" > "$XDG_CONFIG_HOME/go-muscu/go-muscu.conf"
+
+# 6s, a milestone every 2s.
+printf 'Plank\n1 6 2 1\n' > "$XDG_CONFIG_HOME/go-muscu/programs/plank"
+
+fail()
+{
+	echo "resume: $1"
+	exit 1
+}
+
+# q (suspend) 2.5s into the series.
+(sleep 3.5; printf q; sleep 1) | "$GO_MUSCU" -V -M --events json -p plank > "$DIR/first" 2> /dev/null
+
+grep -q '"type":"suspend"' "$DIR/first" || fail "the session was not suspended."
+
+# In nanoseconds.
+REMAINING=$(awk '$1 == "step" { print $3 }' "$XDG_CACHE_HOME/go-muscu/suspended_session")
+
+[ -n "$REMAINING" ] && [ "$REMAINING" -gt 0 ] && [ "$REMAINING" -lt 6000000000 ] ||
+	fail "no time left saved (got '$REMAINING')."
+
+"$GO_MUSCU" -V -M --events json --resume < /dev/null > "$DIR/second" 2> /dev/null
+
+field()
+{
+	sed -n "s/.*\"type\":\"$1\".*\"$2\":\([0-9]*\).*/\1/p" "$DIR/second" | head -n 1
+}
+
+T=$(sed -n 's/^{"t":\([0-9]*\),"type":"series_start".*/\1/p' "$DIR/second")
+END=$(field series_start end)
+ELAPSED=$(field milestone elapsed)
+AT=$(field milestone at)
+
+[ -n "$T" ] && [ -n "$END" ] || fail "the series was not resumed."
+
+# What was left, give or take 100ms.
+awk -v left="$((END - T))" -v expected="$REMAINING" \
+	'BEGIN { d = left - expected; exit !((d < 100000000) && (d > -100000000)) }' ||
+	fail "resumed with $((END - T))ns left, $REMAINING expected."
+
+[ "$ELAPSED" = 4000 ] || fail "next milestone at ${ELAPSED}ms, 4000 expected."
+[ "$((END - AT))" = 2000000000 ] || fail "milestone $((END - AT))ns before the end, 2000000000 expected."
+
+echo "resume: ok"
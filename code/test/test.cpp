@@ -0,0 +1,192 @@
+// Unit tests (see `make test`): each prints what went wrong, if
+// anything, and the exit status is the number of tests that failed.
+
+#include "builtin.h"
+#include "intern.h"
+#include "timer.h"
+
+#define MS 1000000ULL
+
+struct RearmTest
+{
+	Timer first;
+	Timer far;
+	Timer near;
+
+	// In nanoseconds, the NOW of the advance that ran them (0: not
+	// run).
+	u64 far_run_at;
+	u64 near_run_at;
+
+	TimerWheel *wheel;
+	u64 now;
+};
+
+internal void run_far(Timer *, void *data)
+{
+	RearmTest *test = (RearmTest *) data;
+	test->far_run_at = test->now;
+}
+
+internal void run_near(Timer *, void *data)
+{
+	RearmTest *test = (RearmTest *) data;
+	test->near_run_at = test->now;
+}
+
+// Adds a timer 64 ticks away from the tick being run, and one right
+// after it.
+internal void rearm(Timer *, void *data)
+{
+	RearmTest *test = (RearmTest *) data;
+
+	timer_add(test->wheel, &test->far, 69 * MS + MS / 2, run_far, test);
+	timer_add(test->wheel, &test->near, 10 * MS, run_near, test);
+}
+
+// A callback adding a timer 64 ticks ahead must not hold back the
+// others (nor leave a deadline that has passed already).
+internal int test_timer_rearm()
+{
+	TimerWheel wheel;
+	timer_wheel_init(&wheel, 0);
+
+	RearmTest test = {};
+	test.wheel = &wheel;
+
+	timer_add(&wheel, &test.first, 5 * MS, rearm, &test);
+
+	for (test.now = 0; test.now <= 80 * MS; test.now += MS)
+	{
+		timer_wheel_advance(&wheel, test.now);
+
+		u64 deadline;
+
+		if (timer_wheel_next_deadline(&wheel, &deadline) && (deadline <= test.now))
+		{
+			printf("timer_rearm: next deadline %llums, at %llums.\n",
+				   (unsigned long long) (deadline / MS), (unsigned long long) (test.now / MS));
+			return 1;
+		}
+	}
+
+	if ((test.near_run_at != 10 * MS) || (test.far_run_at != 70 * MS))
+	{
+		printf("timer_rearm: run at %llums and %llums, 10ms and 70ms expected.\n",
+			   (unsigned long long) (test.near_run_at / MS), (unsigned long long) (test.far_run_at / MS));
+		return 1;
+	}
+
+	return 0;
+}
+
+// Built-in programs are parsed at compile time, by a parser of their
+// own: it must agree with parse_program_line on every one of them.
+internal int test_builtin_programs()
+{
+	int failed_count = 0;
+
+	for (int i = 0; i < builtin_program_count(); ++i)
+	{
+		const BuiltinProgram *builtin = get_builtin_program(i);
+
+		char name[64];
+		snprintf(name, sizeof(name), "%s%s", BUILTIN_PREFIX, builtin->name);
+
+		Program expected = {};
+		load_builtin_program(name, &expected);
+
+		Program program = {};
+		ProgramParser parser;
+		init_program_parser(&parser, name, &program, stdout);
+
+		for (const char *line = builtin->text; *line;)
+		{
+			const char *end_line = strchr(line, '\n');
+			size_t len = end_line ? (size_t) (end_line - line) : strlen(line);
+
+			char buffer[256];
+			snprintf(buffer, sizeof(buffer), "%.*s", (int) len, line);
+
+			char *reference;
+			parse_program_line(&parser, buffer, &reference);
+
+			line += len + (end_line != NULL);
+		}
+
+		if (end_program_parsing(&parser) != 0)
+		{
+			++failed_count;
+			continue;
+		}
+
+		if (program.exercise_count != expected.exercise_count)
+		{
+			printf("builtin_programs: %s: %d exercises, %d expected.\n",
+				   name, program.exercise_count, expected.exercise_count);
+
+			++failed_count;
+			continue;
+		}
+
+		for (int j = 0; j < program.exercise_count; ++j)
+		{
+			Exercise *a = program.all_exercises + j;
+			Exercise *b = expected.all_exercises + j;
+
+			if ((a->name != b->name) ||
+				(a->series_count != b->series_count) ||
+				(a->duration != b->duration) ||
+				(a->milestone != b->milestone) ||
+				(a->pause_duration != b->pause_duration) ||
+				memcmp(a->tempo, b->tempo, sizeof(a->tempo)))
+			{
+				printf("builtin_programs: %s: exercise '%s' parsed differently.\n",
+					   name, get_string(a->name));
+
+				++failed_count;
+				break;
+			}
+		}
+	}
+
+	// Rejected by parse_program_line as well.
+	const char *invalid_text = "Squats\n5 180\nBench press\n5 180\n";
+
+	if (parse_builtin_program("invalid", invalid_text).error_line != 3)
+	{
+		printf("builtin_programs: missing empty line after an exercise not reported.\n");
+		++failed_count;
+	}
+
+	return failed_count;
+}
+
+// Looking a string up must not intern it.
+internal int test_find_string()
+{
+	u32 id = intern_string("find_string");
+
+	if ((find_string("find_string") != id) ||
+		(find_string(".find_string.swp") != EMPTY_STRING_ID) ||
+		(find_string(".find_string.swp") != EMPTY_STRING_ID))
+	{
+		printf("find_string: wrong id.\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	int failed_count = 0;
+
+	failed_count += test_timer_rearm();
+	failed_count += test_builtin_programs();
+	failed_count += test_find_string();
+
+	printf("%s\n", failed_count ? "failed" : "ok");
+
+	return failed_count;
+}
@@ -0,0 +1,336 @@
+#include <time.h>
+#include <errno.h>
+
+#include "timer.h"
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOT_COUNT - 1)
+
+u64 get_monotonic_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (u64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void sleep_until_ns(u64 monotonic_ns)
+{
+	struct timespec deadline;
+	deadline.tv_sec  = monotonic_ns / 1000000000ULL;
+	deadline.tv_nsec = monotonic_ns % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+internal inline void list_init(Timer *head)
+{
+	head->next = head;
+	head->prev = head;
+}
+
+internal inline b32 list_is_empty(Timer *head)
+{
+	return (head->next == head);
+}
+
+internal inline void list_append(Timer *head, Timer *timer)
+{
+	timer->prev		  = head->prev;
+	timer->next		  = head;
+	head->prev->next  = timer;
+	head->prev		  = timer;
+}
+
+internal inline void list_remove(Timer *timer)
+{
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *wheel, u64 epoch_ns)
+{
+	wheel->epoch_ns		 = epoch_ns;
+	wheel->current_tick	 = 0;
+	wheel->pending_count = 0;
+
+	for (int level = 0; level < TIMER_WHEEL_LEVEL_COUNT; ++level)
+	{
+		FOR_EACH_IT(Timer, wheel->slots[level])
+		{
+			list_init(it);
+		}
+	}
+}
+
+u64 timer_wheel_now(TimerWheel *wheel)
+{
+	u64 now = get_monotonic_ns();
+
+	return (now > wheel->epoch_ns) ? (now - wheel->epoch_ns) : 0;
+}
+
+void timer_wheel_shift(TimerWheel *wheel, u64 delta_ns)
+{
+	wheel->epoch_ns += delta_ns;
+}
+
+// Puts the timer in the slot covering its deadline, as seen from the
+// next tick to run (level 0 for the next 64 ticks, level 1 for the
+// next 64^2, ...).
+// NOTE: Added while a tick's slot is being run (by a callback), a
+//       timer 64 ticks from it goes in that very slot (see
+//       timer_wheel_advance).
+internal void insert_timer(TimerWheel *wheel, Timer *timer)
+{
+	u64 tick = timer->deadline / TIMER_TICK_NS;
+	u64 next_tick = wheel->current_tick + 1;
+
+	// Overdue timers are run on the next advance.
+	if (tick < next_tick)
+	{
+		tick = next_tick;
+	}
+
+	u64 delta = tick - next_tick;
+
+	int level = 0;
+
+	while ((level < TIMER_WHEEL_LEVEL_COUNT - 1) &&
+		   (delta >= (1ULL << ((level + 1) * TIMER_WHEEL_LEVEL_BITS))))
+	{
+		++level;
+	}
+
+	// Further than the wheel can see: parked in the last slot of
+	// the last level, it will be put back in place once cascaded.
+	u64 max_delta = (1ULL << (TIMER_WHEEL_LEVEL_COUNT * TIMER_WHEEL_LEVEL_BITS)) - 1;
+
+	if (delta > max_delta)
+	{
+		tick = next_tick + max_delta;
+	}
+
+	int slot = (tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK;
+
+	list_append(&wheel->slots[level][slot], timer);
+}
+
+void timer_add(TimerWheel *wheel, Timer *timer, u64 deadline,
+			   TimerCallback *callback, void *data)
+{
+	if (timer_is_pending(timer))
+	{
+		timer_cancel(wheel, timer);
+	}
+
+	timer->deadline = deadline;
+	timer->callback = callback;
+	timer->data		= data;
+
+	insert_timer(wheel, timer);
+	++wheel->pending_count;
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer)
+{
+	if (!timer_is_pending(timer))
+	{
+		return;
+	}
+
+	list_remove(timer);
+	--wheel->pending_count;
+}
+
+b32 timer_wheel_next_deadline(TimerWheel *wheel, u64 *deadline)
+{
+	if (!wheel->pending_count)
+	{
+		return false;
+	}
+
+	b32 found = false;
+	u64 earliest = 0;
+
+	// Slots are ordered in time from the current one, so only the
+	// first non-empty slot of each level matters.
+	for (int level = 0; level < TIMER_WHEEL_LEVEL_COUNT; ++level)
+	{
+		int current_slot = (wheel->current_tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK;
+
+		for (int i = 1; i <= TIMER_WHEEL_SLOT_COUNT; ++i)
+		{
+			Timer *head = &wheel->slots[level][(current_slot + i) & TIMER_WHEEL_SLOT_MASK];
+
+			if (list_is_empty(head))
+			{
+				continue;
+			}
+
+			for (Timer *timer = head->next; timer != head; timer = timer->next)
+			{
+				if (!found || (timer->deadline < earliest))
+				{
+					earliest = timer->deadline;
+					found = true;
+				}
+			}
+
+			break;
+		}
+	}
+
+	*deadline = earliest;
+
+	return found;
+}
+
+internal b32 level_is_empty(TimerWheel *wheel, int level)
+{
+	FOR_EACH_IT(Timer, wheel->slots[level])
+	{
+		if (!list_is_empty(it))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Puts back every timer of a higher level slot, now that it is
+// close enough to go down one level.
+internal void cascade(TimerWheel *wheel, int level, int slot)
+{
+	Timer *head = &wheel->slots[level][slot];
+
+	while (!list_is_empty(head))
+	{
+		Timer *timer = head->next;
+
+		list_remove(timer);
+		insert_timer(wheel, timer);
+	}
+}
+
+void timer_wheel_advance(TimerWheel *wheel, u64 now)
+{
+	u64 now_tick = now / TIMER_TICK_NS;
+
+	// The tick after now's is looked at too: overdue timers are put
+	// there (see insert_timer), and only the timers that are due are
+	// run anyway.
+	while (wheel->current_tick <= now_tick)
+	{
+		// Nothing to run nor to cascade before the lowest non-empty
+		// level's next cascade: jump right before it.
+		u64 skip_to = now_tick;
+
+		for (int level = 0; level < TIMER_WHEEL_LEVEL_COUNT; ++level)
+		{
+			if (level_is_empty(wheel, level))
+			{
+				continue;
+			}
+
+			if (level == 0)
+			{
+				skip_to = wheel->current_tick;
+			}
+			else
+			{
+				int shift = level * TIMER_WHEEL_LEVEL_BITS;
+				u64 next_cascade = ((wheel->current_tick >> shift) + 1) << shift;
+
+				skip_to = MIN(skip_to, next_cascade - 1);
+			}
+
+			break;
+		}
+
+		if (skip_to > wheel->current_tick)
+		{
+			wheel->current_tick = skip_to;
+			continue;
+		}
+
+		// Cascading before the tick is marked as done, so timers of
+		// this very tick land in its level 0 slot.
+		u64 tick = wheel->current_tick + 1;
+
+		for (int level = 1; level < TIMER_WHEEL_LEVEL_COUNT; ++level)
+		{
+			u64 lower_ticks = tick >> ((level - 1) * TIMER_WHEEL_LEVEL_BITS);
+
+			if (lower_ticks & TIMER_WHEEL_SLOT_MASK)
+			{
+				break;
+			}
+
+			cascade(wheel, level, (tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK);
+		}
+
+		wheel->current_tick = tick;
+
+		Timer *head = &wheel->slots[0][tick & TIMER_WHEEL_SLOT_MASK];
+
+		// The ones from this tick that are not due yet are kept aside
+		// until it is done, as are those a callback added 64 ticks
+		// from now (this slot is theirs too, see insert_timer).
+		Timer not_due;
+		list_init(&not_due);
+
+		Timer next_lap;
+		list_init(&next_lap);
+
+		while (!list_is_empty(head))
+		{
+			Timer *timer = head->next;
+			list_remove(timer);
+
+			if (timer->deadline / TIMER_TICK_NS > tick)
+			{
+				list_append(&next_lap, timer);
+				continue;
+			}
+
+			if (timer->deadline > now)
+			{
+				// Same tick, but not quite yet.
+				list_append(&not_due, timer);
+				continue;
+			}
+
+			--wheel->pending_count;
+			timer->callback(timer, timer->data);
+		}
+
+		// NOTE: Not waited for: the wheel goes on, and runs them once
+		//       it is back to this slot.
+		while (!list_is_empty(&next_lap))
+		{
+			Timer *timer = next_lap.next;
+
+			list_remove(timer);
+			list_append(head, timer);
+		}
+
+		if (!list_is_empty(&not_due))
+		{
+			while (!list_is_empty(&not_due))
+			{
+				Timer *timer = not_due.next;
+
+				list_remove(timer);
+				list_append(head, timer);
+			}
+
+			// This tick has to be looked at again.
+			--wheel->current_tick;
+			break;
+		}
+	}
+}
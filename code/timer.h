@@ -0,0 +1,71 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "ef_utils.h"
+
+// Hierarchical timing wheel: each level has 64 slots, a slot of
+// level L covering 64^L ticks. Timers are kept in intrusive lists,
+// so adding and cancelling one is O(1), whatever the number of
+// pending timers.
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_SLOT_COUNT  (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVEL_COUNT 4
+
+#define TIMER_TICK_NS 1000000ULL
+
+struct Timer;
+
+typedef void TimerCallback(Timer *timer, void *data);
+
+struct Timer
+{
+	Timer *next;
+	Timer *prev;
+
+	// In nanoseconds, since the wheel's epoch.
+	u64 deadline;
+
+	TimerCallback *callback;
+	void *data;
+};
+
+struct TimerWheel
+{
+	// CLOCK_MONOTONIC time of the wheel's time 0.
+	u64 epoch_ns;
+
+	// Last tick whose timers have all been run.
+	u64 current_tick;
+
+	u32 pending_count;
+
+	// List heads (only next and prev are used).
+	Timer slots[TIMER_WHEEL_LEVEL_COUNT][TIMER_WHEEL_SLOT_COUNT];
+};
+
+u64 get_monotonic_ns();
+void sleep_until_ns(u64 monotonic_ns);
+
+void timer_wheel_init(TimerWheel *wheel, u64 epoch_ns);
+u64  timer_wheel_now(TimerWheel *wheel);
+
+// Moves the wheel's time (and so every pending timer) forward
+// (e.g: after a pause).
+void timer_wheel_shift(TimerWheel *wheel, u64 delta_ns);
+
+void timer_add(TimerWheel *wheel, Timer *timer, u64 deadline,
+			   TimerCallback *callback, void *data);
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+
+inline b32 timer_is_pending(Timer *timer)
+{
+	return (timer->next != NULL);
+}
+
+// Returns false if no timer is pending.
+b32  timer_wheel_next_deadline(TimerWheel *wheel, u64 *deadline);
+
+// Runs every timer whose deadline is <= now.
+void timer_wheel_advance(TimerWheel *wheel, u64 now);
+
+#endif
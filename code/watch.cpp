@@ -0,0 +1,127 @@
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+b32 watch_open(Watch *watch)
+{
+	watch->directory_count = 0;
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	return (watch->fd != -1);
+}
+
+void watch_close(Watch *watch)
+{
+	if (watch->fd != -1)
+	{
+		// Closing it removes every watch.
+		close(watch->fd);
+		watch->fd = -1;
+	}
+
+	watch->directory_count = 0;
+}
+
+int watch_directory(Watch *watch, char *path)
+{
+	if ((watch->fd == -1) || (watch->directory_count == MAX_WATCHED_DIRECTORY_COUNT))
+	{
+		return -1;
+	}
+
+	int descriptor = inotify_add_watch(watch->fd, path, WATCH_MASK | IN_ONLYDIR);
+
+	if (descriptor == -1)
+	{
+		return -1;
+	}
+
+	watch->all_descriptors[watch->directory_count] = descriptor;
+
+	return watch->directory_count++;
+}
+
+internal int find_directory(Watch *watch, int descriptor)
+{
+	for (int i = 0; i < watch->directory_count; ++i)
+	{
+		if (watch->all_descriptors[i] == descriptor)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int watch_read(Watch *watch, WatchEvent *all_events, int max_event_count)
+{
+	if (watch->fd == -1)
+	{
+		return 0;
+	}
+
+	// NOTE: inotify never splits an event across reads.
+	alignas(struct inotify_event) char buffer[4096];
+
+	int event_count = 0;
+	b32 lost = false;
+
+	ssize_t num_read;
+
+	while ((num_read = read(watch->fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *at = buffer; at < buffer + num_read;)
+		{
+			struct inotify_event *event = (struct inotify_event *) at;
+			at += sizeof(*event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				lost = true;
+				continue;
+			}
+
+			int directory = find_directory(watch, event->wd);
+
+			if ((directory == -1) || !event->len)
+			{
+				continue;
+			}
+
+			// An editor saving a file usually makes a few of them.
+			b32 seen = false;
+
+			for (int i = 0; i < event_count; ++i)
+			{
+				if ((all_events[i].directory == directory) &&
+					(strcmp(all_events[i].name, event->name) == 0))
+				{
+					seen = true;
+					break;
+				}
+			}
+
+			if (seen)
+			{
+				continue;
+			}
+
+			if (event_count == max_event_count)
+			{
+				lost = true;
+				continue;
+			}
+
+			WatchEvent *result = all_events + event_count++;
+
+			result->directory = directory;
+			snprintf(result->name, sizeof(result->name), "%s", event->name);
+		}
+	}
+
+	return lost ? -1 : event_count;
+}
@@ -0,0 +1,43 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "common.h"
+
+#define MAX_WATCHED_DIRECTORY_COUNT 4
+
+// Files of a few directories that changed, through inotify: written
+// (and closed), moved in or out, or deleted. Only what changed is
+// reported, whatever the number of files in the directories.
+struct Watch
+{
+	// Non-blocking, -1 if inotify is not available.
+	int fd;
+
+	int all_descriptors[MAX_WATCHED_DIRECTORY_COUNT];
+	int directory_count;
+};
+
+struct WatchEvent
+{
+	// As returned by watch_directory.
+	int directory;
+
+	// Of the file, in its directory.
+	char name[256];
+};
+
+// Returns false if inotify is not available.
+b32  watch_open(Watch *watch);
+void watch_close(Watch *watch);
+
+// Returns the directory's index (see WatchEvent), -1 if it cannot be
+// watched (e.g: it does not exist).
+int watch_directory(Watch *watch, char *path);
+
+// Returns how many files changed since the last call (0 if none), each
+// reported once however many times it changed, or -1 if some changes
+// were lost (more than MAX_EVENT_COUNT files, or inotify's queue
+// overflowed): anything may have changed.
+int watch_read(Watch *watch, WatchEvent *all_events, int max_event_count);
+
+#endif